@@ -22,14 +22,41 @@ Button::Button(Widget *parent, const std::string &caption, int icon)
       mFlags(NormalButton), mBackgroundColor(Color(0, 0)),
       mTextColor(Color(0, 0)) 
 {
+  updateFontIds();
   _captionTex.dirty = true;
   _iconTex.dirty = true;
 }
 
+void Button::setTheme(Theme *theme)
+{
+  Widget::setTheme(theme);
+  updateFontIds();
+}
+
+void Button::setFontSize(int fontSize)
+{
+  Widget::setFontSize(fontSize);
+  updateFontIds();
+  _captionTex.dirty = true;
+  _iconTex.dirty = true;
+}
+
+void Button::updateFontIds()
+{
+  if (!mTheme)
+  {
+    mCaptionFont = mIconFont = kInvalidFont;
+    return;
+  }
+  int fontSize = mFontSize == -1 ? mTheme->mButtonFontSize : mFontSize;
+  mCaptionFont = mTheme->fontId("sans-bold", fontSize);
+  mIconFont = mTheme->fontId("icons", fontSize * 1.5f);
+}
+
 Vector2i Button::preferredSize(SDL_Renderer *ctx) const
 {
     int fontSize = mFontSize == -1 ? mTheme->mButtonFontSize : mFontSize;
-    float tw = const_cast<Button*>(this)->mTheme->getTextWidth("sans-bold", fontSize, mCaption.c_str());
+    float tw = const_cast<Button*>(this)->mTheme->getTextWidth(mCaptionFont, mCaption.c_str());
     float iw = 0.0f, ih = fontSize;
 
     if (mIcon) 
@@ -37,7 +64,7 @@ Vector2i Button::preferredSize(SDL_Renderer *ctx) const
         if (nvgIsFontIcon(mIcon)) 
         {
             ih *= 1.5f;
-            iw = const_cast<Button*>(this)->mTheme->getUtf8Width("icons", ih, utf8(mIcon).data())  + mSize.y * 0.15f;
+            iw = const_cast<Button*>(this)->mTheme->getUtf8Width(mIconFont, utf8(mIcon).data())  + mSize.y * 0.15f;
         } 
         else 
         {
@@ -211,7 +238,7 @@ void Button::draw(SDL_Renderer* renderer)
     if (!mEnabled)
       sdlTextColor = mTheme->mDisabledTextColor;
 
-    mTheme->getTexAndRectUtf8(renderer, _captionTex, 0, 0, mCaption.c_str(), "sans-bold", fontSize, sdlTextColor);
+    mTheme->getTexAndRectUtf8(renderer, _captionTex, 0, 0, mCaption.c_str(), mCaptionFont, sdlTextColor);
   }
 
   Vector2f center(ap.x + width() * 0.5f, ap.y + height() * 0.5f);
@@ -231,7 +258,7 @@ void Button::draw(SDL_Renderer* renderer)
       if (nvgIsFontIcon(mIcon))
       {
         ih *= 1.5f;
-        mTheme->getTexAndRectUtf8(renderer, _iconTex, 0, 0, icon.data(), "icons", ih, sdlTextColor);
+        mTheme->getTexAndRectUtf8(renderer, _iconTex, 0, 0, icon.data(), mIconFont, sdlTextColor);
         iw = _iconTex.w();
       }
       else
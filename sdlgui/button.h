@@ -83,6 +83,8 @@ public:
     virtual bool mouseButtonEvent(const Vector2i &p, int button, bool down, int modifiers) override;
     virtual void draw(SDL_Renderer* renderer) override;
     virtual void drawBody(SDL_Renderer* renderer);
+    void setTheme(Theme *theme) override;
+    void setFontSize(int fontSize) override;
     virtual Color bodyColor();
 
     Button& withCallback(const std::function<void()> &callback) { setCallback( callback ); return *this; }
@@ -91,6 +93,9 @@ public:
     Button& withBackgroundColor(const Color& color) { setBackgroundColor( color ); return *this; }
     Button& withIcon(int icon) { setIcon( icon ); return *this; }
 protected:
+    /// Resolves the caption and icon fonts after the font size or the theme changed
+    void updateFontIds();
+
     std::string mCaption;
     intptr_t mIcon;
     IconPosition mIconPosition;
@@ -99,6 +104,9 @@ protected:
     Color mBackgroundColor;
     Color mTextColor;
 
+    FontId mCaptionFont = kInvalidFont;
+    FontId mIconFont = kInvalidFont;
+
     Texture _captionTex;
     Texture _iconTex;
 
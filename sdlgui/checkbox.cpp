@@ -21,10 +21,24 @@ CheckBox::CheckBox(Widget *parent, const std::string &caption,
     : Widget(parent), mCaption(caption), mPushed(false), mChecked(false),
       mCallback(callback) 
 {
+  mCaptionFont = mTheme ? mTheme->fontId("sans", fontSize()) : kInvalidFont;
   _captionTex.dirty = true;
   _pointTex.dirty = true;
 }
 
+void CheckBox::setTheme(Theme *theme)
+{
+  Widget::setTheme(theme);
+  mCaptionFont = mTheme ? mTheme->fontId("sans", fontSize()) : kInvalidFont;
+}
+
+void CheckBox::setFontSize(int fontSize)
+{
+  Widget::setFontSize(fontSize);
+  mCaptionFont = mTheme ? mTheme->fontId("sans", this->fontSize()) : kInvalidFont;
+  _captionTex.dirty = true;
+}
+
 bool CheckBox::mouseButtonEvent(const Vector2i &p, int button, bool down,
                                 int modifiers) 
 {
@@ -59,7 +73,7 @@ Vector2i CheckBox::preferredSize(SDL_Renderer *ctx) const
         return mFixedSize;
 
     int w, h;
-    const_cast<CheckBox*>(this)->mTheme->getTextBounds("sans", fontSize(), mCaption.c_str(), &w, &h);
+    const_cast<CheckBox*>(this)->mTheme->getTextBounds(mCaptionFont, mCaption.c_str(), &w, &h);
     return Vector2i(w + 1.7f * fontSize(),  fontSize() * 1.3f);
 }
 
@@ -70,7 +84,7 @@ void CheckBox::draw(SDL_Renderer *renderer)
   if (_captionTex.dirty)
   {
     Color tColor = (mEnabled ? mTheme->mTextColor : mTheme->mDisabledTextColor);
-    mTheme->getTexAndRectUtf8(renderer, _captionTex, 0, 0, mCaption.c_str(), "sans", fontSize(), tColor);
+    mTheme->getTexAndRectUtf8(renderer, _captionTex, 0, 0, mCaption.c_str(), mCaptionFont, tColor);
     mTheme->getTexAndRectUtf8(renderer, _pointTex, 0, 0, utf8(ENTYPO_ICON_CHECK).data(), "icons", 1.8 * mSize.y, tColor);
   }
  
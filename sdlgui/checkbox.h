@@ -37,9 +37,12 @@ public:
     virtual bool mouseButtonEvent(const Vector2i &p, int button, bool down, int modifiers);
     Vector2i preferredSize(SDL_Renderer *ctx) const override;
     void draw(SDL_Renderer *ctx) override;
+    void setTheme(Theme *theme) override;
+    void setFontSize(int fontSize) override;
 protected:
     std::string mCaption;
     bool mPushed, mChecked;
+    FontId mCaptionFont = kInvalidFont;
 
     Texture _captionTex;
     Texture _pointTex;
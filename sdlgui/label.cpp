@@ -25,6 +25,7 @@ Label::Label(Widget *parent, const std::string &caption, const std::string &font
     if (fontSize >= 0) 
       mFontSize = fontSize;
 
+    updateFontId();
     _texture.dirty = true;
 }
 
@@ -36,6 +37,13 @@ void Label::setTheme(Theme *theme)
         mFontSize = mTheme->mStandardFontSize;
         mColor = mTheme->mTextColor;
     }
+    updateFontId();
+    _texture.dirty = true;
+}
+
+void Label::updateFontId()
+{
+    mFontId = mTheme ? mTheme->fontId(mFont.c_str(), fontSize()) : kInvalidFont;
 }
 
 Vector2i Label::preferredSize(SDL_Renderer *ctx) const
@@ -43,16 +51,16 @@ Vector2i Label::preferredSize(SDL_Renderer *ctx) const
     if (mCaption == "")
         return Vector2i::Zero();
     
+    Theme* theme = const_cast<Label*>(this)->mTheme;
     if (mFixedSize.x > 0) 
     {
-      int w, h;
-      const_cast<Label*>(this)->mTheme->getUtf8Bounds(mFont.c_str(), fontSize(), mCaption.c_str(), &w, &h);
-      return Vector2i(mFixedSize.x, h);
+      const std::vector<TextRow>& rows = theme->breakLines(mFontId, mCaption.c_str(), mFixedSize.x, TextBreak::Word);
+      return Vector2i(mFixedSize.x, theme->fontHeight(mFontId) * std::max<int>(1, (int)rows.size()));
     } 
     else 
     {
       int w, h;
-      const_cast<Label*>(this)->mTheme->getUtf8Bounds(mFont.c_str(), fontSize(), mCaption.c_str(), &w, &h);
+      theme->getUtf8Bounds(mFontId, mCaption.c_str(), &w, &h);
       return Vector2i(w, mTheme->mStandardFontSize);
     }
 }
@@ -60,6 +68,7 @@ Vector2i Label::preferredSize(SDL_Renderer *ctx) const
 void Label::setFontSize(int fontSize)
 {
   Widget::setFontSize(fontSize);
+  updateFontId();
   _texture.dirty = true;
 }
 
@@ -67,8 +76,37 @@ void Label::draw(SDL_Renderer *renderer)
 {
   Widget::draw(renderer);
 
+  if (mFixedSize.x > 0 && !mCaption.empty())
+  {
+    const std::vector<TextRow>& rows = mTheme->breakLines(mFontId, mCaption.c_str(), mFixedSize.x, TextBreak::Word);
+    if (_texture.dirty || _rowTextures.size() != rows.size())
+    {
+#ifndef SDLGUI_GLYPH_ATLAS
+      for (size_t i = rows.size(); i < _rowTextures.size(); i++)
+        if (_rowTextures[i].tex)
+          SDL_DestroyTexture(_rowTextures[i].tex);
+#endif
+      _rowTextures.resize(rows.size());
+      for (size_t i = 0; i < rows.size(); i++)
+      {
+        std::string row = mCaption.substr(rows[i].begin, rows[i].end - rows[i].begin);
+        mTheme->getTexAndRectUtf8(renderer, _rowTextures[i], 0, 0, row.c_str(), mFontId, mColor);
+      }
+      _texture.dirty = false;
+    }
+
+    int h = mTheme->fontHeight(mFontId);
+    Vector2i pos = absolutePosition();
+    for (auto& row : _rowTextures)
+    {
+      SDL_RenderCopy(renderer, row, pos);
+      pos.y += h;
+    }
+    return;
+  }
+
   if (_texture.dirty)
-    mTheme->getTexAndRectUtf8(renderer, _texture, 0, 0, mCaption.c_str(), mFont.c_str(), fontSize(), mColor);
+    mTheme->getTexAndRectUtf8(renderer, _texture, 0, 0, mCaption.c_str(), mFontId, mColor);
 
   if (mFixedSize.x > 0) 
     SDL_RenderCopy(renderer, _texture, absolutePosition());
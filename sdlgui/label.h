@@ -32,17 +32,17 @@ public:
     /// Get the label's text caption
     const std::string &caption() const { return mCaption; }
     /// Set the label's text caption
-    void setCaption(const std::string &caption) { mCaption = caption; }
+    void setCaption(const std::string &caption) { mCaption = caption; _texture.dirty = true; }
 
     /// Set the currently active font (2 are available by default: 'sans' and 'sans-bold')
-    void setFont(const std::string &font) { mFont = font; }
+    void setFont(const std::string &font) { mFont = font; updateFontId(); _texture.dirty = true; }
     /// Get the currently active font
     const std::string &font() const { return mFont; }
 
     /// Get the label color
     Color color() const { return mColor; }
     /// Set the label color
-    void setColor(const Color& color) { mColor = color; }
+    void setColor(const Color& color) { mColor = color; _texture.dirty = true; }
 
     /// Set the \ref Theme used to draw this widget
     virtual void setTheme(Theme *theme) override;
@@ -55,10 +55,15 @@ public:
     void setFontSize(int fontSize) override;
 
 protected:
+    /// Resolves mFontId after the font, its size or the theme changed
+    void updateFontId();
+
     std::string mCaption;
     std::string mFont;
+    FontId mFontId = kInvalidFont;
     Color mColor;
     Texture _texture;
+    std::vector<Texture> _rowTextures;  // One per wrapped row with a fixed width.
 };
 
 NAMESPACE_END(sdlgui)
@@ -36,12 +36,21 @@ THE SOFTWARE.
 #include <cstdlib>
 #include <cstring>
 #include <string>
+#include <functional>
+
+#if !defined(NANORT_NO_SIMD) &&                                               \
+    (defined(__SSE2__) || defined(_M_X64) ||                                   \
+     (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define NANORT_USE_SSE2 (1)
+#include <emmintrin.h>
+#else
+#define NANORT_USE_SSE2 (0)
+#endif
 
 namespace nanort {
 
-// Parallelized BVH build is not yet fully tested,
-// thus turn off if you face a problem when building BVH.
-#define NANORT_ENABLE_PARALLEL_BUILD (0)
+// Number of rays in a RayPacket, a multiple of the 4 SSE lanes.
+#define NANORT_PACKET_SIZE (8)
 
 // Small vector class useful for multi-threaded environment.
 //
@@ -113,7 +122,7 @@ public:
 
   // For the straight up copy c-tor, we can share storage.
   StackAllocator(const StackAllocator<T, stack_capacity> &rhs)
-      : source_(rhs.source_) {}
+      : std::allocator<T>(rhs), source_(rhs.source_) {}
 
   // ISO C++ requires the following constructor to be defined,
   // and std::vector in VC++2008SP1 Release fails with an error
@@ -373,6 +382,13 @@ typedef struct {
   int dirSign[3];  // filled internally
 } Ray;
 
+// Parallel rays traced together, only their origins differ.
+typedef struct {
+  float org[3][NANORT_PACKET_SIZE]; // must set, org[axis][ray]
+  float dir[3];                     // must set, shared by all rays
+  int count;                        // must set, rays in use
+} RayPacket;
+
 class BVHNode {
 public:
   BVHNode(){};
@@ -594,6 +610,13 @@ struct BVHBuildOptions {
   // Requires more memory, but BVHbuild can be faster.
   bool cacheBBox;
 
+  // Runs job(0) .. job(count - 1), possibly concurrently, and returns once
+  // all of them are done. When set, meshes of more than
+  // minPrimitivesForParallelBuild faces bin the levels above shallowDepth in
+  // parallel and build the subtrees below it as separate jobs.
+  std::function<void(int count, const std::function<void(int)> &job)>
+      parallelFor;
+
   // Set default value: Taabb = 0.2
   BVHBuildOptions()
       : costTaabb(0.2f), minLeafPrimitives(4), maxTreeDepth(256), binSize(64),
@@ -668,6 +691,20 @@ public:
                         int maxIntersections, const float *vertices,
                         const unsigned int *faces, Ray &ray);
 
+  ///< Multi-hit traversal of a packet of parallel rays sharing node visits.
+  ///< isects[i] receives what MultiHitTraverse returns for ray i.
+  ///< Returns the mask of rays which hit anything.
+  unsigned int MultiHitTraversePacket(StackVector<Intersection, 128> *isects,
+                                      int maxIntersections,
+                                      const float *vertices,
+                                      const unsigned int *faces,
+                                      const RayPacket &packet) const;
+
+  ///< Collects the faces whose bounding boxes overlap the box [bmin, bmax]
+  bool OverlapTraverse(StackVector<unsigned int, 128> &faceIDs,
+                       const float *vertices, const unsigned int *faces,
+                       const float bmin[3], const float bmax[3]) const;
+
   const std::vector<BVHNode> &GetNodes() const { return nodes_; }
   const std::vector<unsigned int> &GetIndices() const { return indices_; }
 
@@ -686,7 +723,6 @@ public:
   }
 
 private:
-#if NANORT_ENABLE_PARALLEL_BUILD
   typedef struct {
     unsigned int leftIdx;
     unsigned int rightIdx;
@@ -702,7 +738,6 @@ private:
                                 const unsigned int *faces, unsigned int leftIdx,
                                 unsigned int rightIdx, int depth,
                                 int maxShallowDepth, float epsScale);
-#endif
 
   ///< Builds BVH tree recursively.
   size_t BuildTree(BVHBuildStatistics &outStat, std::vector<BVHNode> &outNodes,
@@ -1147,11 +1182,83 @@ void GetBoundingBox(float3 &bmin, float3 &bmax, std::vector<BBox> &bboxes,
   }
 }
 
+// Number of faces a parallelFor job bins or bounds at once.
+const unsigned int kParallelChunkSize = 1024 * 16;
+
+// ComputeBoundingBox() over chunks of [leftIndex, rightIndex) handed to
+// parallelFor. Gives the same box as the serial version.
+void ComputeBoundingBoxParallel(float3 &bmin, float3 &bmax,
+                                const float *vertices,
+                                const unsigned int *faces,
+                                unsigned int *indices, unsigned int leftIndex,
+                                unsigned int rightIndex, float epsScale,
+                                const BVHBuildOptions &options) {
+  int numChunks =
+      (int)((rightIndex - leftIndex + kParallelChunkSize - 1) /
+            kParallelChunkSize);
+  if (!options.parallelFor || numChunks < 2) {
+    ComputeBoundingBox(bmin, bmax, vertices, faces, indices, leftIndex,
+                       rightIndex, epsScale);
+    return;
+  }
+
+  std::vector<float3> chunkMin(numChunks), chunkMax(numChunks);
+  options.parallelFor(numChunks, [&](int i) {
+    unsigned int left = leftIndex + i * kParallelChunkSize;
+    unsigned int right = std::min(rightIndex, left + kParallelChunkSize);
+    ComputeBoundingBox(chunkMin[i], chunkMax[i], vertices, faces, indices,
+                       left, right, epsScale);
+  });
+
+  bmin = chunkMin[0];
+  bmax = chunkMax[0];
+  for (int i = 1; i < numChunks; i++) {
+    for (int k = 0; k < 3; k++) {
+      bmin[k] = std::min(bmin[k], chunkMin[i][k]);
+      bmax[k] = std::max(bmax[k], chunkMax[i][k]);
+    }
+  }
+}
+
+// ContributeBinBuffer() over chunks of [leftIdx, rightIdx) handed to
+// parallelFor, the bin counts of the chunks are summed.
+void ContributeBinBufferParallel(BinBuffer *bins, // [out]
+                                 const float3 &sceneMin,
+                                 const float3 &sceneMax,
+                                 const float *vertices,
+                                 const unsigned int *faces,
+                                 unsigned int *indices, unsigned int leftIdx,
+                                 unsigned int rightIdx, float epsScale,
+                                 const BVHBuildOptions &options) {
+  int numChunks =
+      (int)((rightIdx - leftIdx + kParallelChunkSize - 1) /
+            kParallelChunkSize);
+  if (!options.parallelFor || numChunks < 2) {
+    ContributeBinBuffer(bins, sceneMin, sceneMax, vertices, faces, indices,
+                        leftIdx, rightIdx, epsScale);
+    return;
+  }
+
+  std::vector<BinBuffer> chunkBins(numChunks, BinBuffer(bins->binSize));
+  options.parallelFor(numChunks, [&](int i) {
+    unsigned int left = leftIdx + i * kParallelChunkSize;
+    unsigned int right = std::min(rightIdx, left + kParallelChunkSize);
+    ContributeBinBuffer(&chunkBins[i], sceneMin, sceneMax, vertices, faces,
+                        indices, left, right, epsScale);
+  });
+
+  std::fill(bins->bin.begin(), bins->bin.end(), 0);
+  for (int i = 0; i < numChunks; i++) {
+    for (size_t j = 0; j < bins->bin.size(); j++) {
+      bins->bin[j] += chunkBins[i].bin[j];
+    }
+  }
+}
+
 //
 // --
 //
 
-#if NANORT_ENABLE_PARALLEL_BUILD
 unsigned int BVHAccel::BuildShallowTree(std::vector<BVHNode> &outNodes,
                                         const float *vertices,
                                         const unsigned int *faces,
@@ -1160,15 +1267,20 @@ unsigned int BVHAccel::BuildShallowTree(std::vector<BVHNode> &outNodes,
                                         int maxShallowDepth, float epsScale) {
   assert(leftIdx <= rightIdx);
 
-  unsigned int offset = outNodes.size();
+  unsigned int offset = (unsigned int)outNodes.size();
 
   if (stats_.maxTreeDepth < depth) {
     stats_.maxTreeDepth = depth;
   }
 
   float3 bmin, bmax;
-  ComputeBoundingBox(bmin, bmax, vertices, faces, &indices_.at(0), leftIdx,
-                     rightIdx, epsScale);
+  if (!bboxes_.empty()) {
+    GetBoundingBox(bmin, bmax, bboxes_, &indices_.at(0), leftIdx, rightIdx,
+                   epsScale);
+  } else {
+    ComputeBoundingBoxParallel(bmin, bmax, vertices, faces, &indices_.at(0),
+                               leftIdx, rightIdx, epsScale, options_);
+  }
 
   long long n = rightIdx - leftIdx;
   if ((n < options_.minLeafPrimitives) || (depth >= options_.maxTreeDepth)) {
@@ -1186,7 +1298,7 @@ unsigned int BVHAccel::BuildShallowTree(std::vector<BVHNode> &outNodes,
     assert(leftIdx < std::numeric_limits<unsigned int>::max());
 
     leaf.flag = 1; // leaf
-    leaf.data[0] = n;
+    leaf.data[0] = (unsigned int)n;
     leaf.data[1] = (unsigned int)leftIdx;
 
     outNodes.push_back(leaf); // atomic update
@@ -1225,8 +1337,9 @@ unsigned int BVHAccel::BuildShallowTree(std::vector<BVHNode> &outNodes,
     float cutPos[3] = {0.0, 0.0, 0.0};
 
     BinBuffer bins(options_.binSize);
-    ContributeBinBuffer(&bins, bmin, bmax, vertices, faces, &indices_.at(0),
-                        leftIdx, rightIdx, epsScale);
+    ContributeBinBufferParallel(&bins, bmin, bmax, vertices, faces,
+                                &indices_.at(0), leftIdx, rightIdx, epsScale,
+                                options_);
     FindCutFromBinBuffer(cutPos, minCutAxis, &bins, bmin, bmax, n,
                          options_.costTaabb, epsScale);
 
@@ -1249,13 +1362,13 @@ unsigned int BVHAccel::BuildShallowTree(std::vector<BVHNode> &outNodes,
       mid = std::partition(begin, end,
                            SAHPred(cutAxis, cutPos[cutAxis], vertices, faces));
 
-      midIdx = leftIdx + (mid - begin);
+      midIdx = leftIdx + (unsigned int)(mid - begin);
       if ((midIdx == leftIdx) || (midIdx == rightIdx)) {
 
         // Can't split well.
         // Switch to object median(which may create unoptimized tree, but
         // stable)
-        midIdx = leftIdx + (n >> 1);
+        midIdx = leftIdx + (unsigned int)(n >> 1);
 
         // Try another axis if there's axis to try.
 
@@ -1312,7 +1425,6 @@ unsigned int BVHAccel::BuildShallowTree(std::vector<BVHNode> &outNodes,
 
   return offset;
 }
-#endif
 
 size_t BVHAccel::BuildTree(BVHBuildStatistics &outStat,
                            std::vector<BVHNode> &outNodes,
@@ -1515,8 +1627,13 @@ bool BVHAccel::Build(const float *vertices, const unsigned int *faces,
     ComputeBoundingBoxOMP(bmin, bmax, vertices, faces, &indices_.at(0), 0, n,
                           epsScale);
 #else
-    ComputeBoundingBox(bmin, bmax, vertices, faces, &indices_.at(0), 0, (unsigned int)n,
-                       epsScale);
+    if (n > options.minPrimitivesForParallelBuild) {
+      ComputeBoundingBoxParallel(bmin, bmax, vertices, faces, &indices_.at(0),
+                                 0, (unsigned int)n, epsScale, options);
+    } else {
+      ComputeBoundingBox(bmin, bmax, vertices, faces, &indices_.at(0), 0,
+                         (unsigned int)n, epsScale);
+    }
 #endif
   }
 
@@ -1533,34 +1650,33 @@ bool BVHAccel::Build(const float *vertices, const unsigned int *faces,
 //
 // 3. Build tree
 //
-#ifdef _OPENMP
-#if NANORT_ENABLE_PARALLEL_BUILD
+  // Rebuilding an existing accel reuses the node storage.
+  nodes_.clear();
 
   // Do parallel build for enoughly large dataset.
-  if (n > options.minPrimitivesForParallelBuild) {
-
-    BuildShallowTree(nodes_, vertices, faces, 0, n, /* root depth */ 0,
-                     options.shallowDepth, epsScale); // [0, n)
+  if (options.parallelFor && n > options.minPrimitivesForParallelBuild) {
+    shallowNodeInfos_.clear();
 
-    assert(shallowNodeInfos_.size() > 0);
+    BuildShallowTree(nodes_, vertices, faces, 0, (unsigned int)n,
+                     /* root depth */ 0, options.shallowDepth,
+                     epsScale); // [0, n)
 
     // Build deeper tree in parallel
     std::vector<std::vector<BVHNode> > local_nodes(shallowNodeInfos_.size());
     std::vector<BVHBuildStatistics> local_stats(shallowNodeInfos_.size());
 
-#pragma omp parallel for
-    for (int i = 0; i < (int)shallowNodeInfos_.size(); i++) {
+    options.parallelFor((int)shallowNodeInfos_.size(), [&](int i) {
       unsigned int leftIdx = shallowNodeInfos_[i].leftIdx;
       unsigned int rightIdx = shallowNodeInfos_[i].rightIdx;
       BuildTree(local_stats[i], local_nodes[i], vertices, faces, leftIdx,
                 rightIdx, options.shallowDepth, epsScale);
-    }
+    });
 
     // Join local nodes
     for (int i = 0; i < (int)local_nodes.size(); i++) {
 
       assert(!local_nodes[i].empty());
-      size_t offset = nodes_.size();
+      unsigned int offset = (unsigned int)nodes_.size();
 
       // Add offset to child index(for branch node).
       for (size_t j = 0; j < local_nodes[i].size(); j++) {
@@ -1587,22 +1703,9 @@ bool BVHAccel::Build(const float *vertices, const unsigned int *faces,
     }
 
   } else {
-    BuildTree(stats_, nodes_, vertices, faces, 0, n, /* root depth */ 0,
-              epsScale); // [0, n)
-  }
-
-#else // !NANORT_ENABLE_PARALLEL_BUILD
-  {
-    BuildTree(stats_, nodes_, vertices, faces, 0, n, /* root depth */ 0,
-              epsScale); // [0, n)
-  }
-#endif
-#else // !_OPENMP
-  {
-    BuildTree(stats_, nodes_, vertices, faces, 0, (unsigned int)n, /* root depth */ 0,
-              epsScale); // [0, n)
+    BuildTree(stats_, nodes_, vertices, faces, 0, (unsigned int)n,
+              /* root depth */ 0, epsScale); // [0, n)
   }
-#endif
 
   stats_.epsScale = epsScale;
   epsScale_ = epsScale;
@@ -2069,6 +2172,411 @@ bool BVHAccel::MultiHitTraverse(StackVector<Intersection, 128> &isects,
   return false;
 }
 
+bool BVHAccel::OverlapTraverse(StackVector<unsigned int, 128> &faceIDs,
+                               const float *vertices,
+                               const unsigned int *faces,
+                               const float bmin[3],
+                               const float bmax[3]) const {
+  int nodeStackIndex = 0;
+  int nodeStack[kMaxStackDepth];
+  nodeStack[0] = 0;
+
+  faceIDs->clear();
+
+  if (nodes_.empty()) {
+    return false;
+  }
+
+  while (nodeStackIndex >= 0) {
+    const BVHNode &node = nodes_[nodeStack[nodeStackIndex]];
+    nodeStackIndex--;
+
+    bool overlap = true;
+    for (int k = 0; k < 3; k++) {
+      if (node.bmax[k] < bmin[k] || node.bmin[k] > bmax[k]) {
+        overlap = false;
+      }
+    }
+    if (!overlap) {
+      continue;
+    }
+
+    if (node.flag == 0) { // branch node
+      if (nodeStackIndex + 2 >= kMaxStackDepth) {
+        assert(0 && "OverlapTraverse: node stack overflow");
+        break;
+      }
+      nodeStack[++nodeStackIndex] = node.data[1];
+      nodeStack[++nodeStackIndex] = node.data[0];
+    } else { // leaf node
+      unsigned int numTriangles = node.data[0];
+      unsigned int offset = node.data[1];
+      for (unsigned int i = 0; i < numTriangles; i++) {
+        unsigned int faceIdx = indices_[i + offset];
+        float tmin[3], tmax[3];
+        for (int k = 0; k < 3; k++) {
+          float a = vertices[3 * faces[3 * faceIdx + 0] + k];
+          float b = vertices[3 * faces[3 * faceIdx + 1] + k];
+          float c = vertices[3 * faces[3 * faceIdx + 2] + k];
+          tmin[k] = std::min(a, std::min(b, c));
+          tmax[k] = std::max(a, std::max(b, c));
+        }
+        if (tmax[0] < bmin[0] || tmin[0] > bmax[0] || tmax[1] < bmin[1] ||
+            tmin[1] > bmax[1] || tmax[2] < bmin[2] || tmin[2] > bmax[2]) {
+          continue;
+        }
+        faceIDs->push_back(faceIdx);
+      }
+    }
+  }
+
+  return !faceIDs->empty();
+}
+
+namespace {
+
+// Lanes of `active` whose ray hits the box, see IntersectRayAABB().
+inline unsigned int IntersectPacketAABB(const float maxT[], const float bmin[3],
+                                        const float bmax[3],
+                                        const RayPacket &packet,
+                                        const float rayInvDir[3],
+                                        const int rayDirSign[3],
+                                        unsigned int active) {
+  const float min_x = rayDirSign[0] ? bmax[0] : bmin[0];
+  const float min_y = rayDirSign[1] ? bmax[1] : bmin[1];
+  const float min_z = rayDirSign[2] ? bmax[2] : bmin[2];
+  const float max_x = rayDirSign[0] ? bmin[0] : bmax[0];
+  const float max_y = rayDirSign[1] ? bmin[1] : bmax[1];
+  const float max_z = rayDirSign[2] ? bmin[2] : bmax[2];
+
+  unsigned int mask = 0;
+#if NANORT_USE_SSE2
+  // minps/maxps return the second operand on NaN, matching the ternaries of
+  // the scalar test for 0 * inf.
+  const __m128 zero = _mm_setzero_ps();
+  for (int k = 0; k < NANORT_PACKET_SIZE; k += 4) {
+    if (((active >> k) & 0xf) == 0) {
+      continue;
+    }
+    __m128 ox = _mm_loadu_ps(&packet.org[0][k]);
+    __m128 oy = _mm_loadu_ps(&packet.org[1][k]);
+    __m128 oz = _mm_loadu_ps(&packet.org[2][k]);
+    __m128 ix = _mm_set1_ps(rayInvDir[0]);
+    __m128 iy = _mm_set1_ps(rayInvDir[1]);
+    __m128 iz = _mm_set1_ps(rayInvDir[2]);
+
+    __m128 tmin_x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(min_x), ox), ix);
+    __m128 tmax_x = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(max_x), ox), ix);
+    __m128 tmin_y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(min_y), oy), iy);
+    __m128 tmax_y = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(max_y), oy), iy);
+    __m128 tmin_z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(min_z), oz), iz);
+    __m128 tmax_z = _mm_mul_ps(_mm_sub_ps(_mm_set1_ps(max_z), oz), iz);
+
+    __m128 tmin = _mm_max_ps(tmin_x, tmin_y);
+    __m128 tmax = _mm_min_ps(tmax_x, tmax_y);
+    tmin = _mm_max_ps(tmin, tmin_z);
+    tmax = _mm_min_ps(tmax, tmax_z);
+
+    __m128 hit = _mm_and_ps(_mm_cmpgt_ps(tmax, zero), _mm_cmple_ps(tmin, tmax));
+    hit = _mm_and_ps(hit, _mm_cmple_ps(tmin, _mm_loadu_ps(&maxT[k])));
+    mask |= (unsigned int)_mm_movemask_ps(hit) << k;
+  }
+#else
+  for (int k = 0; k < NANORT_PACKET_SIZE; k++) {
+    if (!(active & (1u << k))) {
+      continue;
+    }
+    const float tmin_x = (min_x - packet.org[0][k]) * rayInvDir[0];
+    const float tmax_x = (max_x - packet.org[0][k]) * rayInvDir[0];
+    const float tmin_y = (min_y - packet.org[1][k]) * rayInvDir[1];
+    const float tmax_y = (max_y - packet.org[1][k]) * rayInvDir[1];
+    const float tmin_z = (min_z - packet.org[2][k]) * rayInvDir[2];
+    const float tmax_z = (max_z - packet.org[2][k]) * rayInvDir[2];
+
+    float tmin = (tmin_x > tmin_y) ? tmin_x : tmin_y;
+    float tmax = (tmax_x < tmax_y) ? tmax_x : tmax_y;
+    tmin = (tmin > tmin_z) ? tmin : tmin_z;
+    tmax = (tmax < tmax_z) ? tmax : tmax_z;
+
+    if ((tmax > 0.0) && (tmin <= tmax) && (tmin <= maxT[k])) {
+      mask |= 1u << k;
+    }
+  }
+#endif
+
+  return mask & active;
+}
+
+// Lanes of `active` whose ray crosses the triangle within tIn, see
+// TriangleIsect(). The setup depending on the direction only is shared.
+inline unsigned int TrianglePacketIsect(float tOut[], float uOut[],
+                                        float vOut[], const float tIn[],
+                                        const float3 &v0, const float3 &v1,
+                                        const float3 &v2,
+                                        const RayPacket &packet,
+                                        float epsScale, unsigned int active) {
+  const float kEPS = std::numeric_limits<float>::epsilon() * epsScale;
+
+  float3 p0(v0[0], v0[1], v0[2]);
+  float3 p1(v1[0], v1[1], v1[2]);
+  float3 p2(v2[0], v2[1], v2[2]);
+  float3 rayDir(packet.dir);
+  float3 e1, e2;
+  float3 p;
+
+  e1 = p1 - p0;
+  e2 = p2 - p0;
+
+  p = vcross(rayDir, e2);
+
+  float det = vdot(e1, p);
+  if (std::abs(det) < kEPS) { // no-cull
+    return 0;
+  }
+
+  float invDet = 1.0f / det;
+
+  unsigned int mask = 0;
+#if NANORT_USE_SSE2
+  // Rejections are tested negated so NaNs are accepted like in the scalar
+  // test.
+  const __m128 zero = _mm_setzero_ps();
+  const __m128 one = _mm_set1_ps(1.0f);
+  for (int k = 0; k < NANORT_PACKET_SIZE; k += 4) {
+    if (((active >> k) & 0xf) == 0) {
+      continue;
+    }
+    __m128 s0 = _mm_sub_ps(_mm_loadu_ps(&packet.org[0][k]), _mm_set1_ps(p0[0]));
+    __m128 s1 = _mm_sub_ps(_mm_loadu_ps(&packet.org[1][k]), _mm_set1_ps(p0[1]));
+    __m128 s2 = _mm_sub_ps(_mm_loadu_ps(&packet.org[2][k]), _mm_set1_ps(p0[2]));
+
+    __m128 q0 = _mm_sub_ps(_mm_mul_ps(s1, _mm_set1_ps(e1[2])),
+                           _mm_mul_ps(s2, _mm_set1_ps(e1[1])));
+    __m128 q1 = _mm_sub_ps(_mm_mul_ps(s2, _mm_set1_ps(e1[0])),
+                           _mm_mul_ps(s0, _mm_set1_ps(e1[2])));
+    __m128 q2 = _mm_sub_ps(_mm_mul_ps(s0, _mm_set1_ps(e1[1])),
+                           _mm_mul_ps(s1, _mm_set1_ps(e1[0])));
+
+    __m128 u = _mm_add_ps(_mm_add_ps(_mm_mul_ps(s0, _mm_set1_ps(p[0])),
+                                     _mm_mul_ps(s1, _mm_set1_ps(p[1]))),
+                          _mm_mul_ps(s2, _mm_set1_ps(p[2])));
+    __m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(q0, _mm_set1_ps(rayDir[0])),
+                                     _mm_mul_ps(q1, _mm_set1_ps(rayDir[1]))),
+                          _mm_mul_ps(q2, _mm_set1_ps(rayDir[2])));
+    __m128 t = _mm_add_ps(_mm_add_ps(_mm_mul_ps(q0, _mm_set1_ps(e2[0])),
+                                     _mm_mul_ps(q1, _mm_set1_ps(e2[1]))),
+                          _mm_mul_ps(q2, _mm_set1_ps(e2[2])));
+    u = _mm_mul_ps(u, _mm_set1_ps(invDet));
+    v = _mm_mul_ps(v, _mm_set1_ps(invDet));
+    t = _mm_mul_ps(t, _mm_set1_ps(invDet));
+
+    __m128 hit = _mm_and_ps(_mm_cmpnlt_ps(u, zero), _mm_cmpngt_ps(u, one));
+    hit = _mm_and_ps(hit, _mm_cmpnle_ps(v, zero));
+    hit = _mm_and_ps(hit, _mm_cmpngt_ps(_mm_add_ps(u, v), one));
+    hit = _mm_and_ps(hit, _mm_cmpnlt_ps(t, zero));
+    hit = _mm_and_ps(hit, _mm_cmpngt_ps(t, _mm_loadu_ps(&tIn[k])));
+
+    _mm_storeu_ps(&tOut[k], t);
+    _mm_storeu_ps(&uOut[k], u);
+    _mm_storeu_ps(&vOut[k], v);
+    mask |= (unsigned int)_mm_movemask_ps(hit) << k;
+  }
+#else
+  for (int k = 0; k < NANORT_PACKET_SIZE; k++) {
+    if (!(active & (1u << k))) {
+      continue;
+    }
+    float3 s(packet.org[0][k] - p0[0], packet.org[1][k] - p0[1],
+             packet.org[2][k] - p0[2]);
+    float3 q = vcross(s, e1);
+
+    float u = vdot(s, p) * invDet;
+    float v = vdot(q, rayDir) * invDet;
+    float t = vdot(e2, q) * invDet;
+
+    if (u < 0.0f || u > 1.0f)
+      continue;
+    if (v <= 0.0f || u + v > 1.0f)
+      continue;
+    if (t < 0.0f || t > tIn[k])
+      continue;
+
+    tOut[k] = t;
+    uOut[k] = u;
+    vOut[k] = v;
+    mask |= 1u << k;
+  }
+#endif
+
+  return mask & active;
+}
+
+// Packet version of MultiHitTestLeafNode(), returns the lanes which hit.
+inline unsigned int MultiHitTestLeafNodePacket(
+    IsectVector *isects, // [inout]
+    int maxIntersections, const BVHNode &node,
+    const std::vector<unsigned int> &indices, const float *vertices,
+    const unsigned int *faces, const RayPacket &packet, float epsScale,
+    unsigned int active) {
+  unsigned int hit = 0;
+
+  unsigned int numTriangles = node.data[0];
+  unsigned int offset = node.data[1];
+
+  float t[NANORT_PACKET_SIZE];
+  for (int k = 0; k < NANORT_PACKET_SIZE; k++) {
+    t[k] = std::numeric_limits<float>::max();
+    if ((active & (1u << k)) && isects[k].size() >= (size_t)maxIntersections) {
+      t[k] = isects[k].top().t; // current furthest hit distance
+    }
+  }
+
+  for (unsigned int i = 0; i < numTriangles; i++) {
+    int faceIdx = indices[i + offset];
+
+    int f0 = faces[3 * faceIdx + 0];
+    int f1 = faces[3 * faceIdx + 1];
+    int f2 = faces[3 * faceIdx + 2];
+
+    float3 v0(&vertices[3 * f0]);
+    float3 v1(&vertices[3 * f1]);
+    float3 v2(&vertices[3 * f2]);
+
+    float tt[NANORT_PACKET_SIZE], u[NANORT_PACKET_SIZE], v[NANORT_PACKET_SIZE];
+    unsigned int mask = TrianglePacketIsect(tt, u, v, t, v0, v1, v2, packet,
+                                            epsScale, active);
+    while (mask) {
+      int k = 0;
+      while (!(mask & (1u << k))) {
+        k++;
+      }
+      mask &= ~(1u << k);
+
+      Intersection isect;
+      isect.t = tt[k];
+      isect.u = u[k];
+      isect.v = v[k];
+      isect.faceID = faceIdx;
+
+      // Same queue update as MultiHitTestLeafNode().
+      if (isects[k].size() < (size_t)maxIntersections) {
+        isects[k].push(isect);
+        t[k] = std::numeric_limits<float>::max();
+        hit |= 1u << k;
+      } else {
+        t[k] = tt[k];
+        if (t[k] < isects[k].top().t) {
+          isects[k].pop();
+          isects[k].push(isect);
+          t[k] = isects[k].top().t;
+          hit |= 1u << k;
+        }
+      }
+    }
+  }
+
+  return hit;
+}
+
+} // namespace
+
+unsigned int BVHAccel::MultiHitTraversePacket(
+    StackVector<Intersection, 128> *isects, int maxIntersections,
+    const float *vertices, const unsigned int *faces,
+    const RayPacket &packet) const {
+  float hitT[NANORT_PACKET_SIZE];
+  IsectVector isectPQ[NANORT_PACKET_SIZE];
+
+  unsigned int active = 0;
+  for (int k = 0; k < NANORT_PACKET_SIZE; k++) {
+    hitT[k] = std::numeric_limits<float>::max(); // far = no hit.
+    isects[k]->clear();
+    if (k < packet.count) {
+      active |= 1u << k;
+    }
+  }
+
+  if (nodes_.empty()) {
+    return 0;
+  }
+
+  // Each entry carries the rays which reached the node's parent, a node is
+  // visited once for all of them.
+  int nodeStackIndex = 0;
+  int nodeStack[512];
+  unsigned int maskStack[512];
+  nodeStack[0] = 0;
+  maskStack[0] = active;
+
+  int dirSign[3];
+  dirSign[0] = packet.dir[0] < 0.0 ? 1 : 0;
+  dirSign[1] = packet.dir[1] < 0.0 ? 1 : 0;
+  dirSign[2] = packet.dir[2] < 0.0 ? 1 : 0;
+
+  // @fixme { Check edge case; i.e., 1/0 }
+  float rayInvDir[3];
+  rayInvDir[0] = 1.0f / packet.dir[0];
+  rayInvDir[1] = 1.0f / packet.dir[1];
+  rayInvDir[2] = 1.0f / packet.dir[2];
+
+  while (nodeStackIndex >= 0) {
+    const BVHNode &node = nodes_[nodeStack[nodeStackIndex]];
+    unsigned int mask = maskStack[nodeStackIndex];
+
+    nodeStackIndex--;
+
+    mask = IntersectPacketAABB(hitT, node.bmin, node.bmax, packet, rayInvDir,
+                               dirSign, mask);
+    if (!mask) {
+      continue;
+    }
+
+    if (node.flag == 0) { // branch node
+      int orderNear = dirSign[node.axis];
+      int orderFar = 1 - orderNear;
+
+      // Traverse near first.
+      ++nodeStackIndex;
+      nodeStack[nodeStackIndex] = node.data[orderFar];
+      maskStack[nodeStackIndex] = mask;
+      ++nodeStackIndex;
+      nodeStack[nodeStackIndex] = node.data[orderNear];
+      maskStack[nodeStackIndex] = mask;
+    } else { // leaf node
+      unsigned int hit =
+          MultiHitTestLeafNodePacket(isectPQ, maxIntersections, node, indices_,
+                                     vertices, faces, packet, epsScale_, mask);
+      for (int k = 0; k < NANORT_PACKET_SIZE; k++) {
+        // Only update `hitT` when queue is full.
+        if ((hit & (1u << k)) &&
+            isectPQ[k].size() >= (size_t)maxIntersections) {
+          hitT[k] = isectPQ[k].top().t;
+        }
+      }
+    }
+  }
+
+  assert(nodeStackIndex < kMaxStackDepth);
+
+  unsigned int result = 0;
+  for (int k = 0; k < NANORT_PACKET_SIZE; k++) {
+    if (isectPQ[k].empty()) {
+      continue;
+    }
+
+    // Store intesection in reverse order(make it frontmost order)
+    size_t n = isectPQ[k].size();
+    isects[k]->resize(n);
+    for (size_t i = 0; i < n; i++) {
+      isects[k][n - i - 1] = isectPQ[k].top();
+      isectPQ[k].pop();
+    }
+    result |= 1u << k;
+  }
+
+  return result;
+}
+
 } // namespace
 
 #endif
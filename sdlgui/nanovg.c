@@ -16,11 +16,31 @@
 // 3. This notice may not be removed or altered from any source distribution.
 //
 
+// PTHREAD_MUTEX_RECURSIVE is an XSI extension, strict C modes hide it unless
+// asked for before the first system header.
+#if !defined(_WIN32) && !defined(_GNU_SOURCE) && !defined(_XOPEN_SOURCE)
+#define _XOPEN_SOURCE 600
+#endif
+
 #include <stdlib.h>
 #include <stdio.h>
 #include <math.h>
+#include <limits.h>
 #include <memory.h>
 
+#if !defined(NVG_NO_SIMD) && (defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2))
+#define NVG_USE_SSE2
+#include <emmintrin.h>
+#endif
+
+#ifdef _WIN32
+#define WIN32_LEAN_AND_MEAN
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <pthread.h>
+#endif
+
 #include "nanovg.h"
 #define FONTSTASH_IMPLEMENTATION
 #include "fontstash.h"
@@ -37,6 +57,7 @@
 #define NVG_INIT_FONTIMAGE_SIZE  512
 #define NVG_MAX_FONTIMAGE_SIZE   2048
 #define NVG_MAX_FONTIMAGES       4
+#define NVG_ATLAS_DIRTY_RECTS    16	// Recent atlas updates a sharing context can catch up with.
 
 #define NVG_INIT_COMMANDS_SIZE 256
 #define NVG_INIT_POINTS_SIZE 128
@@ -45,6 +66,9 @@
 #define NVG_MAX_STATES 32
 
 #define NVG_KAPPA90 0.5522847493f	// Length proportional to radius of a cubic bezier handle for 90deg arcs.
+#define NVG_MAX_BEZIER_SEGS 1024	// Segments a bezier is flattened into at most.
+
+#define NVG_RETAINED_TOL 0.01f	// Relative scale or stroke width change retained geometry is reused across.
 
 #define NVG_COUNTOF(arr) (sizeof(arr) / sizeof(0[arr]))
 
@@ -68,6 +92,7 @@ enum NVGpointFlags
 struct NVGstate {
 	NVGcompositeOperationState compositeOperation;
 	int shapeAntiAlias;
+	int fillRule;
 	NVGpaint fill;
 	NVGpaint stroke;
 	float strokeWidth;
@@ -109,6 +134,121 @@ struct NVGpathCache {
 };
 typedef struct NVGpathCache NVGpathCache;
 
+// Expanded geometry of a retained path and the parameters it was built with.
+struct NVGretainedGeom {
+	int valid;
+	float xform[4];		// Linear transform, see nvg__retainedKey().
+	float width;		// Stroke width in device pixels, 0 for fills.
+	float fringe;
+	int lineCap;
+	int lineJoin;
+	float miterLimit;
+	int antiAlias;
+	int allowHairline;
+	int hairline;		// Stroke vertices are center lines for renderHairline.
+	int declinedHairline;
+	NVGpath* paths;
+	int npaths;
+	int cpaths;
+	NVGvertex* verts;
+	int cverts;
+	int nverts;
+	float bounds[4];
+};
+typedef struct NVGretainedGeom NVGretainedGeom;
+
+struct NVGretainedPath {
+	float* commands;	// In the space of the transform it was recorded under.
+	int ncommands;
+	NVGretainedGeom fill;
+	NVGretainedGeom stroke;
+};
+
+enum NVGrecordType {
+	NVG_RECORD_FILL,
+	NVG_RECORD_STROKE,
+	NVG_RECORD_TRIANGLES,
+	NVG_RECORD_SHAPE,
+	NVG_RECORD_HAIRLINE,
+};
+
+// A render call in a display list, followed by its paths and vertices.
+struct NVGrecordCall {
+	int type;
+	int fallback;		// Drawn only if no earlier call of its chain was, see nvgDrawDisplayList().
+	int size;			// Bytes up to the next call.
+	NVGpaint paint;
+	NVGcompositeOperationState compositeOperation;
+	NVGscissor scissor;
+	float strokeWidth;
+	int lineCap;
+	int fillRule;
+	float bounds[4];
+	NVGshape shape;
+	int npaths;
+	int nverts;
+};
+typedef struct NVGrecordCall NVGrecordCall;
+
+// NVGpath with vertex offsets in place of pointers.
+struct NVGrecordPath {
+	int first;
+	int count;
+	int closed;
+	int nbevel;
+	int fill;
+	int nfill;
+	int stroke;
+	int nstroke;
+	int winding;
+	int convex;
+};
+typedef struct NVGrecordPath NVGrecordPath;
+
+struct NVGdisplayList {
+	unsigned char* data;	// Calls, no pointers so the buffer can be moved.
+	int ndata;
+	int cdata;
+	int ncalls;
+	int fallback;			// The next recorded call is a fallback of the previous one.
+};
+
+// Recursive, font calls nest, e.g. nvgTextBoxBounds() measures with nvgTextBounds().
+#ifdef _WIN32
+typedef CRITICAL_SECTION NVGmutex;
+static int nvg__initMutex(NVGmutex* m) { InitializeCriticalSection(m); return 1; }
+static void nvg__destroyMutex(NVGmutex* m) { DeleteCriticalSection(m); }
+static void nvg__lockMutex(NVGmutex* m) { EnterCriticalSection(m); }
+static void nvg__unlockMutex(NVGmutex* m) { LeaveCriticalSection(m); }
+#else
+typedef pthread_mutex_t NVGmutex;
+static int nvg__initMutex(NVGmutex* m)
+{
+	pthread_mutexattr_t attr;
+	int res;
+	if (pthread_mutexattr_init(&attr) != 0) return 0;
+	pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+	res = pthread_mutex_init(m, &attr) == 0;
+	pthread_mutexattr_destroy(&attr);
+	return res;
+}
+static void nvg__destroyMutex(NVGmutex* m) { pthread_mutex_destroy(m); }
+static void nvg__lockMutex(NVGmutex* m) { pthread_mutex_lock(m); }
+static void nvg__unlockMutex(NVGmutex* m) { pthread_mutex_unlock(m); }
+#endif
+
+// Font stash shared by contexts. Glyphs are only added to the atlas until it
+// is reset, so each context uploads the rects added since it last looked.
+struct NVGfontAtlas {
+	struct FONScontext* fs;
+	NVGmutex mutex;
+	int refs;
+	int serial;			// Number of dirty rects so far.
+	int resets;			// Number of times the atlas was cleared.
+	int dirty[4];		// Union of the dirty rects since the last reset.
+	int rects[NVG_ATLAS_DIRTY_RECTS][4];	// Latest dirty rects, by serial.
+};
+
 struct NVGcontext {
 	NVGparams params;
 	float* commands;
@@ -118,6 +258,7 @@ struct NVGcontext {
 	NVGstate states[NVG_MAX_STATES];
 	int nstates;
 	NVGpathCache* cache;
+	NVGshape shape;
 	float tessTol;
 	float distTol;
 	float fringeWidth;
@@ -125,10 +266,14 @@ struct NVGcontext {
 	struct FONScontext* fs;
 	int fontImages[NVG_MAX_FONTIMAGES];
 	int fontImageIdx;
+	NVGfontAtlas* fontAtlas;	// Owner of fs when shared.
+	int atlasSerial;			// Atlas updates in the current font image, -1 for none.
+	int atlasResets;
 	int drawCallCount;
 	int fillTriCount;
 	int strokeTriCount;
 	int textTriCount;
+	NVGdisplayList* record;	// Render calls go here instead of the back-end while recording.
 };
 
 static float nvg__sqrtf(float a) { return sqrtf(a); }
@@ -283,9 +428,35 @@ static NVGstate* nvg__getState(NVGcontext* ctx)
 	return &ctx->states[ctx->nstates-1];
 }
 
-NVGcontext* nvgCreateInternal(NVGparams* params)
+static void nvg__lockFonts(NVGcontext* ctx)
+{
+	if (ctx->fontAtlas != NULL)
+		nvg__lockMutex(&ctx->fontAtlas->mutex);
+}
+
+static void nvg__unlockFonts(NVGcontext* ctx)
+{
+	if (ctx->fontAtlas != NULL)
+		nvg__unlockMutex(&ctx->fontAtlas->mutex);
+}
+
+static struct FONScontext* nvg__createFontStash(void)
 {
 	FONSparams fontParams;
+	memset(&fontParams, 0, sizeof(fontParams));
+	fontParams.width = NVG_INIT_FONTIMAGE_SIZE;
+	fontParams.height = NVG_INIT_FONTIMAGE_SIZE;
+	fontParams.flags = FONS_ZERO_TOPLEFT;
+	fontParams.renderCreate = NULL;
+	fontParams.renderUpdate = NULL;
+	fontParams.renderDraw = NULL;
+	fontParams.renderDelete = NULL;
+	fontParams.userPtr = NULL;
+	return fonsCreateInternal(&fontParams);
+}
+
+NVGcontext* nvgCreateInternal(NVGparams* params)
+{
 	NVGcontext* ctx = (NVGcontext*)malloc(sizeof(NVGcontext));
 	int i;
 	if (ctx == NULL) goto error;
@@ -311,22 +482,14 @@ NVGcontext* nvgCreateInternal(NVGparams* params)
 	if (ctx->params.renderCreate(ctx->params.userPtr) == 0) goto error;
 
 	// Init font rendering
-	memset(&fontParams, 0, sizeof(fontParams));
-	fontParams.width = NVG_INIT_FONTIMAGE_SIZE;
-	fontParams.height = NVG_INIT_FONTIMAGE_SIZE;
-	fontParams.flags = FONS_ZERO_TOPLEFT;
-	fontParams.renderCreate = NULL;
-	fontParams.renderUpdate = NULL;
-	fontParams.renderDraw = NULL;
-	fontParams.renderDelete = NULL;
-	fontParams.userPtr = NULL;
-	ctx->fs = fonsCreateInternal(&fontParams);
+	ctx->fs = nvg__createFontStash();
 	if (ctx->fs == NULL) goto error;
 
 	// Create font texture
-	ctx->fontImages[0] = ctx->params.renderCreateTexture(ctx->params.userPtr, NVG_TEXTURE_ALPHA, fontParams.width, fontParams.height, 0, NULL);
+	ctx->fontImages[0] = ctx->params.renderCreateTexture(ctx->params.userPtr, NVG_TEXTURE_ALPHA, NVG_INIT_FONTIMAGE_SIZE, NVG_INIT_FONTIMAGE_SIZE, 0, NULL);
 	if (ctx->fontImages[0] == 0) goto error;
 	ctx->fontImageIdx = 0;
+	ctx->atlasSerial = -1;
 
 	return ctx;
 
@@ -346,8 +509,11 @@ void nvgDeleteInternal(NVGcontext* ctx)
 	if (ctx == NULL) return;
 	if (ctx->commands != NULL) free(ctx->commands);
 	if (ctx->cache != NULL) nvg__deletePathCache(ctx->cache);
+	nvgDeleteDisplayList(ctx, ctx->record);
 
-	if (ctx->fs)
+	if (ctx->fontAtlas != NULL)
+		nvgDeleteFontAtlas(ctx->fontAtlas);
+	else if (ctx->fs)
 		fonsDeleteInternal(ctx->fs);
 
 	for (i = 0; i < NVG_MAX_FONTIMAGES; i++) {
@@ -647,6 +813,7 @@ void nvgReset(NVGcontext* ctx)
 	nvg__setPaintColor(&state->stroke, nvgRGBA(0,0,0,255));
 	state->compositeOperation = nvg__compositeOperationState(NVG_SOURCE_OVER);
 	state->shapeAntiAlias = 1;
+	state->fillRule = NVG_NONZERO;
 	state->strokeWidth = 1.0f;
 	state->miterLimit = 10.0f;
 	state->lineCap = NVG_BUTT;
@@ -672,6 +839,12 @@ void nvgShapeAntiAlias(NVGcontext* ctx, int enabled)
 	state->shapeAntiAlias = enabled;
 }
 
+void nvgFillRule(NVGcontext* ctx, int rule)
+{
+	NVGstate* state = nvg__getState(ctx);
+	state->fillRule = rule;
+}
+
 void nvgStrokeWidth(NVGcontext* ctx, float width)
 {
 	NVGstate* state = nvg__getState(ctx);
@@ -1069,42 +1242,24 @@ static float nvg__distPtSeg(float x, float y, float px, float py, float qx, floa
 	return dx*dx + dy*dy;
 }
 
-static void nvg__appendCommands(NVGcontext* ctx, float* vals, int nvals)
+static void nvg__transformCommands(float* vals, int nvals, const float* xform)
 {
-	NVGstate* state = nvg__getState(ctx);
-	int i;
-
-	if (ctx->ncommands+nvals > ctx->ccommands) {
-		float* commands;
-		int ccommands = ctx->ncommands+nvals + ctx->ccommands/2;
-		commands = (float*)realloc(ctx->commands, sizeof(float)*ccommands);
-		if (commands == NULL) return;
-		ctx->commands = commands;
-		ctx->ccommands = ccommands;
-	}
-
-	if ((int)vals[0] != NVG_CLOSE && (int)vals[0] != NVG_WINDING) {
-		ctx->commandx = vals[nvals-2];
-		ctx->commandy = vals[nvals-1];
-	}
-
-	// transform commands
-	i = 0;
+	int i = 0;
 	while (i < nvals) {
 		int cmd = (int)vals[i];
 		switch (cmd) {
 		case NVG_MOVETO:
-			nvgTransformPoint(&vals[i+1],&vals[i+2], state->xform, vals[i+1],vals[i+2]);
+			nvgTransformPoint(&vals[i+1],&vals[i+2], xform, vals[i+1],vals[i+2]);
 			i += 3;
 			break;
 		case NVG_LINETO:
-			nvgTransformPoint(&vals[i+1],&vals[i+2], state->xform, vals[i+1],vals[i+2]);
+			nvgTransformPoint(&vals[i+1],&vals[i+2], xform, vals[i+1],vals[i+2]);
 			i += 3;
 			break;
 		case NVG_BEZIERTO:
-			nvgTransformPoint(&vals[i+1],&vals[i+2], state->xform, vals[i+1],vals[i+2]);
-			nvgTransformPoint(&vals[i+3],&vals[i+4], state->xform, vals[i+3],vals[i+4]);
-			nvgTransformPoint(&vals[i+5],&vals[i+6], state->xform, vals[i+5],vals[i+6]);
+			nvgTransformPoint(&vals[i+1],&vals[i+2], xform, vals[i+1],vals[i+2]);
+			nvgTransformPoint(&vals[i+3],&vals[i+4], xform, vals[i+3],vals[i+4]);
+			nvgTransformPoint(&vals[i+5],&vals[i+6], xform, vals[i+5],vals[i+6]);
 			i += 7;
 			break;
 		case NVG_CLOSE:
@@ -1117,6 +1272,30 @@ static void nvg__appendCommands(NVGcontext* ctx, float* vals, int nvals)
 			i++;
 		}
 	}
+}
+
+static void nvg__appendCommands(NVGcontext* ctx, float* vals, int nvals)
+{
+	NVGstate* state = nvg__getState(ctx);
+
+	ctx->shape.type = NVG_SHAPE_NONE;
+
+	if (ctx->ncommands+nvals > ctx->ccommands) {
+		float* commands;
+		int ccommands = ctx->ncommands+nvals + ctx->ccommands/2;
+		commands = (float*)realloc(ctx->commands, sizeof(float)*ccommands);
+		if (commands == NULL) return;
+		ctx->commands = commands;
+		ctx->ccommands = ccommands;
+	}
+
+	if ((int)vals[0] != NVG_CLOSE && (int)vals[0] != NVG_WINDING) {
+		ctx->commandx = vals[nvals-2];
+		ctx->commandy = vals[nvals-1];
+	}
+
+	// transform commands
+	nvg__transformCommands(vals, nvals, state->xform);
 
 	memcpy(&ctx->commands[ctx->ncommands], vals, nvals*sizeof(float));
 
@@ -1196,6 +1375,38 @@ static void nvg__addPoint(NVGcontext* ctx, float x, float y, int flags)
 	path->count++;
 }
 
+// Adds interior curve points, merging those closer than distTol like nvg__addPoint().
+static void nvg__addCurvePoints(NVGcontext* ctx, const float* xs, const float* ys, int count)
+{
+	NVGpath* path = nvg__lastPath(ctx);
+	NVGpoint* pt;
+	int i;
+	if (path == NULL) return;
+
+	if (ctx->cache->npoints+count > ctx->cache->cpoints) {
+		NVGpoint* points;
+		int cpoints = ctx->cache->npoints+count + ctx->cache->cpoints/2;
+		points = (NVGpoint*)realloc(ctx->cache->points, sizeof(NVGpoint)*cpoints);
+		if (points == NULL) return;
+		ctx->cache->points = points;
+		ctx->cache->cpoints = cpoints;
+	}
+
+	for (i = 0; i < count; i++) {
+		if (path->count > 0 && ctx->cache->npoints > 0) {
+			pt = nvg__lastPoint(ctx);
+			if (nvg__ptEquals(pt->x,pt->y, xs[i],ys[i], ctx->distTol))
+				continue;
+		}
+		pt = &ctx->cache->points[ctx->cache->npoints];
+		memset(pt, 0, sizeof(*pt));
+		pt->x = xs[i];
+		pt->y = ys[i];
+		ctx->cache->npoints++;
+		path->count++;
+	}
+}
+
 static void nvg__closePath(NVGcontext* ctx)
 {
 	NVGpath* path = nvg__lastPath(ctx);
@@ -1231,6 +1442,20 @@ static NVGvertex* nvg__allocTempVerts(NVGcontext* ctx, int nverts)
 	return ctx->cache->verts;
 }
 
+static NVGpath* nvg__allocTempPaths(NVGcontext* ctx, int npaths)
+{
+	if (npaths > ctx->cache->cpaths) {
+		NVGpath* paths;
+		int cpaths = npaths + ctx->cache->cpaths/2;
+		paths = (NVGpath*)realloc(ctx->cache->paths, sizeof(NVGpath)*cpaths);
+		if (paths == NULL) return NULL;
+		ctx->cache->paths = paths;
+		ctx->cache->cpaths = cpaths;
+	}
+
+	return ctx->cache->paths;
+}
+
 static float nvg__triarea2(float ax, float ay, float bx, float by, float cx, float cy)
 {
 	float abx = bx - ax;
@@ -1275,47 +1500,87 @@ static void nvg__vset(NVGvertex* vtx, float x, float y, float u, float v)
 	vtx->v = v;
 }
 
+// Flattens a bezier into uniform parameter steps. The step count follows
+// from the second differences of the control points (Wang's formula) so that
+// the polyline stays within half the tessellation tolerance of the curve.
+// Points are stepped by forward differencing, four at a time.
 static void nvg__tesselateBezier(NVGcontext* ctx,
 								 float x1, float y1, float x2, float y2,
 								 float x3, float y3, float x4, float y4,
-								 int level, int type)
-{
-	float x12,y12,x23,y23,x34,y34,x123,y123,x234,y234,x1234,y1234;
-	float dx,dy,d2,d3;
-
-	if (level > 10) return;
-
-	x12 = (x1+x2)*0.5f;
-	y12 = (y1+y2)*0.5f;
-	x23 = (x2+x3)*0.5f;
-	y23 = (y2+y3)*0.5f;
-	x34 = (x3+x4)*0.5f;
-	y34 = (y3+y4)*0.5f;
-	x123 = (x12+x23)*0.5f;
-	y123 = (y12+y23)*0.5f;
-
-	dx = x4 - x1;
-	dy = y4 - y1;
-	d2 = nvg__absf(((x2 - x4) * dy - (y2 - y4) * dx));
-	d3 = nvg__absf(((x3 - x4) * dy - (y3 - y4) * dx));
-
-	if ((d2 + d3)*(d2 + d3) < ctx->tessTol * (dx*dx + dy*dy)) {
+								 int type)
+{
+	float ddx0 = x1 - 2.0f*x2 + x3, ddy0 = y1 - 2.0f*y2 + y3;
+	float ddx1 = x2 - 2.0f*x3 + x4, ddy1 = y2 - 2.0f*y3 + y4;
+	float dd = nvg__maxf(ddx0*ddx0 + ddy0*ddy0, ddx1*ddx1 + ddy1*ddy1);
+	float tol = 0.5f * sqrtf(ctx->tessTol);
+	float segs = ceilf(sqrtf(0.75f * sqrtf(dd) / tol));
+	float ax, ay, bx, by, cx, cy, h, H, t;
+	float px[4], py[4], d1x[4], d1y[4], d2x[4], d2y[4], d3x, d3y;
+	int n, i, j;
+
+	if (!(segs > 1.0f)) {	// Also catches NaN.
 		nvg__addPoint(ctx, x4, y4, type);
 		return;
 	}
+	n = segs < NVG_MAX_BEZIER_SEGS ? (int)segs : NVG_MAX_BEZIER_SEGS;
+
+	// Power basis, B(t) = ((a*t + b)*t + c)*t + p1.
+	ax = x4 - x1 + 3.0f*(x2 - x3);
+	ay = y4 - y1 + 3.0f*(y2 - y3);
+	bx = 3.0f*ddx0;
+	by = 3.0f*ddy0;
+	cx = 3.0f*(x2 - x1);
+	cy = 3.0f*(y2 - y1);
+
+	// Lane j starts at step j+1 and advances four steps at a time.
+	h = 1.0f / n;
+	H = 4.0f * h;
+	for (j = 0; j < 4; j++) {
+		t = (j+1) * h;
+		px[j] = ((ax*t + bx)*t + cx)*t + x1;
+		py[j] = ((ay*t + by)*t + cy)*t + y1;
+		d1x[j] = ax*(3.0f*t*t*H + 3.0f*t*H*H + H*H*H) + bx*(2.0f*t*H + H*H) + cx*H;
+		d1y[j] = ay*(3.0f*t*t*H + 3.0f*t*H*H + H*H*H) + by*(2.0f*t*H + H*H) + cy*H;
+		d2x[j] = ax*(6.0f*t*H*H + 6.0f*H*H*H) + 2.0f*bx*H*H;
+		d2y[j] = ay*(6.0f*t*H*H + 6.0f*H*H*H) + 2.0f*by*H*H;
+	}
+	d3x = 6.0f*ax*H*H*H;
+	d3y = 6.0f*ay*H*H*H;
 
-/*	if (nvg__absf(x1+x3-x2-x2) + nvg__absf(y1+y3-y2-y2) + nvg__absf(x2+x4-x3-x3) + nvg__absf(y2+y4-y3-y3) < ctx->tessTol) {
-		nvg__addPoint(ctx, x4, y4, type);
-		return;
-	}*/
-
-	x234 = (x23+x34)*0.5f;
-	y234 = (y23+y34)*0.5f;
-	x1234 = (x123+x234)*0.5f;
-	y1234 = (y123+y234)*0.5f;
+	// The last point is the end point itself, not stepped to.
+#ifdef NVG_USE_SSE2
+	{
+		__m128 vx = _mm_loadu_ps(px), vy = _mm_loadu_ps(py);
+		__m128 v1x = _mm_loadu_ps(d1x), v1y = _mm_loadu_ps(d1y);
+		__m128 v2x = _mm_loadu_ps(d2x), v2y = _mm_loadu_ps(d2y);
+		__m128 v3x = _mm_set1_ps(d3x), v3y = _mm_set1_ps(d3y);
+		for (i = 1; i < n; i += 4) {
+			_mm_storeu_ps(px, vx);
+			_mm_storeu_ps(py, vy);
+			nvg__addCurvePoints(ctx, px, py, nvg__mini(4, n-i));
+			vx = _mm_add_ps(vx, v1x);
+			vy = _mm_add_ps(vy, v1y);
+			v1x = _mm_add_ps(v1x, v2x);
+			v1y = _mm_add_ps(v1y, v2y);
+			v2x = _mm_add_ps(v2x, v3x);
+			v2y = _mm_add_ps(v2y, v3y);
+		}
+	}
+#else
+	for (i = 1; i < n; i += 4) {
+		nvg__addCurvePoints(ctx, px, py, nvg__mini(4, n-i));
+		for (j = 0; j < 4; j++) {
+			px[j] += d1x[j];
+			py[j] += d1y[j];
+			d1x[j] += d2x[j];
+			d1y[j] += d2y[j];
+			d2x[j] += d3x;
+			d2y[j] += d3y;
+		}
+	}
+#endif
 
-	nvg__tesselateBezier(ctx, x1,y1, x12,y12, x123,y123, x1234,y1234, level+1, 0);
-	nvg__tesselateBezier(ctx, x1234,y1234, x234,y234, x34,y34, x4,y4, level+1, type);
+	nvg__addPoint(ctx, x4, y4, type);
 }
 
 static void nvg__flattenPaths(NVGcontext* ctx)
@@ -1358,7 +1623,7 @@ static void nvg__flattenPaths(NVGcontext* ctx)
 				cp1 = &ctx->commands[i+1];
 				cp2 = &ctx->commands[i+3];
 				p = &ctx->commands[i+5];
-				nvg__tesselateBezier(ctx, last->x,last->y, cp1[0],cp1[1], cp2[0],cp2[1], p[0],p[1], 0, NVG_PT_CORNER);
+				nvg__tesselateBezier(ctx, last->x,last->y, cp1[0],cp1[1], cp2[0],cp2[1], p[0],p[1], NVG_PT_CORNER);
 			}
 			i += 7;
 			break;
@@ -1852,6 +2117,11 @@ static int nvg__expandFill(NVGcontext* ctx, float w, int lineJoin, float miterLi
 
 	nvg__calculateJoins(ctx, w, lineJoin, miterLimit);
 
+	convex = cache->npaths == 1 && cache->paths[0].convex;
+	// An inset outline without its fringe would shrink the fill.
+	if (!convex && ctx->params.concaveFillCoverage)
+		fringe = 0;
+
 	// Calculate max vertex usage.
 	cverts = 0;
 	for (i = 0; i < cache->npaths; i++) {
@@ -1864,8 +2134,6 @@ static int nvg__expandFill(NVGcontext* ctx, float w, int lineJoin, float miterLi
 	verts = nvg__allocTempVerts(ctx, cverts);
 	if (verts == NULL) return 0;
 
-	convex = cache->npaths == 1 && cache->paths[0].convex;
-
 	for (i = 0; i < cache->npaths; i++) {
 		NVGpath* path = &cache->paths[i];
 		NVGpoint* pts = &cache->points[path->first];
@@ -1966,9 +2234,60 @@ static int nvg__expandFill(NVGcontext* ctx, float w, int lineJoin, float miterLi
 void nvgBeginPath(NVGcontext* ctx)
 {
 	ctx->ncommands = 0;
+	ctx->shape.type = NVG_SHAPE_NONE;
 	nvg__clearPathCache(ctx);
 }
 
+// Points the stroke vertices of every path at its flattened center line for
+// renderHairline. Thin strokes are drawn with round joins, so this fails if
+// a miter join turns by more than about 90 degrees and would stick out.
+static int nvg__hairlinePaths(NVGcontext* ctx, int lineJoin)
+{
+	NVGpathCache* cache = ctx->cache;
+	NVGvertex* verts;
+	int i, j, nverts = 0;
+
+	for (i = 0; i < cache->npaths; i++)
+		nverts += cache->paths[i].count;
+	verts = nvg__allocTempVerts(ctx, nverts);
+	if (verts == NULL) return 0;
+
+	for (i = 0; i < cache->npaths; i++) {
+		NVGpath* path = &cache->paths[i];
+		NVGpoint* pts = &cache->points[path->first];
+		for (j = 0; j < path->count; j++) {
+			NVGpoint* p0 = &pts[j > 0 ? j-1 : path->count-1];
+			int join = path->closed || (j > 0 && j < path->count-1);
+			if (join && lineJoin == NVG_MITER && p0->dx*pts[j].dx + p0->dy*pts[j].dy < -0.05f)
+				return 0;
+			nvg__vset(&verts[j], pts[j].x, pts[j].y, 0.5f, 1.0f);
+		}
+		path->fill = NULL;
+		path->nfill = 0;
+		path->stroke = verts;
+		path->nstroke = path->count;
+		verts += path->count;
+	}
+	return 1;
+}
+
+// Remembers the shape just appended if it makes up the whole path and the
+// transform keeps it axis aligned.
+static void nvg__setShape(NVGcontext* ctx, int first, int type, float cx, float cy, float hx, float hy, float r)
+{
+	NVGstate* state = nvg__getState(ctx);
+	float* t = state->xform;
+	if (!first || ctx->ncommands == 0 || t[1] != 0.0f || t[2] != 0.0f)
+		return;
+	if (type == NVG_SHAPE_ROUNDEDRECT && nvg__absf(nvg__absf(t[0]) - nvg__absf(t[3])) > 1e-5f)
+		return;
+	nvgTransformPoint(&ctx->shape.cx, &ctx->shape.cy, t, cx, cy);
+	ctx->shape.hx = nvg__absf(hx * t[0]);
+	ctx->shape.hy = nvg__absf(hy * t[3]);
+	ctx->shape.radius = r * nvg__absf(t[0]);
+	ctx->shape.type = type;
+}
+
 void nvgMoveTo(NVGcontext* ctx, float x, float y)
 {
 	float vals[] = { NVG_MOVETO, x, y };
@@ -2133,6 +2452,7 @@ void nvgArc(NVGcontext* ctx, float cx, float cy, float r, float a0, float a1, in
 
 void nvgRect(NVGcontext* ctx, float x, float y, float w, float h)
 {
+	int first = ctx->ncommands == 0;
 	float vals[] = {
 		NVG_MOVETO, x,y,
 		NVG_LINETO, x,y+h,
@@ -2141,6 +2461,7 @@ void nvgRect(NVGcontext* ctx, float x, float y, float w, float h)
 		NVG_CLOSE
 	};
 	nvg__appendCommands(ctx, vals, NVG_COUNTOF(vals));
+	nvg__setShape(ctx, first, NVG_SHAPE_RECT, x+w*0.5f, y+h*0.5f, w*0.5f, h*0.5f, 0.0f);
 }
 
 void nvgRoundedRect(NVGcontext* ctx, float x, float y, float w, float h, float r)
@@ -2154,6 +2475,7 @@ void nvgRoundedRectVarying(NVGcontext* ctx, float x, float y, float w, float h,
 		nvgRect(ctx, x, y, w, h);
 		return;
 	} else {
+		int first = ctx->ncommands == 0;
 		float halfw = nvg__absf(w)*0.5f;
 		float halfh = nvg__absf(h)*0.5f;
 		float rxBL = nvg__minf(radBottomLeft, halfw) * nvg__signf(w), ryBL = nvg__minf(radBottomLeft, halfh) * nvg__signf(h);
@@ -2173,11 +2495,16 @@ void nvgRoundedRectVarying(NVGcontext* ctx, float x, float y, float w, float h,
 			NVG_CLOSE
 		};
 		nvg__appendCommands(ctx, vals, NVG_COUNTOF(vals));
+		// Only circular corners, radii clamped on one axis become elliptical.
+		if (radTopLeft == radTopRight && radTopLeft == radBottomRight && radTopLeft == radBottomLeft &&
+			nvg__absf(rxTL) == nvg__absf(ryTL))
+			nvg__setShape(ctx, first, NVG_SHAPE_ROUNDEDRECT, x+w*0.5f, y+h*0.5f, halfw, halfh, nvg__absf(rxTL));
 	}
 }
 
 void nvgEllipse(NVGcontext* ctx, float cx, float cy, float rx, float ry)
 {
+	int first = ctx->ncommands == 0;
 	float vals[] = {
 		NVG_MOVETO, cx-rx, cy,
 		NVG_BEZIERTO, cx-rx, cy+ry*NVG_KAPPA90, cx-rx*NVG_KAPPA90, cy+ry, cx, cy+ry,
@@ -2187,6 +2514,7 @@ void nvgEllipse(NVGcontext* ctx, float cx, float cy, float rx, float ry)
 		NVG_CLOSE
 	};
 	nvg__appendCommands(ctx, vals, NVG_COUNTOF(vals));
+	nvg__setShape(ctx, first, NVG_SHAPE_ELLIPSE, cx, cy, rx, ry, 0.0f);
 }
 
 void nvgCircle(NVGcontext* ctx, float cx, float cy, float r)
@@ -2216,25 +2544,156 @@ void nvgDebugDumpPathCache(NVGcontext* ctx)
 	}
 }
 
-void nvgFill(NVGcontext* ctx)
+// Display list recording
+
+static int nvg__recordCall(NVGcontext* ctx, int type, NVGpaint* paint, NVGcompositeOperationState compositeOperation,
+						   NVGscissor* scissor, float strokeWidth, int lineCap, int fillRule, const float* bounds,
+						   const NVGshape* shape, const NVGpath* paths, int npaths, const NVGvertex* verts, int nverts)
 {
-	NVGstate* state = nvg__getState(ctx);
-	const NVGpath* path;
-	NVGpaint fillPaint = state->fill;
-	int i;
+	NVGdisplayList* list = ctx->record;
+	NVGrecordCall* call;
+	NVGrecordPath* rpaths;
+	NVGvertex* rverts;
+	int i, size;
 
-	nvg__flattenPaths(ctx);
-	if (ctx->params.edgeAntiAlias && state->shapeAntiAlias)
-		nvg__expandFill(ctx, ctx->fringeWidth, NVG_MITER, 2.4f);
+	for (i = 0; i < npaths; i++)
+		nverts += paths[i].nfill + paths[i].nstroke;
+	size = (int)(sizeof(NVGrecordCall) + sizeof(NVGrecordPath)*npaths + sizeof(NVGvertex)*nverts);
+
+	if (list->ndata+size > list->cdata) {
+		unsigned char* data;
+		int cdata = list->ndata+size + list->cdata/2; // 1.5x Overallocate
+		data = (unsigned char*)realloc(list->data, cdata);
+		if (data == NULL) return 0;
+		list->data = data;
+		list->cdata = cdata;
+	}
+
+	call = (NVGrecordCall*)&list->data[list->ndata];
+	memset(call, 0, sizeof(NVGrecordCall));
+	call->type = type;
+	call->fallback = list->fallback;
+	call->size = size;
+	call->paint = *paint;
+	call->compositeOperation = compositeOperation;
+	call->scissor = *scissor;
+	call->strokeWidth = strokeWidth;
+	call->lineCap = lineCap;
+	call->fillRule = fillRule;
+	if (bounds != NULL)
+		memcpy(call->bounds, bounds, sizeof(call->bounds));
+	if (shape != NULL)
+		call->shape = *shape;
+	call->npaths = npaths;
+	call->nverts = nverts;
+
+	// Paths are packed with their fill and stroke vertices back to back.
+	rpaths = (NVGrecordPath*)(call + 1);
+	rverts = (NVGvertex*)(rpaths + npaths);
+	if (npaths == 0 && nverts > 0)
+		memcpy(rverts, verts, sizeof(NVGvertex)*nverts);
+	nverts = 0;
+	for (i = 0; i < npaths; i++) {
+		const NVGpath* path = &paths[i];
+		NVGrecordPath* rpath = &rpaths[i];
+		rpath->first = path->first;
+		rpath->count = path->count;
+		rpath->closed = path->closed;
+		rpath->nbevel = path->nbevel;
+		rpath->winding = path->winding;
+		rpath->convex = path->convex;
+		rpath->fill = nverts;
+		rpath->nfill = path->nfill;
+		if (path->nfill > 0)
+			memcpy(&rverts[nverts], path->fill, sizeof(NVGvertex)*path->nfill);
+		nverts += path->nfill;
+		rpath->stroke = nverts;
+		rpath->nstroke = path->nstroke;
+		if (path->nstroke > 0)
+			memcpy(&rverts[nverts], path->stroke, sizeof(NVGvertex)*path->nstroke);
+		nverts += path->nstroke;
+	}
+
+	list->ndata += size;
+	list->ncalls++;
+	list->fallback = 0;
+	return 1;
+}
+
+// The back-end calls, diverted to the display list while recording.
+
+static void nvg__renderFill(NVGcontext* ctx, NVGpaint* paint, NVGcompositeOperationState compositeOperation,
+							NVGscissor* scissor, const float* bounds, const NVGpath* paths, int npaths, int fillRule)
+{
+	if (ctx->record != NULL)
+		nvg__recordCall(ctx, NVG_RECORD_FILL, paint, compositeOperation, scissor, 0.0f, 0, fillRule, bounds, NULL,
+						paths, npaths, NULL, 0);
 	else
-		nvg__expandFill(ctx, 0.0f, NVG_MITER, 2.4f);
+		ctx->params.renderFill(ctx->params.userPtr, paint, compositeOperation, scissor, ctx->fringeWidth,
+							   bounds, paths, npaths, fillRule);
+}
 
-	// Apply global alpha
-	fillPaint.innerColor.a *= state->alpha;
-	fillPaint.outerColor.a *= state->alpha;
+static void nvg__renderStroke(NVGcontext* ctx, NVGpaint* paint, NVGcompositeOperationState compositeOperation,
+							  NVGscissor* scissor, float strokeWidth, const NVGpath* paths, int npaths)
+{
+	if (ctx->record != NULL)
+		nvg__recordCall(ctx, NVG_RECORD_STROKE, paint, compositeOperation, scissor, strokeWidth, 0, 0, NULL, NULL,
+						paths, npaths, NULL, 0);
+	else
+		ctx->params.renderStroke(ctx->params.userPtr, paint, compositeOperation, scissor, ctx->fringeWidth,
+								 strokeWidth, paths, npaths);
+}
+
+static void nvg__renderTriangles(NVGcontext* ctx, NVGpaint* paint, NVGcompositeOperationState compositeOperation,
+								 NVGscissor* scissor, const NVGvertex* verts, int nverts)
+{
+	if (ctx->record != NULL)
+		nvg__recordCall(ctx, NVG_RECORD_TRIANGLES, paint, compositeOperation, scissor, 0.0f, 0, 0, NULL, NULL,
+						NULL, 0, verts, nverts);
+	else
+		ctx->params.renderTriangles(ctx->params.userPtr, paint, compositeOperation, scissor, verts, nverts);
+}
+
+// The optional calls are recorded when the back-end has them, followed by
+// the tessellated fallback for replaying on back-ends which do not.
+static int nvg__renderShape(NVGcontext* ctx, NVGpaint* paint, NVGcompositeOperationState compositeOperation,
+							NVGscissor* scissor, float strokeWidth, const NVGshape* shape)
+{
+	if (ctx->params.renderShape == NULL)
+		return 0;
+	if (ctx->record != NULL) {
+		if (nvg__recordCall(ctx, NVG_RECORD_SHAPE, paint, compositeOperation, scissor, strokeWidth, 0, 0, NULL, shape,
+							NULL, 0, NULL, 0))
+			ctx->record->fallback = 1;
+		return 0;
+	}
+	return ctx->params.renderShape(ctx->params.userPtr, paint, compositeOperation, scissor, ctx->fringeWidth,
+								   strokeWidth, shape);
+}
+
+static int nvg__renderHairline(NVGcontext* ctx, NVGpaint* paint, NVGcompositeOperationState compositeOperation,
+							   NVGscissor* scissor, float strokeWidth, int lineCap, const NVGpath* paths, int npaths)
+{
+	if (ctx->params.renderHairline == NULL)
+		return 0;
+	if (ctx->record != NULL) {
+		if (nvg__recordCall(ctx, NVG_RECORD_HAIRLINE, paint, compositeOperation, scissor, strokeWidth, lineCap, 0,
+							NULL, NULL, paths, npaths, NULL, 0))
+			ctx->record->fallback = 1;
+		return 0;
+	}
+	return ctx->params.renderHairline(ctx->params.userPtr, paint, compositeOperation, scissor, ctx->fringeWidth,
+									  strokeWidth, lineCap, paths, npaths);
+}
+
+static void nvg__renderFillCache(NVGcontext* ctx, NVGpaint* fillPaint)
+{
+	NVGstate* state = nvg__getState(ctx);
+	const NVGpath* path;
+	int i;
 
-	ctx->params.renderFill(ctx->params.userPtr, &fillPaint, state->compositeOperation, &state->scissor, ctx->fringeWidth,
-						   ctx->cache->bounds, ctx->cache->paths, ctx->cache->npaths);
+	nvg__renderFill(ctx, fillPaint, state->compositeOperation, &state->scissor,
+					ctx->cache->bounds, ctx->cache->paths, ctx->cache->npaths, state->fillRule);
 
 	// Count triangles
 	for (i = 0; i < ctx->cache->npaths; i++) {
@@ -2245,69 +2704,613 @@ void nvgFill(NVGcontext* ctx)
 	}
 }
 
-void nvgStroke(NVGcontext* ctx)
+static void nvg__renderStrokeCache(NVGcontext* ctx, NVGpaint* strokePaint, float strokeWidth)
 {
 	NVGstate* state = nvg__getState(ctx);
-	float scale = nvg__getAverageScale(state->xform);
-	float strokeWidth = nvg__clampf(state->strokeWidth * scale, 0.0f, 200.0f);
-	NVGpaint strokePaint = state->stroke;
 	const NVGpath* path;
 	int i;
 
+	nvg__renderStroke(ctx, strokePaint, state->compositeOperation, &state->scissor,
+					  strokeWidth, ctx->cache->paths, ctx->cache->npaths);
+
+	// Count triangles
+	for (i = 0; i < ctx->cache->npaths; i++) {
+		path = &ctx->cache->paths[i];
+		ctx->strokeTriCount += path->nstroke-2;
+		ctx->drawCallCount++;
+	}
+}
+
+static int nvg__renderHairlineCache(NVGcontext* ctx, NVGpaint* strokePaint, float strokeWidth)
+{
+	NVGstate* state = nvg__getState(ctx);
+	if (!nvg__renderHairline(ctx, strokePaint, state->compositeOperation, &state->scissor,
+							 strokeWidth, state->lineCap, ctx->cache->paths, ctx->cache->npaths))
+		return 0;
+	ctx->drawCallCount++;
+	return 1;
+}
+
+// Returns the stroke width in device pixels and applies the global alpha to
+// the paint, strokes thinner than a pixel fade it instead.
+static float nvg__strokeWidth(NVGcontext* ctx, NVGpaint* strokePaint)
+{
+	NVGstate* state = nvg__getState(ctx);
+	float scale = nvg__getAverageScale(state->xform);
+	float strokeWidth = nvg__clampf(state->strokeWidth * scale, 0.0f, 200.0f);
 
 	if (strokeWidth < ctx->fringeWidth) {
 		// If the stroke width is less than pixel size, use alpha to emulate coverage.
 		// Since coverage is area, scale by alpha*alpha.
 		float alpha = nvg__clampf(strokeWidth / ctx->fringeWidth, 0.0f, 1.0f);
-		strokePaint.innerColor.a *= alpha*alpha;
-		strokePaint.outerColor.a *= alpha*alpha;
+		strokePaint->innerColor.a *= alpha*alpha;
+		strokePaint->outerColor.a *= alpha*alpha;
 		strokeWidth = ctx->fringeWidth;
 	}
 
 	// Apply global alpha
-	strokePaint.innerColor.a *= state->alpha;
-	strokePaint.outerColor.a *= state->alpha;
+	strokePaint->innerColor.a *= state->alpha;
+	strokePaint->outerColor.a *= state->alpha;
 
-	nvg__flattenPaths(ctx);
+	return strokeWidth;
+}
+
+void nvgFill(NVGcontext* ctx)
+{
+	NVGstate* state = nvg__getState(ctx);
+	NVGpaint fillPaint = state->fill;
+
+	// Apply global alpha
+	fillPaint.innerColor.a *= state->alpha;
+	fillPaint.outerColor.a *= state->alpha;
+
+	if (ctx->shape.type != NVG_SHAPE_NONE && ctx->params.renderShape != NULL && state->shapeAntiAlias &&
+		nvg__renderShape(ctx, &fillPaint, state->compositeOperation, &state->scissor, 0.0f, &ctx->shape)) {
+		ctx->drawCallCount++;
+		return;
+	}
+
+	nvg__flattenPaths(ctx);
+	if (ctx->params.edgeAntiAlias && state->shapeAntiAlias)
+		nvg__expandFill(ctx, ctx->fringeWidth, NVG_MITER, 2.4f);
+	else
+		nvg__expandFill(ctx, 0.0f, NVG_MITER, 2.4f);
+
+	nvg__renderFillCache(ctx, &fillPaint);
+}
+
+void nvgStroke(NVGcontext* ctx)
+{
+	NVGstate* state = nvg__getState(ctx);
+	NVGpaint strokePaint = state->stroke;
+	float strokeWidth = nvg__strokeWidth(ctx, &strokePaint);
+
+	// Sharp rect corners need a miter join, ellipses other than circles
+	// have no elliptical outline.
+	if (ctx->shape.type != NVG_SHAPE_NONE && ctx->params.renderShape != NULL && state->shapeAntiAlias &&
+		(ctx->shape.type != NVG_SHAPE_RECT || (state->lineJoin == NVG_MITER && state->miterLimit >= 1.5f)) &&
+		(ctx->shape.type != NVG_SHAPE_ELLIPSE || ctx->shape.hx == ctx->shape.hy) &&
+		nvg__renderShape(ctx, &strokePaint, state->compositeOperation, &state->scissor, strokeWidth, &ctx->shape)) {
+		ctx->drawCallCount++;
+		return;
+	}
+
+	nvg__flattenPaths(ctx);
+
+	if (strokeWidth <= 2.0f*ctx->fringeWidth && ctx->params.renderHairline != NULL && state->shapeAntiAlias &&
+		nvg__hairlinePaths(ctx, state->lineJoin) &&
+		nvg__renderHairlineCache(ctx, &strokePaint, strokeWidth))
+		return;
 
 	if (ctx->params.edgeAntiAlias && state->shapeAntiAlias)
 		nvg__expandStroke(ctx, strokeWidth*0.5f, ctx->fringeWidth, state->lineCap, state->lineJoin, state->miterLimit);
 	else
 		nvg__expandStroke(ctx, strokeWidth*0.5f, 0.0f, state->lineCap, state->lineJoin, state->miterLimit);
 
-	ctx->params.renderStroke(ctx->params.userPtr, &strokePaint, state->compositeOperation, &state->scissor, ctx->fringeWidth,
-							 strokeWidth, ctx->cache->paths, ctx->cache->npaths);
+	nvg__renderStrokeCache(ctx, &strokePaint, strokeWidth);
+}
 
-	// Count triangles
-	for (i = 0; i < ctx->cache->npaths; i++) {
-		path = &ctx->cache->paths[i];
-		ctx->strokeTriCount += path->nstroke-2;
-		ctx->drawCallCount++;
+// Retained paths
+
+// Linear transform retained geometry is built under for xform. Rotations and
+// reflections with uniform scale only keep the scale, they are applied to the
+// expanded vertices when drawing.
+static void nvg__retainedKey(float* key, const float* xform)
+{
+	float s = nvg__getAverageScale((float*)xform);
+	float tol = s * NVG_RETAINED_TOL;
+	if ((nvg__absf(xform[0] - xform[3]) <= tol && nvg__absf(xform[1] + xform[2]) <= tol) ||
+		(nvg__absf(xform[0] + xform[3]) <= tol && nvg__absf(xform[1] - xform[2]) <= tol)) {
+		key[0] = s; key[1] = 0.0f;
+		key[2] = 0.0f; key[3] = s;
+	} else {
+		key[0] = xform[0]; key[1] = xform[1];
+		key[2] = xform[2]; key[3] = xform[3];
+	}
+}
+
+static int nvg__retainedMatch(const NVGretainedGeom* geom, const float* key, float width, float fringe,
+							  int lineCap, int lineJoin, float miterLimit, int antiAlias, int hairline)
+{
+	float tol = nvg__getAverageScale((float*)geom->xform) * NVG_RETAINED_TOL;
+	int i;
+	if (!geom->valid)
+		return 0;
+	for (i = 0; i < 4; i++) {
+		if (nvg__absf(geom->xform[i] - key[i]) > tol)
+			return 0;
 	}
+	return nvg__absf(geom->width - width) <= geom->width * NVG_RETAINED_TOL && geom->fringe == fringe &&
+		geom->lineCap == lineCap && geom->lineJoin == lineJoin && geom->miterLimit == miterLimit &&
+		geom->antiAlias == antiAlias && geom->allowHairline == hairline;
+}
+
+// Flattens the retained path under the linear transform key into the path
+// cache. The current path is flattened again on its next use.
+static int nvg__retainedFlatten(NVGcontext* ctx, NVGretainedPath* path, const float* key)
+{
+	float xform[6] = { key[0], key[1], key[2], key[3], 0.0f, 0.0f };
+	float* commands = ctx->commands;
+	int ncommands = ctx->ncommands;
+	float* vals;
+
+	nvg__clearPathCache(ctx);
+	if (path->ncommands == 0)
+		return 1;
+	vals = (float*)malloc(sizeof(float)*path->ncommands);
+	if (vals == NULL) return 0;
+	memcpy(vals, path->commands, sizeof(float)*path->ncommands);
+	nvg__transformCommands(vals, path->ncommands, xform);
+
+	ctx->commands = vals;
+	ctx->ncommands = path->ncommands;
+	nvg__flattenPaths(ctx);
+	ctx->commands = commands;
+	ctx->ncommands = ncommands;
+
+	free(vals);
+	return 1;
+}
+
+// Keeps a copy of the paths and vertices expanded into the path cache.
+static int nvg__retainedStore(NVGcontext* ctx, NVGretainedGeom* geom)
+{
+	NVGpathCache* cache = ctx->cache;
+	int i, nverts = 0;
+
+	for (i = 0; i < cache->npaths; i++) {
+		NVGpath* path = &cache->paths[i];
+		if (path->fill != NULL)
+			nverts = nvg__maxi(nverts, (int)(path->fill - cache->verts) + path->nfill);
+		if (path->stroke != NULL)
+			nverts = nvg__maxi(nverts, (int)(path->stroke - cache->verts) + path->nstroke);
+	}
+
+	if (cache->npaths > geom->cpaths) {
+		NVGpath* paths = (NVGpath*)realloc(geom->paths, sizeof(NVGpath)*cache->npaths);
+		if (paths == NULL) return 0;
+		geom->paths = paths;
+		geom->cpaths = cache->npaths;
+	}
+	if (nverts > geom->cverts) {
+		NVGvertex* verts = (NVGvertex*)realloc(geom->verts, sizeof(NVGvertex)*nverts);
+		if (verts == NULL) return 0;
+		geom->verts = verts;
+		geom->cverts = nverts;
+	}
+
+	if (nverts > 0)
+		memcpy(geom->verts, cache->verts, sizeof(NVGvertex)*nverts);
+	for (i = 0; i < cache->npaths; i++) {
+		NVGpath* path = &geom->paths[i];
+		*path = cache->paths[i];
+		if (path->fill != NULL)
+			path->fill = geom->verts + (path->fill - cache->verts);
+		if (path->stroke != NULL)
+			path->stroke = geom->verts + (path->stroke - cache->verts);
+	}
+	geom->npaths = cache->npaths;
+	geom->nverts = nverts;
+	memcpy(geom->bounds, cache->bounds, sizeof(geom->bounds));
+	return 1;
+}
+
+// Copies the retained geometry into the path cache, mapped from the space it
+// was built in to xform.
+static int nvg__retainedCopy(NVGcontext* ctx, const NVGretainedGeom* geom, const float* xform)
+{
+	NVGpathCache* cache = ctx->cache;
+	float key[6] = { geom->xform[0], geom->xform[1], geom->xform[2], geom->xform[3], 0.0f, 0.0f };
+	float t[6], x, y;
+	NVGvertex* verts;
+	int i;
+
+	if (!nvgTransformInverse(t, key))
+		return 0;
+	nvgTransformMultiply(t, xform);
+
+	nvg__clearPathCache(ctx);
+	verts = nvg__allocTempVerts(ctx, geom->nverts);
+	if (verts == NULL && geom->nverts > 0) return 0;
+	if (nvg__allocTempPaths(ctx, geom->npaths) == NULL && geom->npaths > 0) return 0;
+
+	for (i = 0; i < geom->nverts; i++) {
+		const NVGvertex* v = &geom->verts[i];
+		nvgTransformPoint(&verts[i].x, &verts[i].y, t, v->x, v->y);
+		verts[i].u = v->u;
+		verts[i].v = v->v;
+	}
+	for (i = 0; i < geom->npaths; i++) {
+		NVGpath* path = &cache->paths[i];
+		*path = geom->paths[i];
+		if (path->fill != NULL)
+			path->fill = verts + (path->fill - geom->verts);
+		if (path->stroke != NULL)
+			path->stroke = verts + (path->stroke - geom->verts);
+	}
+	cache->npaths = geom->npaths;
+
+	// Bounds of the transformed bounding box.
+	cache->bounds[0] = cache->bounds[1] = 1e6f;
+	cache->bounds[2] = cache->bounds[3] = -1e6f;
+	for (i = 0; i < 4; i++) {
+		nvgTransformPoint(&x, &y, t, geom->bounds[(i & 1) ? 2 : 0], geom->bounds[(i & 2) ? 3 : 1]);
+		cache->bounds[0] = nvg__minf(cache->bounds[0], x);
+		cache->bounds[1] = nvg__minf(cache->bounds[1], y);
+		cache->bounds[2] = nvg__maxf(cache->bounds[2], x);
+		cache->bounds[3] = nvg__maxf(cache->bounds[3], y);
+	}
+	return 1;
+}
+
+static void nvg__retainedSetKey(NVGretainedGeom* geom, const float* key, float width, float fringe,
+								int lineCap, int lineJoin, float miterLimit, int antiAlias, int hairline)
+{
+	memcpy(geom->xform, key, sizeof(geom->xform));
+	geom->width = width;
+	geom->fringe = fringe;
+	geom->lineCap = lineCap;
+	geom->lineJoin = lineJoin;
+	geom->miterLimit = miterLimit;
+	geom->antiAlias = antiAlias;
+	geom->allowHairline = hairline;
+	geom->valid = 1;
+}
+
+NVGretainedPath* nvgRetainPath(NVGcontext* ctx)
+{
+	NVGstate* state = nvg__getState(ctx);
+	NVGretainedPath* path;
+	float inv[6];
+
+	// The commands are stored back in the space of the current transform.
+	if (!nvgTransformInverse(inv, state->xform))
+		return NULL;
+
+	path = (NVGretainedPath*)malloc(sizeof(NVGretainedPath));
+	if (path == NULL) return NULL;
+	memset(path, 0, sizeof(NVGretainedPath));
+
+	if (ctx->ncommands > 0) {
+		path->commands = (float*)malloc(sizeof(float)*ctx->ncommands);
+		if (path->commands == NULL) {
+			free(path);
+			return NULL;
+		}
+		memcpy(path->commands, ctx->commands, sizeof(float)*ctx->ncommands);
+		path->ncommands = ctx->ncommands;
+		nvg__transformCommands(path->commands, path->ncommands, inv);
+	}
+
+	return path;
+}
+
+void nvgDeleteRetainedPath(NVGcontext* ctx, NVGretainedPath* path)
+{
+	NVG_NOTUSED(ctx);
+	if (path == NULL) return;
+	free(path->commands);
+	free(path->fill.paths);
+	free(path->fill.verts);
+	free(path->stroke.paths);
+	free(path->stroke.verts);
+	free(path);
+}
+
+void nvgFillRetained(NVGcontext* ctx, NVGretainedPath* path)
+{
+	NVGstate* state = nvg__getState(ctx);
+	NVGretainedGeom* geom = &path->fill;
+	NVGpaint fillPaint = state->fill;
+	int antiAlias = ctx->params.edgeAntiAlias && state->shapeAntiAlias;
+	float key[4];
+
+	// Apply global alpha
+	fillPaint.innerColor.a *= state->alpha;
+	fillPaint.outerColor.a *= state->alpha;
+
+	nvg__retainedKey(key, state->xform);
+	if (!nvg__retainedMatch(geom, key, 0.0f, ctx->fringeWidth, 0, 0, 0.0f, antiAlias, 0)) {
+		geom->valid = 0;
+		if (!nvg__retainedFlatten(ctx, path, key))
+			return;
+		nvg__expandFill(ctx, antiAlias ? ctx->fringeWidth : 0.0f, NVG_MITER, 2.4f);
+		if (nvg__retainedStore(ctx, geom))
+			nvg__retainedSetKey(geom, key, 0.0f, ctx->fringeWidth, 0, 0, 0.0f, antiAlias, 0);
+		nvg__clearPathCache(ctx);
+		if (!geom->valid)
+			return;
+	}
+
+	if (nvg__retainedCopy(ctx, geom, state->xform))
+		nvg__renderFillCache(ctx, &fillPaint);
+	nvg__clearPathCache(ctx);
+}
+
+static void nvg__strokeRetained(NVGcontext* ctx, NVGretainedPath* path, int allowHairline)
+{
+	NVGstate* state = nvg__getState(ctx);
+	NVGretainedGeom* geom = &path->stroke;
+	NVGpaint strokePaint = state->stroke;
+	float strokeWidth = nvg__strokeWidth(ctx, &strokePaint);
+	int antiAlias = ctx->params.edgeAntiAlias && state->shapeAntiAlias;
+	int hairline = allowHairline && strokeWidth <= 2.0f*ctx->fringeWidth && ctx->params.renderHairline != NULL &&
+		state->shapeAntiAlias && !geom->declinedHairline;
+	float key[4];
+
+	nvg__retainedKey(key, state->xform);
+	if (!nvg__retainedMatch(geom, key, strokeWidth, ctx->fringeWidth, state->lineCap, state->lineJoin,
+							state->miterLimit, antiAlias, hairline)) {
+		geom->valid = 0;
+		if (!nvg__retainedFlatten(ctx, path, key))
+			return;
+		geom->hairline = hairline && nvg__hairlinePaths(ctx, state->lineJoin);
+		if (!geom->hairline)
+			nvg__expandStroke(ctx, strokeWidth*0.5f, antiAlias ? ctx->fringeWidth : 0.0f,
+							  state->lineCap, state->lineJoin, state->miterLimit);
+		if (nvg__retainedStore(ctx, geom))
+			nvg__retainedSetKey(geom, key, strokeWidth, ctx->fringeWidth, state->lineCap, state->lineJoin,
+								state->miterLimit, antiAlias, hairline);
+		nvg__clearPathCache(ctx);
+		if (!geom->valid)
+			return;
+	}
+
+	if (nvg__retainedCopy(ctx, geom, state->xform)) {
+		if (!geom->hairline) {
+			nvg__renderStrokeCache(ctx, &strokePaint, strokeWidth);
+		} else if (!nvg__renderHairlineCache(ctx, &strokePaint, strokeWidth)) {
+			// The backend wants expanded strokes, rebuild and draw those.
+			// Recording always declines, the back-end may still take them.
+			nvg__clearPathCache(ctx);
+			if (ctx->record == NULL)
+				geom->declinedHairline = 1;
+			geom->valid = 0;
+			nvg__strokeRetained(ctx, path, 0);
+			return;
+		}
+	}
+	nvg__clearPathCache(ctx);
+}
+
+void nvgStrokeRetained(NVGcontext* ctx, NVGretainedPath* path)
+{
+	nvg__strokeRetained(ctx, path, 1);
+}
+
+// Display lists
+
+int nvgBeginRecord(NVGcontext* ctx)
+{
+	if (ctx->record != NULL) return 0;
+	ctx->record = (NVGdisplayList*)malloc(sizeof(NVGdisplayList));
+	if (ctx->record == NULL) return 0;
+	memset(ctx->record, 0, sizeof(NVGdisplayList));
+	return 1;
+}
+
+NVGdisplayList* nvgEndRecord(NVGcontext* ctx)
+{
+	NVGdisplayList* list = ctx->record;
+	ctx->record = NULL;
+	if (list != NULL)
+		list->fallback = 0;
+	return list;
+}
+
+void nvgDeleteDisplayList(NVGcontext* ctx, NVGdisplayList* list)
+{
+	NVG_NOTUSED(ctx);
+	if (list == NULL) return;
+	free(list->data);
+	free(list);
+}
+
+// Copies the paths of a recorded call into the path cache, transformed by xform.
+static int nvg__replayPaths(NVGcontext* ctx, const NVGrecordCall* call, const float* xform)
+{
+	const NVGrecordPath* rpaths = (const NVGrecordPath*)(call + 1);
+	const NVGvertex* rverts = (const NVGvertex*)(rpaths + call->npaths);
+	NVGpath* paths;
+	NVGvertex* verts;
+	int i;
+
+	nvg__clearPathCache(ctx);
+	verts = nvg__allocTempVerts(ctx, call->nverts);
+	if (verts == NULL && call->nverts > 0) return 0;
+	paths = nvg__allocTempPaths(ctx, call->npaths);
+	if (paths == NULL && call->npaths > 0) return 0;
+
+	for (i = 0; i < call->nverts; i++) {
+		nvgTransformPoint(&verts[i].x, &verts[i].y, xform, rverts[i].x, rverts[i].y);
+		verts[i].u = rverts[i].u;
+		verts[i].v = rverts[i].v;
+	}
+	for (i = 0; i < call->npaths; i++) {
+		const NVGrecordPath* rpath = &rpaths[i];
+		NVGpath* path = &paths[i];
+		memset(path, 0, sizeof(NVGpath));
+		path->first = rpath->first;
+		path->count = rpath->count;
+		path->closed = (unsigned char)rpath->closed;
+		path->nbevel = rpath->nbevel;
+		path->winding = rpath->winding;
+		path->convex = rpath->convex;
+		path->fill = rpath->nfill > 0 ? &verts[rpath->fill] : NULL;
+		path->nfill = rpath->nfill;
+		path->stroke = rpath->nstroke > 0 ? &verts[rpath->stroke] : NULL;
+		path->nstroke = rpath->nstroke;
+	}
+	ctx->cache->npaths = call->npaths;
+
+	// Bounds of the transformed bounding box.
+	ctx->cache->bounds[0] = ctx->cache->bounds[1] = 1e6f;
+	ctx->cache->bounds[2] = ctx->cache->bounds[3] = -1e6f;
+	for (i = 0; i < 4; i++) {
+		float x, y;
+		nvgTransformPoint(&x, &y, xform, call->bounds[(i & 1) ? 2 : 0], call->bounds[(i & 2) ? 3 : 1]);
+		ctx->cache->bounds[0] = nvg__minf(ctx->cache->bounds[0], x);
+		ctx->cache->bounds[1] = nvg__minf(ctx->cache->bounds[1], y);
+		ctx->cache->bounds[2] = nvg__maxf(ctx->cache->bounds[2], x);
+		ctx->cache->bounds[3] = nvg__maxf(ctx->cache->bounds[3], y);
+	}
+	return 1;
+}
+
+// Replays a recorded shape, these stay shapes only under transforms which
+// keep them axis aligned and do not make round parts elliptical.
+static int nvg__replayShape(NVGcontext* ctx, NVGpaint* paint, const NVGrecordCall* call,
+							NVGscissor* scissor, float strokeWidth, float* xform)
+{
+	NVGshape shape = call->shape;
+	float sx = nvg__absf(xform[0]), sy = nvg__absf(xform[3]);
+
+	if (xform[1] != 0.0f || xform[2] != 0.0f)
+		return 0;
+	if (shape.type != NVG_SHAPE_RECT && sx != sy)
+		return 0;
+	nvgTransformPoint(&shape.cx, &shape.cy, xform, call->shape.cx, call->shape.cy);
+	shape.hx *= sx;
+	shape.hy *= sy;
+	shape.radius *= sx;
+	return nvg__renderShape(ctx, paint, call->compositeOperation, scissor, strokeWidth, &shape);
+}
+
+void nvgDrawDisplayList(NVGcontext* ctx, const NVGdisplayList* list)
+{
+	NVGstate* state = nvg__getState(ctx);
+	int offset, i, drawn = 0;
+
+	if (list == NULL) return;
+
+	for (offset = 0; offset < list->ndata; offset += ((const NVGrecordCall*)&list->data[offset])->size) {
+		const NVGrecordCall* call = (const NVGrecordCall*)&list->data[offset];
+		NVGpaint paint = call->paint;
+		NVGscissor scissor = call->scissor;
+		float strokeWidth = call->strokeWidth * nvg__getAverageScale(state->xform);
+
+		// A call followed by fallbacks draws the first one the back-end takes.
+		if (!call->fallback)
+			drawn = 0;
+		else if (drawn)
+			continue;
+
+		nvgTransformMultiply(paint.xform, state->xform);
+		nvgTransformMultiply(scissor.xform, state->xform);
+		paint.innerColor.a *= state->alpha;
+		paint.outerColor.a *= state->alpha;
+
+		switch (call->type) {
+		case NVG_RECORD_FILL:
+			if (!nvg__replayPaths(ctx, call, state->xform))
+				break;
+			nvg__renderFill(ctx, &paint, call->compositeOperation, &scissor,
+							ctx->cache->bounds, ctx->cache->paths, ctx->cache->npaths, call->fillRule);
+			for (i = 0; i < ctx->cache->npaths; i++) {
+				ctx->fillTriCount += ctx->cache->paths[i].nfill-2;
+				ctx->fillTriCount += ctx->cache->paths[i].nstroke-2;
+				ctx->drawCallCount += 2;
+			}
+			drawn = 1;
+			break;
+		case NVG_RECORD_STROKE:
+			if (!nvg__replayPaths(ctx, call, state->xform))
+				break;
+			nvg__renderStroke(ctx, &paint, call->compositeOperation, &scissor,
+							  strokeWidth, ctx->cache->paths, ctx->cache->npaths);
+			for (i = 0; i < ctx->cache->npaths; i++) {
+				ctx->strokeTriCount += ctx->cache->paths[i].nstroke-2;
+				ctx->drawCallCount++;
+			}
+			drawn = 1;
+			break;
+		case NVG_RECORD_TRIANGLES:
+			if (!nvg__replayPaths(ctx, call, state->xform))
+				break;
+			nvg__renderTriangles(ctx, &paint, call->compositeOperation, &scissor, ctx->cache->verts, call->nverts);
+			ctx->drawCallCount++;
+			ctx->textTriCount += call->nverts/3;
+			drawn = 1;
+			break;
+		case NVG_RECORD_SHAPE:
+			if (nvg__replayShape(ctx, &paint, call, &scissor, strokeWidth, state->xform)) {
+				ctx->drawCallCount++;
+				drawn = 1;
+			}
+			break;
+		case NVG_RECORD_HAIRLINE:
+			// Scaled up hairlines are left to the expanded stroke after it.
+			if (strokeWidth <= 2.0f*ctx->fringeWidth && nvg__replayPaths(ctx, call, state->xform) &&
+				nvg__renderHairline(ctx, &paint, call->compositeOperation, &scissor,
+									strokeWidth, call->lineCap, ctx->cache->paths, ctx->cache->npaths)) {
+				ctx->drawCallCount++;
+				drawn = 1;
+			}
+			break;
+		}
+	}
+
+	nvg__clearPathCache(ctx);
 }
 
 // Add fonts
 int nvgCreateFont(NVGcontext* ctx, const char* name, const char* path)
 {
-	return fonsAddFont(ctx->fs, name, path);
+	int font;
+	nvg__lockFonts(ctx);
+	font = fonsAddFont(ctx->fs, name, path);
+	nvg__unlockFonts(ctx);
+	return font;
 }
 
 int nvgCreateFontMem(NVGcontext* ctx, const char* name, unsigned char* data, int ndata, int freeData)
 {
-	return fonsAddFontMem(ctx->fs, name, data, ndata, freeData);
+	int font;
+	nvg__lockFonts(ctx);
+	font = fonsAddFontMem(ctx->fs, name, data, ndata, freeData);
+	nvg__unlockFonts(ctx);
+	return font;
 }
 
 int nvgFindFont(NVGcontext* ctx, const char* name)
 {
+	int font;
 	if (name == NULL) return -1;
-	return fonsGetFontByName(ctx->fs, name);
+	nvg__lockFonts(ctx);
+	font = fonsGetFontByName(ctx->fs, name);
+	nvg__unlockFonts(ctx);
+	return font;
 }
 
 
 int nvgAddFallbackFontId(NVGcontext* ctx, int baseFont, int fallbackFont)
 {
+	int res;
 	if(baseFont == -1 || fallbackFont == -1) return 0;
-	return fonsAddFallbackFont(ctx->fs, baseFont, fallbackFont);
+	nvg__lockFonts(ctx);
+	res = fonsAddFallbackFont(ctx->fs, baseFont, fallbackFont);
+	nvg__unlockFonts(ctx);
+	return res;
 }
 
 int nvgAddFallbackFont(NVGcontext* ctx, const char* baseFont, const char* fallbackFont)
@@ -2355,7 +3358,7 @@ void nvgFontFaceId(NVGcontext* ctx, int font)
 void nvgFontFace(NVGcontext* ctx, const char* font)
 {
 	NVGstate* state = nvg__getState(ctx);
-	state->fontId = fonsGetFontByName(ctx->fs, font);
+	state->fontId = nvgFindFont(ctx, font);
 }
 
 static float nvg__quantize(float a, float d)
@@ -2368,23 +3371,107 @@ static float nvg__getFontScale(NVGstate* state)
 	return nvg__minf(nvg__quantize(nvg__getAverageScale(state->xform), 0.01f), 4.0f);
 }
 
+static void nvg__updateFontImage(NVGcontext* ctx, const int* dirty)
+{
+	int fontImage = ctx->fontImages[ctx->fontImageIdx];
+	// Update texture
+	if (fontImage != 0 && dirty[2] > dirty[0] && dirty[3] > dirty[1]) {
+		int iw, ih, tw, th;
+		const unsigned char* data = fonsGetTextureData(ctx->fs, &iw, &ih);
+		int x = dirty[0];
+		int y = dirty[1];
+		int w = dirty[2] - dirty[0];
+		int h = dirty[3] - dirty[1];
+		// A context out of font images keeps its image when a shared atlas
+		// grows, the atlas data no longer fits it.
+		nvgImageSize(ctx, fontImage, &tw, &th);
+		if (tw != iw || th != ih)
+			return;
+		ctx->params.renderUpdateTexture(ctx->params.userPtr, fontImage, x,y, w,h, data);
+	}
+}
+
+static void nvg__unionRect(int* dst, const int* src)
+{
+	dst[0] = nvg__mini(dst[0], src[0]);
+	dst[1] = nvg__mini(dst[1], src[1]);
+	dst[2] = nvg__maxi(dst[2], src[2]);
+	dst[3] = nvg__maxi(dst[3], src[3]);
+}
+
+// Moves on to the next font image, of size iw*ih.
+static int nvg__nextFontImage(NVGcontext* ctx, int iw, int ih)
+{
+	int* fontImage;
+	int w, h;
+	if (ctx->fontImageIdx >= NVG_MAX_FONTIMAGES-1)
+		return 0;
+	fontImage = &ctx->fontImages[ctx->fontImageIdx+1];
+	if (*fontImage != 0) {
+		nvgImageSize(ctx, *fontImage, &w, &h);
+		if (w != iw || h != ih) {
+			nvgDeleteImage(ctx, *fontImage);
+			*fontImage = 0;
+		}
+	}
+	if (*fontImage == 0)
+		*fontImage = ctx->params.renderCreateTexture(ctx->params.userPtr, NVG_TEXTURE_ALPHA, iw, ih, 0, NULL);
+	if (*fontImage == 0)
+		return 0;
+	++ctx->fontImageIdx;
+	return 1;
+}
+
+// Brings the font image up to date with a shared atlas, moving on to a
+// new image when another context has reset the atlas since.
+static void nvg__syncFontImage(NVGcontext* ctx)
+{
+	NVGfontAtlas* atlas = ctx->fontAtlas;
+	int dirty[4], i;
+
+	if (ctx->atlasResets != atlas->resets) {
+		int iw, ih;
+		fonsGetTextureData(ctx->fs, &iw, &ih);
+		// Out of images, overwrite the current one if it has the atlas size,
+		// text drawn earlier in the frame may show wrong glyphs. Otherwise
+		// nvg__updateFontImage leaves it alone.
+		nvg__nextFontImage(ctx, iw, ih);
+		ctx->atlasResets = atlas->resets;
+		ctx->atlasSerial = -1;
+	}
+	if (ctx->atlasSerial == atlas->serial)
+		return;
+
+	if (ctx->atlasSerial < 0 || atlas->serial - ctx->atlasSerial > NVG_ATLAS_DIRTY_RECTS) {
+		memcpy(dirty, atlas->dirty, sizeof(dirty));
+	} else {
+		dirty[0] = dirty[1] = INT_MAX;
+		dirty[2] = dirty[3] = -INT_MAX;
+		for (i = ctx->atlasSerial; i < atlas->serial; i++)
+			nvg__unionRect(dirty, atlas->rects[i % NVG_ATLAS_DIRTY_RECTS]);
+	}
+	nvg__updateFontImage(ctx, dirty);
+	ctx->atlasSerial = atlas->serial;
+}
+
 static void nvg__flushTextTexture(NVGcontext* ctx)
 {
+	NVGfontAtlas* atlas = ctx->fontAtlas;
 	int dirty[4];
 
+	if (atlas == NULL) {
+		if (fonsValidateTexture(ctx->fs, dirty))
+			nvg__updateFontImage(ctx, dirty);
+		return;
+	}
+
+	// Log the glyphs added by this context for the others.
 	if (fonsValidateTexture(ctx->fs, dirty)) {
-		int fontImage = ctx->fontImages[ctx->fontImageIdx];
-		// Update texture
-		if (fontImage != 0) {
-			int iw, ih;
-			const unsigned char* data = fonsGetTextureData(ctx->fs, &iw, &ih);
-			int x = dirty[0];
-			int y = dirty[1];
-			int w = dirty[2] - dirty[0];
-			int h = dirty[3] - dirty[1];
-			ctx->params.renderUpdateTexture(ctx->params.userPtr, fontImage, x,y, w,h, data);
-		}
+		memcpy(atlas->rects[atlas->serial % NVG_ATLAS_DIRTY_RECTS], dirty, sizeof(dirty));
+		nvg__unionRect(atlas->dirty, dirty);
+		atlas->serial++;
 	}
+	nvg__syncFontImage(ctx);
 }
 
 static int nvg__allocTextAtlas(NVGcontext* ctx)
@@ -2404,10 +3491,90 @@ static int nvg__allocTextAtlas(NVGcontext* ctx)
 			iw *= 2;
 		if (iw > NVG_MAX_FONTIMAGE_SIZE || ih > NVG_MAX_FONTIMAGE_SIZE)
 			iw = ih = NVG_MAX_FONTIMAGE_SIZE;
-		ctx->fontImages[ctx->fontImageIdx+1] = ctx->params.renderCreateTexture(ctx->params.userPtr, NVG_TEXTURE_ALPHA, iw, ih, 0, NULL);
 	}
-	++ctx->fontImageIdx;
+	if (!nvg__nextFontImage(ctx, iw, ih))
+		return 0;
 	fonsResetAtlas(ctx->fs, iw, ih);
+	if (ctx->fontAtlas != NULL) {
+		NVGfontAtlas* atlas = ctx->fontAtlas;
+		atlas->resets++;
+		atlas->dirty[0] = atlas->dirty[1] = INT_MAX;
+		atlas->dirty[2] = atlas->dirty[3] = -INT_MAX;
+		ctx->atlasResets = atlas->resets;
+		ctx->atlasSerial = atlas->serial;
+	}
+	return 1;
+}
+
+NVGfontAtlas* nvgCreateFontAtlas(void)
+{
+	NVGfontAtlas* atlas = (NVGfontAtlas*)malloc(sizeof(NVGfontAtlas));
+	if (atlas == NULL) return NULL;
+	memset(atlas, 0, sizeof(NVGfontAtlas));
+	if (!nvg__initMutex(&atlas->mutex)) {
+		free(atlas);
+		return NULL;
+	}
+	atlas->fs = nvg__createFontStash();
+	if (atlas->fs == NULL) {
+		nvg__destroyMutex(&atlas->mutex);
+		free(atlas);
+		return NULL;
+	}
+	atlas->refs = 1;
+	atlas->dirty[0] = atlas->dirty[1] = INT_MAX;
+	atlas->dirty[2] = atlas->dirty[3] = -INT_MAX;
+	return atlas;
+}
+
+void nvgDeleteFontAtlas(NVGfontAtlas* atlas)
+{
+	int refs;
+	if (atlas == NULL) return;
+	nvg__lockMutex(&atlas->mutex);
+	refs = --atlas->refs;
+	nvg__unlockMutex(&atlas->mutex);
+	if (refs > 0) return;
+	fonsDeleteInternal(atlas->fs);
+	nvg__destroyMutex(&atlas->mutex);
+	free(atlas);
+}
+
+int nvgShareFontAtlas(NVGcontext* ctx, NVGfontAtlas* atlas)
+{
+	int i, iw, ih, fontImage;
+
+	nvg__lockMutex(&atlas->mutex);
+	fonsGetTextureData(atlas->fs, &iw, &ih);
+	fontImage = ctx->params.renderCreateTexture(ctx->params.userPtr, NVG_TEXTURE_ALPHA, iw, ih, 0, NULL);
+	if (fontImage == 0) {
+		nvg__unlockMutex(&atlas->mutex);
+		return 0;
+	}
+	atlas->refs++;
+	nvg__unlockMutex(&atlas->mutex);
+
+	if (ctx->fontAtlas != NULL)
+		nvgDeleteFontAtlas(ctx->fontAtlas);
+	else if (ctx->fs != NULL)
+		fonsDeleteInternal(ctx->fs);
+	for (i = 0; i < NVG_MAX_FONTIMAGES; i++) {
+		if (ctx->fontImages[i] != 0) {
+			nvgDeleteImage(ctx, ctx->fontImages[i]);
+			ctx->fontImages[i] = 0;
+		}
+	}
+
+	ctx->fs = atlas->fs;
+	ctx->fontAtlas = atlas;
+	ctx->fontImages[0] = fontImage;
+	ctx->fontImageIdx = 0;
+	ctx->atlasSerial = -1;
+
+	// Glyphs already in the atlas are uploaded by the first text drawn.
+	nvg__lockMutex(&atlas->mutex);
+	ctx->atlasResets = atlas->resets;
+	nvg__unlockMutex(&atlas->mutex);
 	return 1;
 }
 
@@ -2423,13 +3590,13 @@ static void nvg__renderText(NVGcontext* ctx, NVGvertex* verts, int nverts)
 	paint.innerColor.a *= state->alpha;
 	paint.outerColor.a *= state->alpha;
 
-	ctx->params.renderTriangles(ctx->params.userPtr, &paint, state->compositeOperation, &state->scissor, verts, nverts);
+	nvg__renderTriangles(ctx, &paint, state->compositeOperation, &state->scissor, verts, nverts);
 
 	ctx->drawCallCount++;
 	ctx->textTriCount += nverts/3;
 }
 
-float nvgText(NVGcontext* ctx, float x, float y, const char* string, const char* end)
+static float nvg__text(NVGcontext* ctx, float x, float y, const char* string, const char* end)
 {
 	NVGstate* state = nvg__getState(ctx);
 	FONStextIter iter, prevIter;
@@ -2445,6 +3612,10 @@ float nvgText(NVGcontext* ctx, float x, float y, const char* string, const char*
 
 	if (state->fontId == FONS_INVALID) return x;
 
+	// Another context may have reset the shared atlas since.
+	if (ctx->fontAtlas != NULL)
+		nvg__syncFontImage(ctx);
+
 	fonsSetSize(ctx->fs, state->fontSize*scale);
 	fonsSetSpacing(ctx->fs, state->letterSpacing*scale);
 	fonsSetBlur(ctx->fs, state->fontBlur*scale);
@@ -2496,6 +3667,15 @@ float nvgText(NVGcontext* ctx, float x, float y, const char* string, const char*
 	return iter.nextx / scale;
 }
 
+float nvgText(NVGcontext* ctx, float x, float y, const char* string, const char* end)
+{
+	float res;
+	nvg__lockFonts(ctx);
+	res = nvg__text(ctx, x, y, string, end);
+	nvg__unlockFonts(ctx);
+	return res;
+}
+
 void nvgTextBox(NVGcontext* ctx, float x, float y, float breakRowWidth, const char* string, const char* end)
 {
 	NVGstate* state = nvg__getState(ctx);
@@ -2529,7 +3709,7 @@ void nvgTextBox(NVGcontext* ctx, float x, float y, float breakRowWidth, const ch
 	state->textAlign = oldAlign;
 }
 
-int nvgTextGlyphPositions(NVGcontext* ctx, float x, float y, const char* string, const char* end, NVGglyphPosition* positions, int maxPositions)
+static int nvg__textGlyphPositions(NVGcontext* ctx, float x, float y, const char* string, const char* end, NVGglyphPosition* positions, int maxPositions)
 {
 	NVGstate* state = nvg__getState(ctx);
 	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
@@ -2572,6 +3752,15 @@ int nvgTextGlyphPositions(NVGcontext* ctx, float x, float y, const char* string,
 	return npos;
 }
 
+int nvgTextGlyphPositions(NVGcontext* ctx, float x, float y, const char* string, const char* end, NVGglyphPosition* positions, int maxPositions)
+{
+	int res;
+	nvg__lockFonts(ctx);
+	res = nvg__textGlyphPositions(ctx, x, y, string, end, positions, maxPositions);
+	nvg__unlockFonts(ctx);
+	return res;
+}
+
 enum NVGcodepointType {
 	NVG_SPACE,
 	NVG_NEWLINE,
@@ -2579,7 +3768,7 @@ enum NVGcodepointType {
 	NVG_CJK_CHAR,
 };
 
-int nvgTextBreakLines(NVGcontext* ctx, const char* string, const char* end, float breakRowWidth, NVGtextRow* rows, int maxRows)
+static int nvg__textBreakLines(NVGcontext* ctx, const char* string, const char* end, float breakRowWidth, NVGtextRow* rows, int maxRows)
 {
 	NVGstate* state = nvg__getState(ctx);
 	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
@@ -2785,7 +3974,16 @@ int nvgTextBreakLines(NVGcontext* ctx, const char* string, const char* end, floa
 	return nrows;
 }
 
-float nvgTextBounds(NVGcontext* ctx, float x, float y, const char* string, const char* end, float* bounds)
+int nvgTextBreakLines(NVGcontext* ctx, const char* string, const char* end, float breakRowWidth, NVGtextRow* rows, int maxRows)
+{
+	int res;
+	nvg__lockFonts(ctx);
+	res = nvg__textBreakLines(ctx, string, end, breakRowWidth, rows, maxRows);
+	nvg__unlockFonts(ctx);
+	return res;
+}
+
+static float nvg__textBounds(NVGcontext* ctx, float x, float y, const char* string, const char* end, float* bounds)
 {
 	NVGstate* state = nvg__getState(ctx);
 	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
@@ -2812,7 +4010,16 @@ float nvgTextBounds(NVGcontext* ctx, float x, float y, const char* string, const
 	return width * invscale;
 }
 
-void nvgTextBoxBounds(NVGcontext* ctx, float x, float y, float breakRowWidth, const char* string, const char* end, float* bounds)
+float nvgTextBounds(NVGcontext* ctx, float x, float y, const char* string, const char* end, float* bounds)
+{
+	float res;
+	nvg__lockFonts(ctx);
+	res = nvg__textBounds(ctx, x, y, string, end, bounds);
+	nvg__unlockFonts(ctx);
+	return res;
+}
+
+static void nvg__textBoxBounds(NVGcontext* ctx, float x, float y, float breakRowWidth, const char* string, const char* end, float* bounds)
 {
 	NVGstate* state = nvg__getState(ctx);
 	NVGtextRow rows[2];
@@ -2881,7 +4088,14 @@ void nvgTextBoxBounds(NVGcontext* ctx, float x, float y, float breakRowWidth, co
 	}
 }
 
-void nvgTextMetrics(NVGcontext* ctx, float* ascender, float* descender, float* lineh)
+void nvgTextBoxBounds(NVGcontext* ctx, float x, float y, float breakRowWidth, const char* string, const char* end, float* bounds)
+{
+	nvg__lockFonts(ctx);
+	nvg__textBoxBounds(ctx, x, y, breakRowWidth, string, end, bounds);
+	nvg__unlockFonts(ctx);
+}
+
+static void nvg__textMetrics(NVGcontext* ctx, float* ascender, float* descender, float* lineh)
 {
 	NVGstate* state = nvg__getState(ctx);
 	float scale = nvg__getFontScale(state) * ctx->devicePxRatio;
@@ -2903,4 +4117,11 @@ void nvgTextMetrics(NVGcontext* ctx, float* ascender, float* descender, float* l
 	if (lineh != NULL)
 		*lineh *= invscale;
 }
+
+void nvgTextMetrics(NVGcontext* ctx, float* ascender, float* descender, float* lineh)
+{
+	nvg__lockFonts(ctx);
+	nvg__textMetrics(ctx, ascender, descender, lineh);
+	nvg__unlockFonts(ctx);
+}
 // vim: ft=c nu noet ts=4
@@ -31,6 +31,9 @@ extern "C" {
 #endif
 
 typedef struct NVGcontext NVGcontext;
+typedef struct NVGretainedPath NVGretainedPath;
+typedef struct NVGdisplayList NVGdisplayList;
+typedef struct NVGfontAtlas NVGfontAtlas;
 
 struct NVGcolor {
 	union {
@@ -63,6 +66,11 @@ enum NVGsolidity {
 	NVG_HOLE = 2,			// CW
 };
 
+enum NVGfillRule {
+	NVG_NONZERO,			// Covered where the winding number is not zero
+	NVG_EVENODD,			// Covered where the winding number is odd
+};
+
 enum NVGlineCap {
 	NVG_BUTT,
 	NVG_ROUND,
@@ -241,6 +249,11 @@ void nvgReset(NVGcontext* ctx);
 // Sets whether to draw antialias for nvgStroke() and nvgFill(). It's enabled by default.
 void nvgShapeAntiAlias(NVGcontext* ctx, int enabled);
 
+// Sets the fill rule used by nvgFill() for overlapping sub-paths, see NVGfillRule.
+// Default is NVG_NONZERO, which honours the NVG_SOLID/NVG_HOLE winding set by nvgPathWinding();
+// with NVG_EVENODD every nested sub-path toggles between filled and empty regardless of winding.
+void nvgFillRule(NVGcontext* ctx, int rule);
+
 // Sets current stroke style to a solid color.
 void nvgStrokeColor(NVGcontext* ctx, NVGcolor color);
 
@@ -508,6 +521,56 @@ void nvgFill(NVGcontext* ctx);
 // Fills the current path with current stroke style.
 void nvgStroke(NVGcontext* ctx);
 
+//
+// Retained paths
+//
+// A retained path keeps a copy of the current path which can be filled and stroked
+// later, any number of times and under any transform, without building it again.
+// The flattened and expanded geometry is cached in the path and reused as long as
+// the scale of the transform, the stroke width and style and the pixel ratio stay
+// within about 1% of what it was built for. Translations, rotations and uniform
+// scales within that range cost a vertex copy. A retained path can be drawn by any
+// context, but not by several threads at once.
+
+// Retains the current path, in the space of the current transform.
+// Returns NULL if the transform can not be inverted or out of memory.
+NVGretainedPath* nvgRetainPath(NVGcontext* ctx);
+
+// Deletes a retained path.
+void nvgDeleteRetainedPath(NVGcontext* ctx, NVGretainedPath* path);
+
+// Fills a retained path with current fill style and transform.
+void nvgFillRetained(NVGcontext* ctx, NVGretainedPath* path);
+
+// Strokes a retained path with current stroke style and transform.
+void nvgStrokeRetained(NVGcontext* ctx, NVGretainedPath* path);
+
+//
+// Display lists
+//
+// A display list records the fill, stroke and text calls made between nvgBeginRecord()
+// and nvgEndRecord() as tessellated geometry, with their paints, scissors and composite
+// operations, instead of drawing them. The list can then be replayed any number of
+// times, on any context and back-end, under the transform current at replay. Rects,
+// rounded rects and ellipses are kept as shapes for back-ends which draw those, with
+// their tessellation as fallback for back-ends or transforms which do not.
+// Replaying under a translation draws exactly what was recorded, scales resample the
+// geometry built at the recorded scale. Image paints and text refer to images of the
+// recording context, and the current scissor is ignored in favour of the recorded one.
+
+// Starts recording the render calls of ctx into a new display list. Returns 0 if
+// ctx is already recording, recordings do not nest, or if out of memory.
+int nvgBeginRecord(NVGcontext* ctx);
+
+// Stops recording and returns the display list, NULL if out of memory.
+NVGdisplayList* nvgEndRecord(NVGcontext* ctx);
+
+// Draws a display list with current transform and global alpha.
+void nvgDrawDisplayList(NVGcontext* ctx, const NVGdisplayList* list);
+
+// Deletes a display list.
+void nvgDeleteDisplayList(NVGcontext* ctx, NVGdisplayList* list);
+
 
 //
 // Text
@@ -541,6 +604,22 @@ void nvgStroke(NVGcontext* ctx);
 //		nvgFill(vg);
 //
 // Note: currently only solid color fill is supported for text.
+//
+// Each context has its own fonts and glyph atlas. Contexts can share one font atlas
+// instead, fonts added through one are then available in all of them and glyphs
+// are rasterized once. Contexts sharing an atlas can be used from different threads,
+// the text calls of each take the atlas lock and paths are not affected by it.
+
+// Creates a font atlas to be shared by contexts, see nvgShareFontAtlas().
+// Returns NULL if out of memory.
+NVGfontAtlas* nvgCreateFontAtlas(void);
+
+// Releases the atlas, it is deleted once no context uses it anymore.
+void nvgDeleteFontAtlas(NVGfontAtlas* atlas);
+
+// Makes the context use the specified atlas instead of its own fonts, which are
+// deleted. Returns 1 on success, 0 if the font texture could not be created.
+int nvgShareFontAtlas(NVGcontext* ctx, NVGfontAtlas* atlas);
 
 // Creates font by loading it from the disk from specified file name.
 // Returns handle to the font.
@@ -645,9 +724,29 @@ struct NVGpath {
 };
 typedef struct NVGpath NVGpath;
 
+enum NVGshapeType {
+	NVG_SHAPE_NONE = 0,
+	NVG_SHAPE_RECT,
+	NVG_SHAPE_ROUNDEDRECT,
+	NVG_SHAPE_ELLIPSE,
+};
+
+// Current path when it is a single rect, rounded rect or ellipse drawn under
+// a translate/scale transform, in device space.
+struct NVGshape {
+	int type;
+	float cx, cy;	// Center.
+	float hx, hy;	// Half size, radii of ellipses.
+	float radius;	// Corner radius of rounded rects.
+};
+typedef struct NVGshape NVGshape;
+
 struct NVGparams {
 	void* userPtr;
 	int edgeAntiAlias;
+	// Set when renderFill resolves the edge coverage of concave fills itself,
+	// they are then expanded without fringes.
+	int concaveFillCoverage;
 	int (*renderCreate)(void* uptr);
 	int (*renderCreateTexture)(void* uptr, int type, int w, int h, int imageFlags, const unsigned char* data);
 	int (*renderDeleteTexture)(void* uptr, int image);
@@ -656,9 +755,16 @@ struct NVGparams {
 	void (*renderViewport)(void* uptr, float width, float height, float devicePixelRatio);
 	void (*renderCancel)(void* uptr);
 	void (*renderFlush)(void* uptr);
-	void (*renderFill)(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor, float fringe, const float* bounds, const NVGpath* paths, int npaths);
+	void (*renderFill)(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor, float fringe, const float* bounds, const NVGpath* paths, int npaths, int fillRule);
 	void (*renderStroke)(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor, float fringe, float strokeWidth, const NVGpath* paths, int npaths);
 	void (*renderTriangles)(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor, const NVGvertex* verts, int nverts);
+	// Optional. Fills (strokeWidth 0) or strokes a recognized shape without tessellating it,
+	// returns 0 to fall back to renderFill/renderStroke.
+	int (*renderShape)(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor, float fringe, float strokeWidth, const NVGshape* shape);
+	// Optional. Strokes paths at most two pixels wide from their center lines: the stroke
+	// vertices of each path hold its flattened points, closed paths do not repeat the first one.
+	// Returns 0 to fall back to renderStroke.
+	int (*renderHairline)(void* uptr, NVGpaint* paint, NVGcompositeOperationState compositeOperation, NVGscissor* scissor, float fringe, float strokeWidth, int lineCap, const NVGpath* paths, int npaths);
 	void (*renderDelete)(void* uptr);
 };
 typedef struct NVGparams NVGparams;
@@ -59,12 +59,43 @@ enum NVGcreateFlags {
   NVG_STENCIL_STROKES = 1 << 1,
   // Flag indicating that additional debug checks are done.
   NVG_DEBUG = 1 << 2,
+  // Flag indicating that paths are rasterized with the edge list scanline
+  // rasterizer instead of ray casting against a per call BVH. Combined with
+  // NVG_ANTIALIAS, pixel coverage is computed analytically and no fringe
+  // geometry is generated.
+  NVG_SCANLINE = 1 << 3,
+  // Flag indicating that NVG_SCANLINE frames are binned into screen tiles
+  // which are rasterized in parallel by a pool of worker threads. Draw order
+  // is kept within every tile. Ray cast calls with large BVHs build them on
+  // the same pool.
+  NVG_TILED = 1 << 4,
+  // Flags selecting coverage mask anti-aliasing for ray casting: each pixel
+  // tests a sparse 4, 8 or 16 sample pattern against the geometry as a
+  // bitmask and is shaded once, weighted by the covered fraction. Takes the
+  // place of the fringes and 2x2 supersampling of NVG_ANTIALIAS. The largest
+  // one given wins. Paths swept by the scanline rasterizer (all of them with
+  // NVG_SCANLINE, concave fills otherwise) get analytic coverage instead.
+  NVG_MSAA_4X = 1 << 5,
+  NVG_MSAA_8X = 1 << 6,
+  NVG_MSAA_16X = 1 << 7,
 };
 
 NVGcontext *nvgCreateRT(int flags, int w, int h);
 void nvgDeleteRT(NVGcontext *ctx);
 void nvgClearBackgroundRT(NVGcontext *ctx, float r, float g, float b, float a); // Clear background.
 unsigned char *nvgReadPixelsRT(NVGcontext *ctx); // Returns RGBA8 pixel data.
+// Makes the context render into w x h RGBA8 pixels whose rows are stride
+// bytes apart, e.g. a locked streaming texture. The caller keeps ownership
+// and the buffer must stay valid while it is bound. With pixels NULL the
+// context renders into its own tightly packed buffer of that size.
+// Returns 0 on failure.
+int nvgBindPixelsRT(NVGcontext *ctx, unsigned char *pixels, int w, int h,
+                    int stride);
+// Returns the distance in bytes between rows of nvgReadPixelsRT.
+int nvgPixelStrideRT(NVGcontext *ctx);
+// Sets the number of threads rasterizing NVG_TILED frames and building their
+// BVHs, including the calling one. 0 (default) uses one thread per hardware core.
+void nvgThreadCountRT(NVGcontext *ctx, int nthreads);
 
 // These are additional flags on top of NVGimageFlags.
 enum NVGimageFlagsRT {
@@ -87,141 +118,40 @@ unsigned int nvrtImageHandle(NVGcontext *ctx, int image);
 #include <stdio.h>
 #include <string.h>
 #include <math.h>
+#include <atomic>
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
 #include "nanovg.h"
 
-namespace {
-
-union fi {
-  float f;
-  unsigned int i;
-};
-
-inline unsigned int mask(int x) { return (1U << x) - 1; }
-
-// from fmath.hpp
-/*
-  for given y > 0
-  get f_y(x) := pow(x, y) for x >= 0
-*/
-
-class PowGenerator {
-  enum { N = 11 };
-  float tbl0_[256];
-  struct {
-    float app;
-    float rev;
-  } tbl1_[1 << N];
-
-public:
-  PowGenerator(float y) {
-    for (int i = 0; i < 256; i++) {
-      tbl0_[i] = ::powf(2, (i - 127) * y);
-    }
-    const double e = 1 / double(1 << 24);
-    const double h = 1 / double(1 << N);
-    const size_t n = 1U << N;
-    for (size_t i = 0; i < n; i++) {
-      double x = 1 + double(i) / n;
-      double a = ::pow(x, (double)y);
-      tbl1_[i].app = (float)a;
-      double b = ::pow(x + h - e, (double)y);
-      tbl1_[i].rev = (float)((b - a) / (h - e) / (1 << 23));
-    }
-  }
-  float get(float x) const {
-    fi fi;
-    fi.f = x;
-    int a = (fi.i >> 23) & mask(8);
-    unsigned int b = fi.i & mask(23);
-    unsigned int b1 = b & (mask(N) << (23 - N));
-    unsigned int b2 = b & mask(23 - N);
-    float f;
-    int idx = b1 >> (23 - N);
-    f = tbl0_[a] * (tbl1_[idx].app + float(b2) * tbl1_[idx].rev);
-    return f;
-  }
-};
-
-class TextureSampler {
-
-public:
-  typedef enum {
-    FORMAT_BYTE = 0,
-    FORMAT_FLOAT = 1,
-  } Format;
-
-  TextureSampler() : m_pow(1.0f) {
-    // Make invalid texture
-    m_width = -1;
-    m_height = -1;
-    m_image = NULL;
-    m_components = -1;
-  }
-
-  TextureSampler(unsigned char *image, int width, int height, int components,
-                 Format format, float gamma = 1.0f)
-      : m_pow(gamma) {
-    Set(image, width, height, components, format, gamma);
-  }
-
-  ~TextureSampler() {}
-
-  void Set(const unsigned char *image, int width, int height, int components,
-           Format format, float gamma = 1.0f) {
-    m_width = width;
-    m_height = height;
-    m_image = image;
-    m_invWidth = 1.0f / width;
-    m_invHeight = 1.0f / height;
-    m_components = components;
-    m_format = format;
-    m_gamma = gamma;
-  }
-
-  int width() const { return m_width; }
-
-  int height() const { return m_height; }
-
-  int components() const { return m_components; }
-
-  const unsigned char *image() const { return m_image; }
-
-  int format() const { return m_format; }
-
-  float gamma() const { return m_gamma; }
-
-  void fetch(float *rgba, float u, float v) const;
-
-  bool IsValid() const {
-    return (m_image != NULL) && (m_width > 0) && (m_height > 0);
-  }
-
-private:
-  int m_width;
-  int m_height;
-  float m_invWidth;
-  float m_invHeight;
-  int m_components;
-  const unsigned char *m_image;
-  int m_format;
-  float m_gamma;
-  PowGenerator m_pow;
-};
-
-int inline fasterfloor(const float x) {
-  if (x >= 0) {
-    return (int)x;
-  }
-
-  int y = (int)x;
-  if (std::abs(x - y) <= std::numeric_limits<float>::epsilon()) {
-    // Do nothing.
-  } else {
-    y = y - 1;
-  }
+// Instruction sets of the span kernels, AVX2 is checked at runtime.
+// Define RTNVG_NO_SIMD to build the scalar kernels only.
+#if defined(RTNVG_NO_SIMD)
+#elif defined(__x86_64__) || defined(_M_X64) || defined(__i386__) ||          \
+    defined(_M_IX86)
+#if defined(__SSE2__) || defined(_M_X64) ||                                    \
+    (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#define RTNVG_SSE2 1
+#include <emmintrin.h>
+#endif
+#if defined(__GNUC__)
+#define RTNVG_AVX2 1
+#define RTNVG_TARGET_AVX2 __attribute__((target("avx2")))
+#include <immintrin.h>
+#elif defined(_MSC_VER)
+#define RTNVG_AVX2 1
+#define RTNVG_TARGET_AVX2
+#include <immintrin.h>
+#include <intrin.h>
+#endif
+#elif defined(__aarch64__) || defined(_M_ARM64)
+#define RTNVG_NEON 1
+#include <arm_neon.h>
+#endif
 
-  return y;
-}
+namespace {
 
 inline float lerp(float x, float y, float t) { return x + t * (y - x); }
 
@@ -229,148 +159,6 @@ inline float lerp(float x, float y, float t) { return x + t * (y - x); }
 //  volatile float d = a;
 //  return d != d;
 //}
-
-inline void FilterByteLerp(float *rgba, const unsigned char *image, int i00,
-                           int i10, int i01, int i11, float dx, float dy,
-                           int stride, const PowGenerator &p) {
-  float texel[4][4];
-
-  const float inv = 1.0f / 255.0f;
-  if (stride == 4) {
-
-    // Assume color is already degamma'ed.
-    for (int i = 0; i < 4; i++) {
-      texel[0][i] = (float)image[i00 + i] * inv;
-      texel[1][i] = (float)image[i10 + i] * inv;
-      texel[2][i] = (float)image[i01 + i] * inv;
-      texel[3][i] = (float)image[i11 + i] * inv;
-    }
-
-    for (int i = 0; i < 4; i++) {
-      rgba[i] = lerp(lerp(texel[0][i], texel[1][i], dx),
-                     lerp(texel[2][i], texel[3][i], dx), dy);
-    }
-
-  } else {
-
-    for (int i = 0; i < stride; i++) {
-      texel[0][i] = (float)image[i00 + i] * inv;
-      texel[1][i] = (float)image[i10 + i] * inv;
-      texel[2][i] = (float)image[i01 + i] * inv;
-      texel[3][i] = (float)image[i11 + i] * inv;
-    }
-
-    for (int i = 0; i < stride; i++) {
-      rgba[i] = texel[0][i]; // NEAREST
-      // rgba[i] = lerp(lerp(texel[0][i], texel[1][i], dx), lerp(texel[2][i],
-      // texel[3][i], dx), dy);
-    }
-  }
-
-  if (stride < 4) {
-    for (int i = stride; i < 4; i++) {
-      rgba[i] = rgba[stride - 1];
-    }
-    // rgba[3] = 1.0;
-  }
-}
-}
-
-inline void FilterFloatLerp(float *rgba, const float *image, int i00, int i10,
-                            int i01, int i11, float dx, float dy, int stride,
-                            const PowGenerator &p) {
-  float texel[4][4];
-
-  if (stride == 4) {
-
-    for (int i = 0; i < 4; i++) {
-      texel[0][i] = image[i00 + i];
-      texel[1][i] = image[i10 + i];
-      texel[2][i] = image[i01 + i];
-      texel[3][i] = image[i11 + i];
-    }
-
-    for (int i = 0; i < 4; i++) {
-      rgba[i] = lerp(lerp(texel[0][i], texel[1][i], dx),
-                     lerp(texel[2][i], texel[3][i], dx), dy);
-    }
-
-  } else {
-
-    for (int i = 0; i < stride; i++) {
-      texel[0][i] = image[i00 + i];
-      texel[1][i] = image[i10 + i];
-      texel[2][i] = image[i01 + i];
-      texel[3][i] = image[i11 + i]; // alpha is linear
-    }
-
-    for (int i = 0; i < stride; i++) {
-      rgba[i] = lerp(lerp(texel[0][i], texel[1][i], dx),
-                     lerp(texel[2][i], texel[3][i], dx), dy);
-    }
-  }
-
-  if (stride < 4) {
-    rgba[3] = 1.0;
-  }
-}
-
-void TextureSampler::fetch(float *rgba, float u, float v) const {
-
-  if (!IsValid()) {
-    if (rgba) {
-      rgba[0] = 0.0f;
-      rgba[1] = 0.0f;
-      rgba[2] = 0.0f;
-      rgba[3] = 1.0f;
-    }
-    return;
-  }
-
-  float sx = (float)fasterfloor(u);
-  float sy = (float)fasterfloor(v);
-
-  float uu = u - sx;
-  float vv = v - sy;
-
-  // clamp
-  uu = std::max(uu, 0.0f);
-  uu = std::min(uu, 1.0f);
-  vv = std::max(vv, 0.0f);
-  vv = std::min(vv, 1.0f);
-
-  float px = m_width * uu;
-  float py = m_height * vv;
-
-  int x0 = (int)px;
-  int y0 = (int)py;
-  int x1 = ((x0 + 1) >= m_width) ? (m_width - 1) : (x0 + 1);
-  int y1 = ((y0 + 1) >= m_height) ? (m_height - 1) : (y0 + 1);
-
-  float dx = px - (float)x0;
-  float dy = py - (float)y0;
-
-  float w[4];
-
-  w[0] = (1.0f - dx) * (1.0f - dy);
-  w[1] = (1.0f - dx) * (dy);
-  w[2] = (dx) * (1.0f - dy);
-  w[3] = (dx) * (dy);
-
-  int stride = m_components;
-
-  int i00 = stride * (y0 * m_width + x0);
-  int i01 = stride * (y0 * m_width + x1);
-  int i10 = stride * (y1 * m_width + x0);
-  int i11 = stride * (y1 * m_width + x1);
-
-  if (m_format == FORMAT_BYTE) {
-    FilterByteLerp(rgba, m_image, i00, i01, i10, i11, dx, dy, stride, m_pow);
-  } else if (m_format == FORMAT_FLOAT) {
-    FilterFloatLerp(rgba, reinterpret_cast<const float *>(m_image), i00, i01,
-                    i10, i11, dx, dy, stride, m_pow);
-  } else { // unknown
-  }
 }
 
 void colorize_material_id(unsigned char col[3], unsigned int mid) {
@@ -433,6 +221,8 @@ enum RTNVGcallType {
   RTNVG_CONVEXFILL,
   RTNVG_STROKE,
   RTNVG_TRIANGLES,
+  RTNVG_SHAPE, // Analytic rect, rounded rect or ellipse, no geometry.
+  RTNVG_LINES, // Thin stroke drawn from the path center lines.
 };
 
 struct RTNVGcall {
@@ -443,17 +233,51 @@ struct RTNVGcall {
   int triangleOffset;
   int triangleCount;
   int uniformOffset;
+  int edgeOffset;
+  int edgeCount;
+  int bounds[4]; // l,t,r,b pixel rect touched by the call (NVG_SCANLINE)
+  int ramp;      // Gradient ramp of the paint, -1 if none.
+  int clip[4];   // l,t,r,b pixel rect of an axis aligned scissor
+  int fillRule;  // NVGfillRule of RTNVG_FILL
+  NVGcompositeOperationState compositeOperation;
+  NVGshape shape;    // RTNVG_SHAPE only
+  float strokeWidth; // RTNVG_SHAPE and RTNVG_LINES, 0 fills a shape
+  int lineCap;       // RTNVG_LINES only
 };
 typedef struct RTNVGcall RTNVGcall;
 
+// Clip rect of calls without a hard-edged scissor.
+#define RTNVG_MAX_COORD (1 << 24)
+
 struct RTNVGpath {
   int fillOffset;
   int fillCount;
   int strokeOffset;
   int strokeCount;
+  int closed; // RTNVG_LINES only
 };
 typedef struct RTNVGpath RTNVGpath;
 
+#define RTNVG_RAMP_SIZE 256
+#define RTNVG_MAX_RAMPS 64
+
+// Box gradient colors sampled at RTNVG_RAMP_SIZE steps, premultiplied RGBA8.
+struct RTNVGramp {
+  NVGcolor innerCol;
+  NVGcolor outerCol;
+  unsigned int frame; // Last flush using the ramp.
+  unsigned char rgba[4 * RTNVG_RAMP_SIZE];
+};
+typedef struct RTNVGramp RTNVGramp;
+
+// Block of the frame arena, the allocations follow the header.
+struct RTNVGarenaBlock {
+  struct RTNVGarenaBlock *next;
+  size_t size;
+  size_t used;
+};
+typedef struct RTNVGarenaBlock RTNVGarenaBlock;
+
 struct RTNVGfragUniforms {
 #if NANOVG_GL_USE_UNIFORMBUFFER
   float scissorMat[12]; // matrices are actually 3 vec4s
@@ -495,6 +319,104 @@ struct RTNVGfragUniforms {
 };
 typedef struct RTNVGfragUniforms RTNVGfragUniforms;
 
+// Directed edge for the scanline rasterizer. Always stored top to bottom,
+// dir keeps the winding of the original edge.
+struct RTNVGedge {
+  float x0, y0;
+  float x1, y1;
+  float dxdy;
+  float dir;
+};
+typedef struct RTNVGedge RTNVGedge;
+
+// Per thread buffers of the scanline rasterizer.
+struct RTNVGscratch {
+  int *active;
+  int cactive;
+  float *cover; // Row accumulation buffer, width + 2 entries.
+  int ccover;
+  float *accum; // RGBA accumulation for triangle calls.
+  int caccum;
+};
+typedef struct RTNVGscratch RTNVGscratch;
+
+// Fixed set of worker threads for NVG_TILED. run() hands task indices
+// [0, count) out to the workers and the calling thread, and returns once
+// all of them are done. The caller always is worker 0.
+class RTNVGworkerPool {
+public:
+  explicit RTNVGworkerPool(int nthreads)
+      : m_count(0), m_busy(0), m_generation(0), m_quit(false) {
+    m_next = 0;
+    for (int i = 0; i < nthreads; i++)
+      m_threads.push_back(std::thread(&RTNVGworkerPool::loop, this, i + 1));
+  }
+
+  ~RTNVGworkerPool() {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_quit = true;
+    }
+    m_wake.notify_all();
+    for (size_t i = 0; i < m_threads.size(); i++)
+      m_threads[i].join();
+  }
+
+  int size() const { return (int)m_threads.size() + 1; }
+
+  void run(int count, const std::function<void(int, int)> &job) {
+    {
+      std::lock_guard<std::mutex> lock(m_mutex);
+      m_job = job;
+      m_count = count;
+      m_next = 0;
+      m_busy = (int)m_threads.size();
+      m_generation++;
+    }
+    m_wake.notify_all();
+    work(0);
+    std::unique_lock<std::mutex> lock(m_mutex);
+    m_done.wait(lock, [this] { return m_busy == 0; });
+    m_job = nullptr;
+  }
+
+private:
+  void work(int worker) {
+    int i;
+    while ((i = m_next++) < m_count)
+      m_job(i, worker);
+  }
+
+  void loop(int worker) {
+    unsigned int seen = 0;
+    for (;;) {
+      {
+        std::unique_lock<std::mutex> lock(m_mutex);
+        m_wake.wait(lock,
+                    [&] { return m_quit || m_generation != seen; });
+        if (m_quit)
+          return;
+        seen = m_generation;
+      }
+      work(worker);
+      std::lock_guard<std::mutex> lock(m_mutex);
+      if (--m_busy == 0)
+        m_done.notify_one();
+    }
+  }
+
+  std::vector<std::thread> m_threads;
+  std::mutex m_mutex;
+  std::condition_variable m_wake;
+  std::condition_variable m_done;
+  std::function<void(int, int)> m_job;
+  std::atomic<int> m_next;
+  int m_count;
+  int m_busy;
+  unsigned int m_generation;
+  bool m_quit;
+};
+
 struct RTNVGcontext {
   RTNVGshader shader;
   RTNVGtexture *textures;
@@ -523,6 +445,16 @@ struct RTNVGcontext {
   int cuniforms;
   int nuniforms;
 
+  // Ray cast geometry, valid until the next flush.
+  RTNVGarenaBlock *arena;
+  nanort::BVHAccel *accel;
+
+  // Gradient ramps, kept across frames.
+  RTNVGramp *ramps;
+  int cramps;
+  int nramps;
+  unsigned int frame;
+
 // cached state
 #if NANOVG_GL_USE_STATE_FILTER
   unsigned int boundTexture;
@@ -532,9 +464,28 @@ struct RTNVGcontext {
   unsigned int stencilFuncMask;
 #endif
 
-  unsigned char *pixels; // RGBA
+  // Scanline rasterizer buffers (NVG_SCANLINE)
+  RTNVGedge *edges;
+  int cedges;
+  int nedges;
+  RTNVGscratch *scratch; // One per worker.
+  int nscratch;
+
+  // Tile bins (NVG_TILED), call indices of tile i are
+  // tileCalls[tileStart[i] .. tileStart[i + 1]).
+  RTNVGworkerPool *workers;
+  int nthreads;
+  int *tileStart;
+  int ctileStart;
+  int *tileCalls;
+  int ctileCalls;
+
+  unsigned char *pixels; // RGBA, rows are stride bytes apart
   int width;
   int height;
+  int stride;
+  unsigned char *ownPixels; // Buffer used unless one is bound.
+  int cownPixels;
 };
 typedef struct RTNVGcontext RTNVGcontext;
 
@@ -637,8 +588,7 @@ static int rtnvg__deleteTexture(RTNVGcontext *rt, int id) {
   int i;
   for (i = 0; i < rt->ntextures; i++) {
     if (rt->textures[i].id == id) {
-      if (rt->textures[i].tex != 0 &&
-          (rt->textures[i].flags & NVG_IMAGE_NODELETE) == 0) {
+      if ((rt->textures[i].flags & NVG_IMAGE_NODELETE) == 0) {
         free(rt->textures[i].data);
         // glDeleteTextures(1, &rt->textures[i].tex);
       }
@@ -1076,9 +1026,39 @@ static NVGcolor rtnvg__premulColor(NVGcolor c) {
   return c;
 }
 
+// Pixel rect (l,t,r,b) of an axis aligned scissor whose edges fall on pixel
+// boundaries. With a fringe of at most one pixel its mask is exactly 1 or 0
+// at every pixel center, so calls are clipped to the rect instead of being
+// masked. Rotated or fractional scissors keep the soft mask.
+static int rtnvg__scissorRect(const NVGscissor *scissor, float fringe,
+                              int *rect) {
+  const float *xf = scissor->xform;
+  float ex, ey, r[4];
+  int i;
+  if (xf[1] != 0.0f || xf[2] != 0.0f || fringe > 1.0f)
+    return 0;
+  ex = scissor->extent[0] * fabsf(xf[0]);
+  ey = scissor->extent[1] * fabsf(xf[3]);
+  r[0] = xf[4] - ex;
+  r[1] = xf[5] - ey;
+  r[2] = xf[4] + ex;
+  r[3] = xf[5] + ey;
+  for (i = 0; i < 4; i++) {
+    float f = floorf(r[i] + 0.5f);
+    if (fabsf(r[i] - f) > 1.0f / 1024.0f)
+      return 0;
+    r[i] = std::min(std::max(f, (float)-RTNVG_MAX_COORD),
+                    (float)RTNVG_MAX_COORD);
+  }
+  for (i = 0; i < 4; i++)
+    rect[i] = (int)r[i];
+  return 1;
+}
+
 static int rtnvg__convertPaint(RTNVGcontext *rt, RTNVGfragUniforms *frag,
                                NVGpaint *paint, NVGscissor *scissor,
-                               float width, float fringe, float strokeThr) {
+                               float width, float fringe, float strokeThr,
+                               int *clip) {
   // printf("convertPaint\n");
   RTNVGtexture *tex = NULL;
   float invxform[6];
@@ -1088,7 +1068,10 @@ static int rtnvg__convertPaint(RTNVGcontext *rt, RTNVGfragUniforms *frag,
   frag->innerCol = rtnvg__premulColor(paint->innerColor);
   frag->outerCol = rtnvg__premulColor(paint->outerColor);
 
-  if (scissor->extent[0] < -0.5f || scissor->extent[1] < -0.5f) {
+  clip[0] = clip[1] = -RTNVG_MAX_COORD;
+  clip[2] = clip[3] = RTNVG_MAX_COORD;
+  if (scissor->extent[0] < -0.5f || scissor->extent[1] < -0.5f ||
+      rtnvg__scissorRect(scissor, fringe, clip)) {
     memset(frag->scissorMat, 0, sizeof(frag->scissorMat));
     frag->scissorExt[0] = 1.0f;
     frag->scissorExt[1] = 1.0f;
@@ -1248,322 +1231,2310 @@ static float rtnvg__scissorMask(float scissorMat[12], float scissorExt[2],
   return fclamp(sc[0], 0.0f, 1.0f) * fclamp(sc[1], 0.0f, 1.0f);
 }
 
-static void rtnvg__shade(float color[4], RTNVGcontext *rt,
-                         RTNVGfragUniforms *frag, float x, float y, float tu,
-                         float tv, int imageId) {
-  float scissor = rtnvg__scissorMask(frag->scissorMat, frag->scissorExt,
-                                     frag->scissorScale, x, y);
-  float pt[2];
-  pt[0] = frag->paintMat[0] * x + frag->paintMat[4] * y + frag->paintMat[8];
-  pt[1] = frag->paintMat[1] * x + frag->paintMat[5] * y + frag->paintMat[9];
-  // printf("scissor = %f, %f, %f, %f,   %f, %f, %f, %f,   %f, %f, %f, %f\n",
-  //  frag->scissorMat[0],
-  //  frag->scissorMat[1],
-  //  frag->scissorMat[2],
-  //  frag->scissorMat[3],
-  //  frag->scissorMat[4],
-  //  frag->scissorMat[5],
-  //  frag->scissorMat[6],
-  //  frag->scissorMat[7],
-  //  frag->scissorMat[8],
-  //  frag->scissorMat[9],
-  //  frag->scissorMat[10],
-  //  frag->scissorMat[11]);
-  // printf("type = %f\n", frag->type);
-  // printf("innerCol = %f, %f, %f, %f\n",
-  //  frag->innerCol.r,
-  //  frag->innerCol.g,
-  //  frag->innerCol.b,
-  //  frag->innerCol.a);
-  // printf("outerCol = %f, %f, %f, %f\n",
-  //  frag->outerCol.r,
-  //  frag->outerCol.g,
-  //  frag->outerCol.b,
-  //  frag->outerCol.a);
-  // printf("paintMat = %f, %f, %f, %f,   %f, %f, %f, %f   %f, %f, %f, %f\n",
-  //  frag->paintMat[0],
-  //  frag->paintMat[1],
-  //  frag->paintMat[2],
-  //  frag->paintMat[3],
-  //  frag->paintMat[4],
-  //  frag->paintMat[5],
-  //  frag->paintMat[6],
-  //  frag->paintMat[7],
-  //  frag->paintMat[8],
-  //  frag->paintMat[9],
-  //  frag->paintMat[10],
-  //  frag->paintMat[11]);
-
-  // printf("pt = %f, %f\n", pt[0], pt[1]);
-  color[0] = color[1] = color[2] = 0;
-  color[3] = 1.0f;
-
-  int type = (int)frag->type;
-  if (type == 0) { // grad fill
-                   // Calculate gradient color using box gradient
-
-    // printf("feather = %f, rad = %f\n", frag->feather, frag->radius);
-    // printf("extent = %f, %f\n", frag->extent[0], frag->extent[1]);
-    float d = fclamp((rtnvg__sdroundrect(pt, frag->extent, frag->radius) +
-                      frag->feather * 0.5f) /
-                         (float)frag->feather,
-                     0.0f, 1.0f);
-    // printf("d = %f\n", (rtnvg__sdroundrect(pt, frag->extent, frag->radius) +
-    // frag->feather*0.5f) / (float)frag->feather);
-    color[0] = frag->innerCol.r * (1.0f - d) + frag->outerCol.r * d;
-    color[1] = frag->innerCol.g * (1.0f - d) + frag->outerCol.g * d;
-    color[2] = frag->innerCol.b * (1.0f - d) + frag->outerCol.b * d;
-    color[3] = frag->innerCol.a * (1.0f - d) + frag->outerCol.a * d;
-
-    float strokeAlpha = 1.0f; // @fixme.
-    color[0] *= strokeAlpha * scissor;
-    color[1] *= strokeAlpha * scissor;
-    color[2] *= strokeAlpha * scissor;
-    color[3] *= strokeAlpha * scissor;
-  } else if (type == 1) { // Image
-                          // Calculate color from texture
-
-    int texType = (int)frag->texType;
-    RTNVGtexture *tex = rtnvg__findTexture(rt, imageId);
-    TextureSampler sampler;
-    int components = 1;
-    if (tex->type == NVG_TEXTURE_RGBA) {
-      components = 4;
-    }
-    sampler.Set(tex->data, tex->width, tex->height, components,
-                TextureSampler::FORMAT_BYTE);
-    float tcol[4];
-    sampler.fetch(tcol, pt[0] / frag->extent[0], pt[1] / frag->extent[1]);
-
-    if (texType == 2) { // Use R channel.
-      color[0] = frag->innerCol.r * tcol[0];
-      color[1] = frag->innerCol.g * tcol[0];
-      color[2] = frag->innerCol.b * tcol[0];
-      color[3] = frag->innerCol.a * tcol[0];
-    } else {
-      color[0] = frag->innerCol.r * tcol[0] * tcol[3];
-      color[1] = frag->innerCol.g * tcol[1] * tcol[3];
-      color[2] = frag->innerCol.b * tcol[2] * tcol[3];
-      color[3] = frag->innerCol.a * tcol[3];
-    }
-
-    float strokeAlpha = 1.0f; // @fixme.
-    color[0] *= strokeAlpha * scissor;
-    color[1] *= strokeAlpha * scissor;
-    color[2] *= strokeAlpha * scissor;
-    color[3] *= strokeAlpha * scissor;
-
-  } else if (type == 3) { // textured tri
-    int texType = (int)frag->texType;
-    //"		if (texType == 1) color = vec4(color.xyz*color.w,color.w);"
-    //"		if (texType == 2) color = vec4(color.x);"
-    // if (texType == 1) {
-    //}
-    // if (texType == 2) {
-    // printf("tu, tv = %f, %f\n", tu, tv);
-
-    RTNVGtexture *tex = rtnvg__findTexture(rt, imageId);
-    TextureSampler sampler;
-    int components = 1;
-    if (tex->type == NVG_TEXTURE_RGBA) {
-      components = 4;
-    }
-    sampler.Set(tex->data, tex->width, tex->height, components,
-                TextureSampler::FORMAT_BYTE);
-    // printf("texId = %d, data = %p, w = %d\n", rt->textureId, tex->data,
-    // tex->width);
-    float tcol[4];
-    sampler.fetch(tcol, tu, tv);
-
-    if (texType == 2) { // Use R channel.
-      color[0] = frag->innerCol.r * tcol[0];
-      color[1] = frag->innerCol.g * tcol[0];
-      color[2] = frag->innerCol.b * tcol[0];
-      color[3] = frag->innerCol.a * tcol[0];
-    } else {
-      color[0] = frag->innerCol.r * tcol[0] * tcol[3];
-      color[1] = frag->innerCol.g * tcol[1] * tcol[3];
-      color[2] = frag->innerCol.b * tcol[2] * tcol[3];
-      color[3] = frag->innerCol.a * tcol[3];
-    }
-
-    float strokeAlpha = 1.0f; // @fixme.
-    color[0] *= strokeAlpha * scissor;
-    color[1] *= strokeAlpha * scissor;
-    color[2] *= strokeAlpha * scissor;
-    color[3] *= strokeAlpha * scissor;
-  }
+static int rtnvg__rampIndex(float t) {
+  int i = (int)(t * (float)(RTNVG_RAMP_SIZE - 1) + 0.5f);
+  return i < 0 ? 0 : (i > RTNVG_RAMP_SIZE - 1 ? RTNVG_RAMP_SIZE - 1 : i);
 }
 
-static void rtnvg__fill(RTNVGcontext *rt, RTNVGcall *call) {
-  // printf("__fill\n");
-  RTNVGpath *paths = &rt->paths[call->pathOffset];
-  (void)paths;
-  int i, npaths = call->pathCount;
-  (void)i;
-  (void)npaths;
+static int rtnvg__sameColor(const NVGcolor *a, const NVGcolor *b) {
+  return memcmp(a, b, sizeof(NVGcolor)) == 0;
+}
 
-  // Draw shapes
-  // glEnable(GL_STENCIL_TEST);
-  rtnvg__stencilMask(rt, 0xff);
-  // rtnvg__stencilFunc(rt, GL_ALWAYS, 0, 0xff);
-  // glColorMask(GL_FALSE, GL_FALSE, GL_FALSE, GL_FALSE);
+// Returns the index of the ramp for the colors, filling the least recently
+// used slot not needed by this frame on a miss. -1 if out of memory.
+static int rtnvg__findRamp(RTNVGcontext *rt, const NVGcolor *inner,
+                           const NVGcolor *outer) {
+  const float *c0 = inner->rgba, *c1 = outer->rgba;
+  RTNVGramp *ramp;
+  int i, j, slot = -1;
+
+  for (i = 0; i < rt->nramps; i++) {
+    ramp = &rt->ramps[i];
+    if (rtnvg__sameColor(&ramp->innerCol, inner) &&
+        rtnvg__sameColor(&ramp->outerCol, outer)) {
+      ramp->frame = rt->frame;
+      return i;
+    }
+    if (ramp->frame != rt->frame &&
+        (slot == -1 || ramp->frame < rt->ramps[slot].frame))
+      slot = i;
+  }
 
-  // set bindpoint for solid loc
-  rtnvg__setUniforms(rt, call->uniformOffset, 0);
-  rtnvg__checkError(rt, "fill simple");
+  if (slot == -1 || rt->nramps < RTNVG_MAX_RAMPS) {
+    if (rt->nramps + 1 > rt->cramps) {
+      int cramps =
+          rtnvg__maxi(rt->nramps + 1, 16) + rt->cramps / 2; // 1.5x Overallocate
+      RTNVGramp *ramps =
+          (RTNVGramp *)realloc(rt->ramps, sizeof(RTNVGramp) * cramps);
+      if (ramps == NULL)
+        return -1;
+      rt->ramps = ramps;
+      rt->cramps = cramps;
+    }
+    slot = rt->nramps++;
+  }
 
-  // glStencilOpSeparate(GL_FRONT, GL_KEEP, GL_KEEP, GL_INCR_WRAP);
-  // glStencilOpSeparate(GL_BACK, GL_KEEP, GL_KEEP, GL_DECR_WRAP);
-  // glDisable(GL_CULL_FACE);
-  // for (i = 0; i < npaths; i++)
-  //	glDrawArrays(GL_TRIANGLE_FAN, paths[i].fillOffset, paths[i].fillCount);
-  // glEnable(GL_CULL_FACE);
+  ramp = &rt->ramps[slot];
+  ramp->innerCol = *inner;
+  ramp->outerCol = *outer;
+  ramp->frame = rt->frame;
+  for (i = 0; i < RTNVG_RAMP_SIZE; i++) {
+    float t = (float)i / (float)(RTNVG_RAMP_SIZE - 1);
+    for (j = 0; j < 4; j++) {
+      float c = (c0[j] * (1.0f - t) + c1[j] * t) * 255.0f + 0.5f;
+      ramp->rgba[4 * i + j] = (unsigned char)fclamp(c, 0.0f, 255.0f);
+    }
+  }
+  return slot;
+}
 
-  // Draw anti-aliased pixels
-  // glColorMask(GL_TRUE, GL_TRUE, GL_TRUE, GL_TRUE);
+// Looks up the gradient ramps of all calls before they are drawn, the cache
+// is not touched while tiles are rendered in parallel.
+static void rtnvg__resolveRamps(RTNVGcontext *rt) {
+  int i;
+  rt->frame++;
+  for (i = 0; i < rt->ncalls; i++) {
+    RTNVGcall *call = &rt->calls[i];
+    const RTNVGfragUniforms *frag;
+    call->ramp = -1;
+    if (call->type == RTNVG_TRIANGLES)
+      continue;
+    frag = nvg__fragUniformPtr(rt, call->type == RTNVG_FILL
+                                       ? call->uniformOffset + rt->fragSize
+                                       : call->uniformOffset);
+    if ((int)frag->type == NSVG_SHADER_FILLGRAD &&
+        !rtnvg__sameColor(&frag->innerCol, &frag->outerCol))
+      call->ramp = rtnvg__findRamp(rt, &frag->innerCol, &frag->outerCol);
+  }
+}
 
-  // for (i = 0; i < npaths; i++) {
-  //  printf("fill: offset = %d, count = %d\n", paths[i].fillOffset,
-  //  paths[i].fillCount);
-  //}
-  rtnvg__setUniforms(rt, call->uniformOffset + rt->fragSize, call->image);
-  rtnvg__checkError(rt, "fill fill");
+enum RTNVGscissorMode {
+  RTNVG_SCISSOR_NONE,
+  RTNVG_SCISSOR_AXIS, // scissor rect not rotated, mask is separable in x, y
+  RTNVG_SCISSOR_ROTATED
+};
 
-  if (rt->flags & NVG_ANTIALIAS) {
-    // rtnvg__stencilFunc(rt, GL_EQUAL, 0x00, 0xff);
-    // glStencilOp(GL_KEEP, GL_KEEP, GL_KEEP);
-    // Draw fringes
-    // for (i = 0; i < npaths; i++) {
-    //	glDrawArrays(GL_TRIANGLE_STRIP, paths[i].strokeOffset,
-    //paths[i].strokeCount);
-    // printf("storoke: offset = %d, count = %d\n", paths[i].strokeOffset,
-    // paths[i].strokeCount);
-    //}
+// Blend factors of a composite operation resolved for the span kernels.
+// Every factor is k[0] + k[1] * Sa + k[2] * Da + k[3] * Sc + k[4] * Dc +
+// k[5] * min(Sa, 1 - Da) for source (S) and destination (D) channel c, which
+// covers all NVGblendFactor values.
+struct RTNVGcomposite {
+  float src[2][6]; // [0] color channels, [1] alpha channel
+  float dst[2][6];
+};
+typedef struct RTNVGcomposite RTNVGcomposite;
+
+// Paint of a call resolved once before its pixels are shaded.
+struct RTNVGshadeState {
+  const RTNVGfragUniforms *frag;
+  const RTNVGtexture *tex; // NULL unless an image paint
+  int type;                // NSVG_SHADER_*
+  int components;          // 4 for RGBA textures, 1 for alpha textures
+  int texR;                // spread the R channel (texType 2)
+  int solid;               // gradient with inner == outer color
+  int scissor;             // RTNVGscissorMode
+  const unsigned char *ramp; // Gradient ramp, NULL to interpolate.
+  float invExtent[2];
+  NVGcolor innerCol, outerCol; // premultiplied
+  int composite;               // 0 for source-over
+  RTNVGcomposite comp;
+};
+typedef struct RTNVGshadeState RTNVGshadeState;
+
+// Coefficients of one NVGblendFactor, see RTNVGcomposite. Returns 0 if the
+// factor is not valid.
+static int rtnvg__blendFactor(int factor, int alpha, float *k) {
+  memset(k, 0, sizeof(float) * 6);
+  switch (factor) {
+  case NVG_ZERO:
+    break;
+  case NVG_ONE:
+    k[0] = 1.0f;
+    break;
+  case NVG_SRC_COLOR:
+    k[alpha ? 1 : 3] = 1.0f;
+    break;
+  case NVG_ONE_MINUS_SRC_COLOR:
+    k[0] = 1.0f;
+    k[alpha ? 1 : 3] = -1.0f;
+    break;
+  case NVG_DST_COLOR:
+    k[alpha ? 2 : 4] = 1.0f;
+    break;
+  case NVG_ONE_MINUS_DST_COLOR:
+    k[0] = 1.0f;
+    k[alpha ? 2 : 4] = -1.0f;
+    break;
+  case NVG_SRC_ALPHA:
+    k[1] = 1.0f;
+    break;
+  case NVG_ONE_MINUS_SRC_ALPHA:
+    k[0] = 1.0f;
+    k[1] = -1.0f;
+    break;
+  case NVG_DST_ALPHA:
+    k[2] = 1.0f;
+    break;
+  case NVG_ONE_MINUS_DST_ALPHA:
+    k[0] = 1.0f;
+    k[2] = -1.0f;
+    break;
+  case NVG_SRC_ALPHA_SATURATE:
+    k[alpha ? 0 : 5] = 1.0f;
+    break;
+  default:
+    return 0;
   }
+  return 1;
+}
 
-  // Draw fill
-  // rtnvg__stencilFunc(rt, GL_NOTEQUAL, 0x0, 0xff);
-  // glStencilOp(GL_ZERO, GL_ZERO, GL_ZERO);
-  // glDrawArrays(GL_TRIANGLES, call->triangleOffset, call->triangleCount);
-  // printf("GL_TRIANGLES: drawFill: triangleOffset: %d, triangleCount: %d\n",
-  // call->triangleOffset, call->triangleCount);
+// Resolves the composite operation of a call. Returns 0 for source-over,
+// which has its own blend kernel, and for invalid factors, which fall back
+// to it like glBlendFuncSeparate would reject them.
+static int rtnvg__compositeState(const NVGcompositeOperationState *op,
+                                 RTNVGcomposite *comp) {
+  if (op->srcRGB == NVG_ONE && op->srcAlpha == NVG_ONE &&
+      op->dstRGB == NVG_ONE_MINUS_SRC_ALPHA &&
+      op->dstAlpha == NVG_ONE_MINUS_SRC_ALPHA)
+    return 0;
+  return rtnvg__blendFactor(op->srcRGB, 0, comp->src[0]) &&
+         rtnvg__blendFactor(op->srcAlpha, 1, comp->src[1]) &&
+         rtnvg__blendFactor(op->dstRGB, 0, comp->dst[0]) &&
+         rtnvg__blendFactor(op->dstAlpha, 1, comp->dst[1]);
+}
 
-  // render
-  {
-    std::vector<float> vertices;
-    std::vector<float> texcoords;
-    std::vector<unsigned int> faces;
+static void rtnvg__shadeState(RTNVGcontext *rt, const RTNVGcall *call,
+                              const RTNVGfragUniforms *frag,
+                              RTNVGshadeState *st) {
+  const float *m = frag->scissorMat;
+  memset(st, 0, sizeof(*st));
+  st->frag = frag;
+  st->type = (int)frag->type;
+  st->innerCol = frag->innerCol;
+  st->outerCol = frag->outerCol;
+  st->solid = rtnvg__sameColor(&frag->innerCol, &frag->outerCol);
+  if (call->ramp >= 0)
+    st->ramp = rt->ramps[call->ramp].rgba;
+  st->texR = (int)frag->texType == 2;
+  st->invExtent[0] = frag->extent[0] != 0.0f ? 1.0f / frag->extent[0] : 0.0f;
+  st->invExtent[1] = frag->extent[1] != 0.0f ? 1.0f / frag->extent[1] : 0.0f;
+  if (st->type == NSVG_SHADER_FILLIMG || st->type == NSVG_SHADER_IMG) {
+    st->tex = rtnvg__findTexture(rt, call->image);
+    if (st->tex != NULL && st->tex->data != NULL)
+      st->components = st->tex->type == NVG_TEXTURE_RGBA ? 4 : 1;
+    else
+      st->tex = NULL;
+  }
+  // convertPaint sets up a zero matrix with unit extent when there is no
+  // scissor, which evaluates to a mask of 1 everywhere.
+  if (m[0] == 0.0f && m[1] == 0.0f && m[4] == 0.0f && m[5] == 0.0f &&
+      m[8] == 0.0f && m[9] == 0.0f && frag->scissorExt[0] == 1.0f &&
+      frag->scissorExt[1] == 1.0f && frag->scissorScale[0] == 1.0f &&
+      frag->scissorScale[1] == 1.0f)
+    st->scissor = RTNVG_SCISSOR_NONE;
+  else if (m[1] == 0.0f && m[4] == 0.0f)
+    st->scissor = RTNVG_SCISSOR_AXIS;
+  else
+    st->scissor = RTNVG_SCISSOR_ROTATED;
+  st->composite = rtnvg__compositeState(&call->compositeOperation, &st->comp);
+}
 
-    // Convert geometry to nanort friendly format.
+// Blends premultiplied col into dst as src * Fs + dst * Fd.
+static void rtnvg__compositePixel(unsigned char *dst, const float col[4],
+                                  const RTNVGcomposite *k) {
+  const float(*ks)[6] = k->src, (*kd)[6] = k->dst;
+  float d[4], sa, sat, bs[2], bd[2];
+  int c;
+
+  for (c = 0; c < 4; c++)
+    d[c] = uctof(dst[c]);
+  sa = fclamp(col[3], 0.0f, 1.0f);
+  sat = std::min(sa, 1.0f - d[3]);
+  for (c = 0; c < 2; c++) {
+    bs[c] = ks[c][0] + ks[c][1] * sa + ks[c][2] * d[3] + ks[c][5] * sat;
+    bd[c] = kd[c][0] + kd[c][1] * sa + kd[c][2] * d[3] + kd[c][5] * sat;
+  }
+  for (c = 0; c < 4; c++) {
+    int j = c == 3;
+    float fs = bs[j] + ks[j][3] * col[c] + ks[j][4] * d[c];
+    float fd = bd[j] + kd[j][3] * col[c] + kd[j][4] * d[c];
+    dst[c] = ftouc(col[c] * fs + d[c] * fd);
+  }
+}
 
-    // TRIANGLE_FAN -> TRIANGLES.
-    for (int k = 0; k < npaths; k++) {
-      int npolys = paths[k].fillCount - 2;
-      int voffset = (int)vertices.size() / 3;
-      for (int n = 0; n < npolys; n++) {
-        faces.push_back(voffset + 0);
-        faces.push_back(voffset + n + 1);
-        faces.push_back(voffset + n + 2);
-      }
+// Blends a shaded pixel with the composite operation of the paint.
+static void rtnvg__blendPixel(unsigned char *dst, const float col[4],
+                              const RTNVGshadeState *st) {
+  if (st->composite)
+    rtnvg__compositePixel(dst, col, &st->comp);
+  else
+    rtnvg__alphaBlend(dst, col);
+}
 
-      for (int n = 0; n < paths[k].fillCount; n++) {
-        vertices.push_back(rt->verts[paths[k].fillOffset + n].x);
-        vertices.push_back(rt->verts[paths[k].fillOffset + n].y);
-        vertices.push_back(0.0f);
-        texcoords.push_back(rt->verts[paths[k].fillOffset + n].u);
-        texcoords.push_back(rt->verts[paths[k].fillOffset + n].v);
-      }
-    }
+// Bilinear texel fetch with repeat addressing on byte images. One channel
+// images are sampled nearest and replicated.
+static void rtnvg__fetchTexel(const RTNVGshadeState *st, float u, float v,
+                              float *rgba) {
+  const RTNVGtexture *tex = st->tex;
+  const float inv = 1.0f / 255.0f;
+  const unsigned char *img = tex->data;
+  int w = tex->width, h = tex->height;
+  float uu = fclamp(u - floorf(u), 0.0f, 1.0f);
+  float vv = fclamp(v - floorf(v), 0.0f, 1.0f);
+  float px = w * uu, py = h * vv;
+  int x0 = std::min((int)px, w - 1), y0 = std::min((int)py, h - 1);
+  int i;
 
-    // printf("vertices.size = %d\n", (int)vertices.size() / 3);
-    // printf("faces.size = %d\n", (int)faces.size() / 3);
+  if (st->components == 4) {
+    int x1 = x0 + 1 >= w ? w - 1 : x0 + 1;
+    int y1 = y0 + 1 >= h ? h - 1 : y0 + 1;
+    float dx = px - (float)x0, dy = py - (float)y0;
+    const unsigned char *t00 = &img[4 * (y0 * w + x0)];
+    const unsigned char *t10 = &img[4 * (y0 * w + x1)];
+    const unsigned char *t01 = &img[4 * (y1 * w + x0)];
+    const unsigned char *t11 = &img[4 * (y1 * w + x1)];
+    for (i = 0; i < 4; i++) {
+      float a = lerp((float)t00[i] * inv, (float)t10[i] * inv, dx);
+      float b = lerp((float)t01[i] * inv, (float)t11[i] * inv, dx);
+      rgba[i] = lerp(a, b, dy);
+    }
+  } else {
+    rgba[0] = rgba[1] = rgba[2] = rgba[3] = (float)img[y0 * w + x0] * inv;
+  }
+}
 
-    if (faces.size() > 0) {
+// Tinted texel of an image paint or a textured triangle.
+static void rtnvg__texelColor(const RTNVGshadeState *st, float u, float v,
+                              float *color) {
+  float t[4];
+  rtnvg__fetchTexel(st, u, v, t);
+  if (st->texR) {
+    t[1] = t[2] = t[3] = t[0];
+  } else {
+    t[0] *= t[3];
+    t[1] *= t[3];
+    t[2] *= t[3];
+  }
+  color[0] = st->innerCol.r * t[0];
+  color[1] = st->innerCol.g * t[1];
+  color[2] = st->innerCol.b * t[2];
+  color[3] = st->innerCol.a * t[3];
+}
 
-      unsigned char *rgba = rt->pixels;
+static void rtnvg__shade(float color[4], const RTNVGshadeState *st, float x,
+                         float y, float tu, float tv) {
+  const RTNVGfragUniforms *frag = st->frag;
+  float scissor = 1.0f;
+
+  if (st->scissor == RTNVG_SCISSOR_AXIS) {
+    const float *m = frag->scissorMat;
+    float sx = fabsf(m[0] * x + m[8]) - frag->scissorExt[0];
+    float sy = fabsf(m[5] * y + m[9]) - frag->scissorExt[1];
+    scissor = fclamp(0.5f - sx * frag->scissorScale[0], 0.0f, 1.0f) *
+              fclamp(0.5f - sy * frag->scissorScale[1], 0.0f, 1.0f);
+  } else if (st->scissor == RTNVG_SCISSOR_ROTATED) {
+    scissor = rtnvg__scissorMask((float *)frag->scissorMat,
+                                 (float *)frag->scissorExt,
+                                 (float *)frag->scissorScale, x, y);
+  }
 
-      nanort::BVHBuildOptions options; // Use default option
+  if (st->type == NSVG_SHADER_FILLGRAD) {
+    if (st->solid) {
+      color[0] = st->innerCol.r;
+      color[1] = st->innerCol.g;
+      color[2] = st->innerCol.b;
+      color[3] = st->innerCol.a;
+    } else {
+      // Calculate gradient color using box gradient
+      float pt[2], d;
+      pt[0] = frag->paintMat[0] * x + frag->paintMat[4] * y + frag->paintMat[8];
+      pt[1] = frag->paintMat[1] * x + frag->paintMat[5] * y + frag->paintMat[9];
+      d = fclamp((rtnvg__sdroundrect(pt, (float *)frag->extent, frag->radius) +
+                  frag->feather * 0.5f) /
+                     frag->feather,
+                 0.0f, 1.0f);
+      if (st->ramp != NULL) {
+        const unsigned char *c = &st->ramp[4 * rtnvg__rampIndex(d)];
+        color[0] = uctof(c[0]) * scissor;
+        color[1] = uctof(c[1]) * scissor;
+        color[2] = uctof(c[2]) * scissor;
+        color[3] = uctof(c[3]) * scissor;
+        return;
+      }
+      color[0] = st->innerCol.r * (1.0f - d) + st->outerCol.r * d;
+      color[1] = st->innerCol.g * (1.0f - d) + st->outerCol.g * d;
+      color[2] = st->innerCol.b * (1.0f - d) + st->outerCol.b * d;
+      color[3] = st->innerCol.a * (1.0f - d) + st->outerCol.a * d;
+    }
+  } else if (st->tex != NULL) {
+    if (st->type == NSVG_SHADER_FILLIMG) {
+      // Image paint, texcoords from the paint transform.
+      tu = (frag->paintMat[0] * x + frag->paintMat[4] * y + frag->paintMat[8]) *
+           st->invExtent[0];
+      tv = (frag->paintMat[1] * x + frag->paintMat[5] * y + frag->paintMat[9]) *
+           st->invExtent[1];
+    }
+    rtnvg__texelColor(st, tu, tv, color);
+  } else {
+    // No paint to shade, or the texture is gone.
+    color[0] = color[1] = color[2] = 0.0f;
+    color[3] = 1.0f;
+    return;
+  }
 
-      // printf("  BVH build option:\n");
-      // printf("    # of leaf primitives: %d\n", options.minLeafPrimitives);
-      // printf("    SAH binsize         : %d\n", options.binSize);
+  color[0] *= scissor;
+  color[1] *= scissor;
+  color[2] *= scissor;
+  color[3] *= scissor;
+}
 
-      nanort::BVHAccel accel;
-      bool ret =
-          accel.Build(&vertices.at(0), &faces.at(0), (unsigned int)faces.size() / 3, options);
-      assert(ret);
-      (void)ret;
+//
+// Span kernels.
+//
+// The scanline rasterizer shades RTNVG_SPAN_CHUNK pixels at a time into
+// planar float buffers (r, g, b, a), multiplies them by scissor mask and
+// coverage, and blends them into the RGBA8 target. These arithmetic stages
+// exist as scalar, SSE2, AVX2 and NEON versions, rtnvg__spanKernels() picks
+// the widest one the CPU supports at runtime. Texel fetches stay scalar.
+//
 
-      // nanort::BVHBuildStatistics stats = accel.GetStatistics();
+#define RTNVG_SPAN_CHUNK 64
+
+struct RTNVGspanKernels {
+  // Box gradient parameter in [0, 1] of the n pixels starting at (x, y).
+  void (*gradient)(const RTNVGfragUniforms *frag, int x, int y, int n,
+                   float *grad);
+  // Multiplies colors by scissor mask and coverage.
+  void (*mask)(const RTNVGfragUniforms *frag, int x, int y, int n,
+               const float *cover, float *rgba);
+  // Colors from a gradient ramp.
+  void (*ramp)(const unsigned char *ramp, const float *grad, int n,
+               float *rgba);
+  // Premultiplied source-over into RGBA8.
+  void (*blend)(unsigned char *dst, const float *rgba, int n);
+  // Any other composite operation into RGBA8.
+  void (*composite)(unsigned char *dst, const float *rgba, int n,
+                    const RTNVGcomposite *k);
+};
+typedef struct RTNVGspanKernels RTNVGspanKernels;
 
-      // printf("  BVH statistics:\n");
-      // printf("    # of leaf   nodes: %d\n", stats.numLeafNodes);
-      // printf("    # of branch nodes: %d\n", stats.numBranchNodes);
-      // printf("  Max tree depth   : %d\n", stats.maxTreeDepth);
-      // float bmin[3], bmax[3];
-      // accel.BoundingBox(bmin, bmax);
-      // printf("  Bmin               : %f, %f, %f\n", bmin[0], bmin[1],
-      // bmin[2]);
-      // printf("  Bmax               : %f, %f, %f\n", bmax[0], bmax[1],
-      // bmax[2]);
+// Loop invariant part of the gradient and scissor evaluation.
+struct RTNVGspanSetup {
+  float pm[4];  // paint:   pt = (pm[0] * x + pm[1], pm[2] * x + pm[3])
+  float sm[4];  // scissor: sc = (sm[0] * x + sm[1], sm[2] * x + sm[3])
+  float ext[2]; // extent - radius
+};
 
-      // const float tFar = 1.0e+30f;
+static void rtnvg__spanSetup(struct RTNVGspanSetup *s,
+                             const RTNVGfragUniforms *frag, int y) {
+  float py = (float)y + 0.5f;
+  const float *m = frag->paintMat;
+  const float *sc = frag->scissorMat;
+  s->pm[0] = m[0];
+  s->pm[1] = m[4] * py + m[8];
+  s->pm[2] = m[1];
+  s->pm[3] = m[5] * py + m[9];
+  s->sm[0] = sc[0];
+  s->sm[1] = sc[4] * py + sc[8];
+  s->sm[2] = sc[1];
+  s->sm[3] = sc[5] * py + sc[9];
+  s->ext[0] = frag->extent[0] - frag->radius;
+  s->ext[1] = frag->extent[1] - frag->radius;
+}
 
-      int bound[4]; // l,t,r,b
-      bound[0] = (int)rt->verts[call->triangleOffset + 0].x - 1;
-      bound[1] = (int)rt->verts[call->triangleOffset + 2].y - 1;
-      bound[2] = (int)rt->verts[call->triangleOffset + 1].x + 1;
-      bound[3] = (int)rt->verts[call->triangleOffset + 0].y + 1;
-      if (bound[0] < 0)           bound[0] = 0;
-      if (bound[1] < 0)           bound[1] = 0;
-      if (bound[2] >= rt->width)  bound[2] = rt->width  - 1;
-      if (bound[3] >= rt->height) bound[3] = rt->height - 1;
-      // printf("drawFill: triangleOffset: %d, triangleCount: %d\n",
-      // call->triangleOffset, call->triangleCount);
-      // Shoot rays.
-      for (int y = bound[1]; y < bound[3]; y++) {
-        // bound check
-        if (y < 0) continue;
-        if (y >= rt->height) continue;
-        for (int x = bound[0]; x < bound[2]; x++) {
-          // bound check
-          if (x < 0) continue;
-          if (x >= rt->width) continue;
-
-          // Use multi-hit ray traversal to detect overdraw.
-          nanort::StackVector<nanort::Intersection, 128> isects;
-          int maxIsects = 128;
-
-          // Simple ortho camera.
-
-          nanort::Ray ray;
-          ray.org[0] = x + 0.5f;
-          ray.org[1] = y + 0.5f;
-          ray.org[2] = 1.0f;
-
-          ray.dir[0] = 0.0f;
-          ray.dir[1] = 0.0f;
-          ray.dir[2] = -1.0f;
-
-          bool hit = accel.MultiHitTraverse(isects, maxIsects, &vertices.at(0),
-                                            &faces.at(0), ray);
-
-          // odd # of intersections --> valid hit.
-          if (hit && (isects->size() % 2 == 1)) {
-            float col[4];
-            RTNVGfragUniforms *frag =
-                nvg__fragUniformPtr(rt, call->uniformOffset + rt->fragSize);
-            rtnvg__shade(col, rt, frag, ray.org[0], ray.org[1], 0.0f, 0.0f,
-                         call->image);
-            rtnvg__alphaBlend(&rgba[4 * (y * rt->width + x)], col);
-          }
-        }
-      }
-    }
+static void rtnvg__gradientSpanScalar(const RTNVGfragUniforms *frag, int x,
+                                      int y, int n, float *grad) {
+  struct RTNVGspanSetup s;
+  int i;
+  rtnvg__spanSetup(&s, frag, y);
+  for (i = 0; i < n; i++) {
+    float px = (float)(x + i) + 0.5f;
+    float d0 = fabsf(s.pm[0] * px + s.pm[1]) - s.ext[0];
+    float d1 = fabsf(s.pm[2] * px + s.pm[3]) - s.ext[1];
+    float m0 = d0 > 0.0f ? d0 : 0.0f;
+    float m1 = d1 > 0.0f ? d1 : 0.0f;
+    float sd = std::min(std::max(d0, d1), 0.0f) + sqrtf(m0 * m0 + m1 * m1) -
+               frag->radius;
+    float t = fclamp((sd + frag->feather * 0.5f) / frag->feather, 0.0f, 1.0f);
+    grad[i] = t;
   }
+}
 
-  // glDisable(GL_STENCIL_TEST);
+static void rtnvg__maskSpanScalar(const RTNVGfragUniforms *frag, int x, int y,
+                                  int n, const float *cover, float *rgba) {
+  struct RTNVGspanSetup s;
+  int i;
+  rtnvg__spanSetup(&s, frag, y);
+  for (i = 0; i < n; i++) {
+    float px = (float)(x + i) + 0.5f;
+    float s0 = fabsf(s.sm[0] * px + s.sm[1]) - frag->scissorExt[0];
+    float s1 = fabsf(s.sm[2] * px + s.sm[3]) - frag->scissorExt[1];
+    float k = fclamp(0.5f - s0 * frag->scissorScale[0], 0.0f, 1.0f) *
+              fclamp(0.5f - s1 * frag->scissorScale[1], 0.0f, 1.0f) * cover[i];
+    rgba[i] *= k;
+    rgba[i + RTNVG_SPAN_CHUNK] *= k;
+    rgba[i + 2 * RTNVG_SPAN_CHUNK] *= k;
+    rgba[i + 3 * RTNVG_SPAN_CHUNK] *= k;
+  }
+}
+
+static void rtnvg__blendSpanScalar(unsigned char *dst, const float *rgba,
+                                   int n) {
+  int i;
+  for (i = 0; i < n; i++, dst += 4) {
+    float col[4];
+    col[0] = rgba[i];
+    col[1] = rgba[i + RTNVG_SPAN_CHUNK];
+    col[2] = rgba[i + 2 * RTNVG_SPAN_CHUNK];
+    col[3] = rgba[i + 3 * RTNVG_SPAN_CHUNK];
+    rtnvg__alphaBlend(dst, col);
+  }
+}
+
+static void rtnvg__compositeSpanScalar(unsigned char *dst, const float *rgba,
+                                       int n, const RTNVGcomposite *k) {
+  int i;
+  for (i = 0; i < n; i++, dst += 4) {
+    float col[4];
+    col[0] = rgba[i];
+    col[1] = rgba[i + RTNVG_SPAN_CHUNK];
+    col[2] = rgba[i + 2 * RTNVG_SPAN_CHUNK];
+    col[3] = rgba[i + 3 * RTNVG_SPAN_CHUNK];
+    rtnvg__compositePixel(dst, col, k);
+  }
+}
+
+static void rtnvg__rampSpanScalar(const unsigned char *ramp, const float *grad,
+                                  int n, float *rgba) {
+  const float inv = 1.0f / 255.0f;
+  int i;
+  for (i = 0; i < n; i++) {
+    const unsigned char *c = &ramp[4 * rtnvg__rampIndex(grad[i])];
+    rgba[i] = (float)c[0] * inv;
+    rgba[i + RTNVG_SPAN_CHUNK] = (float)c[1] * inv;
+    rgba[i + 2 * RTNVG_SPAN_CHUNK] = (float)c[2] * inv;
+    rgba[i + 3 * RTNVG_SPAN_CHUNK] = (float)c[3] * inv;
+  }
+}
+
+static const RTNVGspanKernels rtnvg__scalarKernels = {
+    rtnvg__gradientSpanScalar, rtnvg__maskSpanScalar, rtnvg__rampSpanScalar,
+    rtnvg__blendSpanScalar, rtnvg__compositeSpanScalar};
+
+// The SIMD kernels process whole vectors; span buffers are padded to
+// RTNVG_SPAN_CHUNK so reading or writing past n is harmless, except for the
+// destination pixels which are handled by the scalar tail.
+
+#if RTNVG_SSE2
+static void rtnvg__gradientSpanSSE2(const RTNVGfragUniforms *frag, int x,
+                                    int y, int n, float *grad) {
+  struct RTNVGspanSetup s;
+  rtnvg__spanSetup(&s, frag, y);
+  __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+  __m128 sign = _mm_set1_ps(-0.0f);
+  __m128 rad = _mm_set1_ps(frag->radius);
+  __m128 half = _mm_set1_ps(frag->feather * 0.5f);
+  __m128 ifeather = _mm_set1_ps(1.0f / frag->feather);
+  __m128 px = _mm_add_ps(_mm_set1_ps((float)x),
+                         _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+  int i;
+  for (i = 0; i < n; i += 4, px = _mm_add_ps(px, _mm_set1_ps(4.0f))) {
+    __m128 p0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(s.pm[0]), px),
+                           _mm_set1_ps(s.pm[1]));
+    __m128 p1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(s.pm[2]), px),
+                           _mm_set1_ps(s.pm[3]));
+    __m128 d0 = _mm_sub_ps(_mm_andnot_ps(sign, p0), _mm_set1_ps(s.ext[0]));
+    __m128 d1 = _mm_sub_ps(_mm_andnot_ps(sign, p1), _mm_set1_ps(s.ext[1]));
+    __m128 m0 = _mm_max_ps(d0, zero), m1 = _mm_max_ps(d1, zero);
+    __m128 len =
+        _mm_sqrt_ps(_mm_add_ps(_mm_mul_ps(m0, m0), _mm_mul_ps(m1, m1)));
+    __m128 sd = _mm_sub_ps(
+        _mm_add_ps(_mm_min_ps(_mm_max_ps(d0, d1), zero), len), rad);
+    __m128 t = _mm_mul_ps(_mm_add_ps(sd, half), ifeather);
+    t = _mm_min_ps(_mm_max_ps(t, zero), one);
+    _mm_storeu_ps(grad + i, t);
+  }
+}
+
+static void rtnvg__maskSpanSSE2(const RTNVGfragUniforms *frag, int x, int y,
+                                int n, const float *cover, float *rgba) {
+  struct RTNVGspanSetup s;
+  rtnvg__spanSetup(&s, frag, y);
+  __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+  __m128 half = _mm_set1_ps(0.5f), sign = _mm_set1_ps(-0.0f);
+  __m128 px = _mm_add_ps(_mm_set1_ps((float)x),
+                         _mm_setr_ps(0.5f, 1.5f, 2.5f, 3.5f));
+  int i, c;
+  for (i = 0; i < n; i += 4, px = _mm_add_ps(px, _mm_set1_ps(4.0f))) {
+    __m128 s0 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(s.sm[0]), px),
+                           _mm_set1_ps(s.sm[1]));
+    __m128 s1 = _mm_add_ps(_mm_mul_ps(_mm_set1_ps(s.sm[2]), px),
+                           _mm_set1_ps(s.sm[3]));
+    s0 = _mm_sub_ps(_mm_andnot_ps(sign, s0), _mm_set1_ps(frag->scissorExt[0]));
+    s1 = _mm_sub_ps(_mm_andnot_ps(sign, s1), _mm_set1_ps(frag->scissorExt[1]));
+    s0 = _mm_sub_ps(half, _mm_mul_ps(s0, _mm_set1_ps(frag->scissorScale[0])));
+    s1 = _mm_sub_ps(half, _mm_mul_ps(s1, _mm_set1_ps(frag->scissorScale[1])));
+    s0 = _mm_min_ps(_mm_max_ps(s0, zero), one);
+    s1 = _mm_min_ps(_mm_max_ps(s1, zero), one);
+    __m128 k = _mm_mul_ps(_mm_mul_ps(s0, s1), _mm_loadu_ps(cover + i));
+    for (c = 0; c < 4; c++) {
+      float *p = rgba + c * RTNVG_SPAN_CHUNK + i;
+      _mm_storeu_ps(p, _mm_mul_ps(_mm_loadu_ps(p), k));
+    }
+  }
+}
+
+static void rtnvg__blendSpanSSE2(unsigned char *dst, const float *rgba,
+                                 int n) {
+  __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+  __m128 k255 = _mm_set1_ps(255.0f), inv255 = _mm_set1_ps(1.0f / 255.0f);
+  __m128i lo = _mm_set1_epi32(0xff);
+  int i;
+  for (i = 0; i + 4 <= n; i += 4, dst += 16) {
+    __m128i d = _mm_loadu_si128((const __m128i *)dst);
+    __m128 sa = _mm_loadu_ps(rgba + i + 3 * RTNVG_SPAN_CHUNK);
+    __m128 ia = _mm_sub_ps(one, _mm_min_ps(_mm_max_ps(sa, zero), one));
+    __m128i out = _mm_setzero_si128();
+    int c;
+    for (c = 0; c < 4; c++) {
+      __m128i dc = _mm_and_si128(_mm_srli_epi32(d, 8 * c), lo);
+      __m128 df = _mm_mul_ps(_mm_cvtepi32_ps(dc), inv255);
+      __m128 r = _mm_add_ps(_mm_loadu_ps(rgba + c * RTNVG_SPAN_CHUNK + i),
+                            _mm_mul_ps(df, ia));
+      r = _mm_min_ps(_mm_max_ps(_mm_mul_ps(r, k255), zero), k255);
+      out = _mm_or_si128(out, _mm_slli_epi32(_mm_cvttps_epi32(r), 8 * c));
+    }
+    _mm_storeu_si128((__m128i *)dst, out);
+  }
+  if (i < n)
+    rtnvg__blendSpanScalar(dst, rgba + i, n - i);
+}
+
+static void rtnvg__compositeSpanSSE2(unsigned char *dst, const float *rgba,
+                                     int n, const RTNVGcomposite *k) {
+  __m128 zero = _mm_setzero_ps(), one = _mm_set1_ps(1.0f);
+  __m128 k255 = _mm_set1_ps(255.0f), inv255 = _mm_set1_ps(1.0f / 255.0f);
+  __m128i lo = _mm_set1_epi32(0xff);
+  __m128 ks[2][6], kd[2][6];
+  int i, j, c;
+  for (j = 0; j < 2; j++)
+    for (c = 0; c < 6; c++) {
+      ks[j][c] = _mm_set1_ps(k->src[j][c]);
+      kd[j][c] = _mm_set1_ps(k->dst[j][c]);
+    }
+  for (i = 0; i + 4 <= n; i += 4, dst += 16) {
+    __m128i d = _mm_loadu_si128((const __m128i *)dst);
+    __m128 df[4], bs[2], bd[2], sa, sat;
+    __m128i out = _mm_setzero_si128();
+    for (c = 0; c < 4; c++)
+      df[c] = _mm_mul_ps(
+          _mm_cvtepi32_ps(_mm_and_si128(_mm_srli_epi32(d, 8 * c), lo)),
+          inv255);
+    sa = _mm_loadu_ps(rgba + i + 3 * RTNVG_SPAN_CHUNK);
+    sa = _mm_min_ps(_mm_max_ps(sa, zero), one);
+    sat = _mm_min_ps(sa, _mm_sub_ps(one, df[3]));
+    for (j = 0; j < 2; j++) {
+      bs[j] = _mm_add_ps(
+          _mm_add_ps(ks[j][0], _mm_mul_ps(ks[j][1], sa)),
+          _mm_add_ps(_mm_mul_ps(ks[j][2], df[3]), _mm_mul_ps(ks[j][5], sat)));
+      bd[j] = _mm_add_ps(
+          _mm_add_ps(kd[j][0], _mm_mul_ps(kd[j][1], sa)),
+          _mm_add_ps(_mm_mul_ps(kd[j][2], df[3]), _mm_mul_ps(kd[j][5], sat)));
+    }
+    for (c = 0; c < 4; c++) {
+      __m128 sc = _mm_loadu_ps(rgba + c * RTNVG_SPAN_CHUNK + i);
+      __m128 fs, fd, r;
+      j = c == 3;
+      fs = _mm_add_ps(bs[j], _mm_add_ps(_mm_mul_ps(ks[j][3], sc),
+                                        _mm_mul_ps(ks[j][4], df[c])));
+      fd = _mm_add_ps(bd[j], _mm_add_ps(_mm_mul_ps(kd[j][3], sc),
+                                        _mm_mul_ps(kd[j][4], df[c])));
+      r = _mm_add_ps(_mm_mul_ps(sc, fs), _mm_mul_ps(df[c], fd));
+      r = _mm_min_ps(_mm_max_ps(_mm_mul_ps(r, k255), zero), k255);
+      out = _mm_or_si128(out, _mm_slli_epi32(_mm_cvttps_epi32(r), 8 * c));
+    }
+    _mm_storeu_si128((__m128i *)dst, out);
+  }
+  if (i < n)
+    rtnvg__compositeSpanScalar(dst, rgba + i, n - i, k);
+}
+
+static const RTNVGspanKernels rtnvg__sse2Kernels = {
+    rtnvg__gradientSpanSSE2, rtnvg__maskSpanSSE2, rtnvg__rampSpanScalar,
+    rtnvg__blendSpanSSE2, rtnvg__compositeSpanSSE2};
+#endif
+
+#if RTNVG_AVX2
+RTNVG_TARGET_AVX2
+static void rtnvg__gradientSpanAVX2(const RTNVGfragUniforms *frag, int x,
+                                    int y, int n, float *grad) {
+  struct RTNVGspanSetup s;
+  rtnvg__spanSetup(&s, frag, y);
+  __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+  __m256 sign = _mm256_set1_ps(-0.0f);
+  __m256 rad = _mm256_set1_ps(frag->radius);
+  __m256 half = _mm256_set1_ps(frag->feather * 0.5f);
+  __m256 ifeather = _mm256_set1_ps(1.0f / frag->feather);
+  __m256 px = _mm256_add_ps(
+      _mm256_set1_ps((float)x),
+      _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f));
+  int i;
+  for (i = 0; i < n; i += 8, px = _mm256_add_ps(px, _mm256_set1_ps(8.0f))) {
+    __m256 p0 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(s.pm[0]), px),
+                              _mm256_set1_ps(s.pm[1]));
+    __m256 p1 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(s.pm[2]), px),
+                              _mm256_set1_ps(s.pm[3]));
+    __m256 d0 =
+        _mm256_sub_ps(_mm256_andnot_ps(sign, p0), _mm256_set1_ps(s.ext[0]));
+    __m256 d1 =
+        _mm256_sub_ps(_mm256_andnot_ps(sign, p1), _mm256_set1_ps(s.ext[1]));
+    __m256 m0 = _mm256_max_ps(d0, zero), m1 = _mm256_max_ps(d1, zero);
+    __m256 len = _mm256_sqrt_ps(
+        _mm256_add_ps(_mm256_mul_ps(m0, m0), _mm256_mul_ps(m1, m1)));
+    __m256 sd = _mm256_sub_ps(
+        _mm256_add_ps(_mm256_min_ps(_mm256_max_ps(d0, d1), zero), len), rad);
+    __m256 t = _mm256_mul_ps(_mm256_add_ps(sd, half), ifeather);
+    t = _mm256_min_ps(_mm256_max_ps(t, zero), one);
+    _mm256_storeu_ps(grad + i, t);
+  }
+}
+
+RTNVG_TARGET_AVX2
+static void rtnvg__maskSpanAVX2(const RTNVGfragUniforms *frag, int x, int y,
+                                int n, const float *cover, float *rgba) {
+  struct RTNVGspanSetup s;
+  rtnvg__spanSetup(&s, frag, y);
+  __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+  __m256 half = _mm256_set1_ps(0.5f), sign = _mm256_set1_ps(-0.0f);
+  __m256 px = _mm256_add_ps(
+      _mm256_set1_ps((float)x),
+      _mm256_setr_ps(0.5f, 1.5f, 2.5f, 3.5f, 4.5f, 5.5f, 6.5f, 7.5f));
+  int i, c;
+  for (i = 0; i < n; i += 8, px = _mm256_add_ps(px, _mm256_set1_ps(8.0f))) {
+    __m256 s0 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(s.sm[0]), px),
+                              _mm256_set1_ps(s.sm[1]));
+    __m256 s1 = _mm256_add_ps(_mm256_mul_ps(_mm256_set1_ps(s.sm[2]), px),
+                              _mm256_set1_ps(s.sm[3]));
+    s0 = _mm256_sub_ps(_mm256_andnot_ps(sign, s0),
+                       _mm256_set1_ps(frag->scissorExt[0]));
+    s1 = _mm256_sub_ps(_mm256_andnot_ps(sign, s1),
+                       _mm256_set1_ps(frag->scissorExt[1]));
+    s0 = _mm256_sub_ps(
+        half, _mm256_mul_ps(s0, _mm256_set1_ps(frag->scissorScale[0])));
+    s1 = _mm256_sub_ps(
+        half, _mm256_mul_ps(s1, _mm256_set1_ps(frag->scissorScale[1])));
+    s0 = _mm256_min_ps(_mm256_max_ps(s0, zero), one);
+    s1 = _mm256_min_ps(_mm256_max_ps(s1, zero), one);
+    __m256 k = _mm256_mul_ps(_mm256_mul_ps(s0, s1), _mm256_loadu_ps(cover + i));
+    for (c = 0; c < 4; c++) {
+      float *p = rgba + c * RTNVG_SPAN_CHUNK + i;
+      _mm256_storeu_ps(p, _mm256_mul_ps(_mm256_loadu_ps(p), k));
+    }
+  }
+}
+
+RTNVG_TARGET_AVX2
+static void rtnvg__rampSpanAVX2(const unsigned char *ramp, const float *grad,
+                                int n, float *rgba) {
+  __m256 scale = _mm256_set1_ps((float)(RTNVG_RAMP_SIZE - 1));
+  __m256 half = _mm256_set1_ps(0.5f);
+  __m256 inv255 = _mm256_set1_ps(1.0f / 255.0f);
+  __m256i lo = _mm256_set1_epi32(0xff);
+  __m256i last = _mm256_set1_epi32(RTNVG_RAMP_SIZE - 1);
+  int i, c;
+  // Lanes past n hold whatever the gradient kernel left there, the index
+  // clamp keeps their gather inside the ramp.
+  for (i = 0; i < n; i += 8) {
+    __m256 t = _mm256_add_ps(_mm256_mul_ps(_mm256_loadu_ps(grad + i), scale),
+                             half);
+    __m256i idx = _mm256_cvttps_epi32(t);
+    idx = _mm256_min_epi32(_mm256_max_epi32(idx, _mm256_setzero_si256()), last);
+    __m256i col = _mm256_i32gather_epi32((const int *)ramp, idx, 4);
+    for (c = 0; c < 4; c++) {
+      __m256i cc = _mm256_and_si256(_mm256_srli_epi32(col, 8 * c), lo);
+      _mm256_storeu_ps(rgba + c * RTNVG_SPAN_CHUNK + i,
+                       _mm256_mul_ps(_mm256_cvtepi32_ps(cc), inv255));
+    }
+  }
+}
+
+RTNVG_TARGET_AVX2
+static void rtnvg__blendSpanAVX2(unsigned char *dst, const float *rgba,
+                                 int n) {
+  __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+  __m256 k255 = _mm256_set1_ps(255.0f), inv255 = _mm256_set1_ps(1.0f / 255.0f);
+  __m256i lo = _mm256_set1_epi32(0xff);
+  __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  int i;
+  // The last partial vector goes through masked loads and stores.
+  for (i = 0; i < n; i += 8, dst += 32) {
+    __m256i live = _mm256_cmpgt_epi32(_mm256_set1_epi32(n - i), lanes);
+    __m256i d = _mm256_maskload_epi32((const int *)dst, live);
+    __m256 sa = _mm256_loadu_ps(rgba + i + 3 * RTNVG_SPAN_CHUNK);
+    __m256 ia = _mm256_sub_ps(one, _mm256_min_ps(_mm256_max_ps(sa, zero), one));
+    __m256i out = _mm256_setzero_si256();
+    int c;
+    for (c = 0; c < 4; c++) {
+      __m256i dc = _mm256_and_si256(_mm256_srli_epi32(d, 8 * c), lo);
+      __m256 df = _mm256_mul_ps(_mm256_cvtepi32_ps(dc), inv255);
+      __m256 r = _mm256_add_ps(
+          _mm256_loadu_ps(rgba + c * RTNVG_SPAN_CHUNK + i),
+          _mm256_mul_ps(df, ia));
+      r = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(r, k255), zero), k255);
+      out = _mm256_or_si256(out,
+                            _mm256_slli_epi32(_mm256_cvttps_epi32(r), 8 * c));
+    }
+    _mm256_maskstore_epi32((int *)dst, live, out);
+  }
+}
+
+RTNVG_TARGET_AVX2
+static void rtnvg__compositeSpanAVX2(unsigned char *dst, const float *rgba,
+                                     int n, const RTNVGcomposite *k) {
+  __m256 zero = _mm256_setzero_ps(), one = _mm256_set1_ps(1.0f);
+  __m256 k255 = _mm256_set1_ps(255.0f), inv255 = _mm256_set1_ps(1.0f / 255.0f);
+  __m256i lo = _mm256_set1_epi32(0xff);
+  __m256i lanes = _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7);
+  __m256 ks[2][6], kd[2][6];
+  int i, j, c;
+  for (j = 0; j < 2; j++)
+    for (c = 0; c < 6; c++) {
+      ks[j][c] = _mm256_set1_ps(k->src[j][c]);
+      kd[j][c] = _mm256_set1_ps(k->dst[j][c]);
+    }
+  // The last partial vector goes through masked loads and stores.
+  for (i = 0; i < n; i += 8, dst += 32) {
+    __m256i live = _mm256_cmpgt_epi32(_mm256_set1_epi32(n - i), lanes);
+    __m256i d = _mm256_maskload_epi32((const int *)dst, live);
+    __m256 df[4], bs[2], bd[2], sa, sat;
+    __m256i out = _mm256_setzero_si256();
+    for (c = 0; c < 4; c++)
+      df[c] = _mm256_mul_ps(
+          _mm256_cvtepi32_ps(_mm256_and_si256(_mm256_srli_epi32(d, 8 * c), lo)),
+          inv255);
+    sa = _mm256_loadu_ps(rgba + i + 3 * RTNVG_SPAN_CHUNK);
+    sa = _mm256_min_ps(_mm256_max_ps(sa, zero), one);
+    sat = _mm256_min_ps(sa, _mm256_sub_ps(one, df[3]));
+    for (j = 0; j < 2; j++) {
+      bs[j] = _mm256_add_ps(
+          _mm256_add_ps(ks[j][0], _mm256_mul_ps(ks[j][1], sa)),
+          _mm256_add_ps(_mm256_mul_ps(ks[j][2], df[3]),
+                        _mm256_mul_ps(ks[j][5], sat)));
+      bd[j] = _mm256_add_ps(
+          _mm256_add_ps(kd[j][0], _mm256_mul_ps(kd[j][1], sa)),
+          _mm256_add_ps(_mm256_mul_ps(kd[j][2], df[3]),
+                        _mm256_mul_ps(kd[j][5], sat)));
+    }
+    for (c = 0; c < 4; c++) {
+      __m256 sc = _mm256_loadu_ps(rgba + c * RTNVG_SPAN_CHUNK + i);
+      __m256 fs, fd, r;
+      j = c == 3;
+      fs = _mm256_add_ps(bs[j], _mm256_add_ps(_mm256_mul_ps(ks[j][3], sc),
+                                              _mm256_mul_ps(ks[j][4], df[c])));
+      fd = _mm256_add_ps(bd[j], _mm256_add_ps(_mm256_mul_ps(kd[j][3], sc),
+                                              _mm256_mul_ps(kd[j][4], df[c])));
+      r = _mm256_add_ps(_mm256_mul_ps(sc, fs), _mm256_mul_ps(df[c], fd));
+      r = _mm256_min_ps(_mm256_max_ps(_mm256_mul_ps(r, k255), zero), k255);
+      out = _mm256_or_si256(out,
+                            _mm256_slli_epi32(_mm256_cvttps_epi32(r), 8 * c));
+    }
+    _mm256_maskstore_epi32((int *)dst, live, out);
+  }
+}
+
+static const RTNVGspanKernels rtnvg__avx2Kernels = {
+    rtnvg__gradientSpanAVX2, rtnvg__maskSpanAVX2, rtnvg__rampSpanAVX2,
+    rtnvg__blendSpanAVX2, rtnvg__compositeSpanAVX2};
+
+static int rtnvg__cpuHasAVX2() {
+#if defined(_MSC_VER) && !defined(__clang__)
+  int info[4];
+  __cpuid(info, 0);
+  if (info[0] < 7)
+    return 0;
+  __cpuid(info, 1);
+  // OSXSAVE and AVX, then the OS must have enabled the YMM state.
+  if ((info[2] & (1 << 27)) == 0 || (info[2] & (1 << 28)) == 0)
+    return 0;
+  if ((_xgetbv(0) & 6) != 6)
+    return 0;
+  __cpuidex(info, 7, 0);
+  return (info[1] & (1 << 5)) != 0;
+#else
+  __builtin_cpu_init();
+  return __builtin_cpu_supports("avx2");
+#endif
+}
+#endif
+
+#if RTNVG_NEON
+static void rtnvg__gradientSpanNEON(const RTNVGfragUniforms *frag, int x,
+                                    int y, int n, float *grad) {
+  struct RTNVGspanSetup s;
+  rtnvg__spanSetup(&s, frag, y);
+  static const float steps[4] = {0.5f, 1.5f, 2.5f, 3.5f};
+  float32x4_t zero = vdupq_n_f32(0.0f), one = vdupq_n_f32(1.0f);
+  float32x4_t rad = vdupq_n_f32(frag->radius);
+  float32x4_t half = vdupq_n_f32(frag->feather * 0.5f);
+  float32x4_t ifeather = vdupq_n_f32(1.0f / frag->feather);
+  float32x4_t px = vaddq_f32(vdupq_n_f32((float)x), vld1q_f32(steps));
+  int i;
+  for (i = 0; i < n; i += 4, px = vaddq_f32(px, vdupq_n_f32(4.0f))) {
+    float32x4_t p0 = vmlaq_n_f32(vdupq_n_f32(s.pm[1]), px, s.pm[0]);
+    float32x4_t p1 = vmlaq_n_f32(vdupq_n_f32(s.pm[3]), px, s.pm[2]);
+    float32x4_t d0 = vsubq_f32(vabsq_f32(p0), vdupq_n_f32(s.ext[0]));
+    float32x4_t d1 = vsubq_f32(vabsq_f32(p1), vdupq_n_f32(s.ext[1]));
+    float32x4_t m0 = vmaxq_f32(d0, zero), m1 = vmaxq_f32(d1, zero);
+    float32x4_t len = vsqrtq_f32(vmlaq_f32(vmulq_f32(m0, m0), m1, m1));
+    float32x4_t sd =
+        vsubq_f32(vaddq_f32(vminq_f32(vmaxq_f32(d0, d1), zero), len), rad);
+    float32x4_t t = vmulq_f32(vaddq_f32(sd, half), ifeather);
+    t = vminq_f32(vmaxq_f32(t, zero), one);
+    vst1q_f32(grad + i, t);
+  }
+}
+
+static void rtnvg__maskSpanNEON(const RTNVGfragUniforms *frag, int x, int y,
+                                int n, const float *cover, float *rgba) {
+  struct RTNVGspanSetup s;
+  rtnvg__spanSetup(&s, frag, y);
+  static const float steps[4] = {0.5f, 1.5f, 2.5f, 3.5f};
+  float32x4_t zero = vdupq_n_f32(0.0f), one = vdupq_n_f32(1.0f);
+  float32x4_t half = vdupq_n_f32(0.5f);
+  float32x4_t px = vaddq_f32(vdupq_n_f32((float)x), vld1q_f32(steps));
+  int i, c;
+  for (i = 0; i < n; i += 4, px = vaddq_f32(px, vdupq_n_f32(4.0f))) {
+    float32x4_t s0 = vmlaq_n_f32(vdupq_n_f32(s.sm[1]), px, s.sm[0]);
+    float32x4_t s1 = vmlaq_n_f32(vdupq_n_f32(s.sm[3]), px, s.sm[2]);
+    s0 = vsubq_f32(vabsq_f32(s0), vdupq_n_f32(frag->scissorExt[0]));
+    s1 = vsubq_f32(vabsq_f32(s1), vdupq_n_f32(frag->scissorExt[1]));
+    s0 = vmlsq_n_f32(half, s0, frag->scissorScale[0]);
+    s1 = vmlsq_n_f32(half, s1, frag->scissorScale[1]);
+    s0 = vminq_f32(vmaxq_f32(s0, zero), one);
+    s1 = vminq_f32(vmaxq_f32(s1, zero), one);
+    float32x4_t k = vmulq_f32(vmulq_f32(s0, s1), vld1q_f32(cover + i));
+    for (c = 0; c < 4; c++) {
+      float *p = rgba + c * RTNVG_SPAN_CHUNK + i;
+      vst1q_f32(p, vmulq_f32(vld1q_f32(p), k));
+    }
+  }
+}
+
+static void rtnvg__blendSpanNEON(unsigned char *dst, const float *rgba,
+                                 int n) {
+  float32x4_t zero = vdupq_n_f32(0.0f), one = vdupq_n_f32(1.0f);
+  float32x4_t k255 = vdupq_n_f32(255.0f);
+  float32x4_t inv255 = vdupq_n_f32(1.0f / 255.0f);
+  uint32x4_t lo = vdupq_n_u32(0xff);
+  int i;
+  for (i = 0; i + 4 <= n; i += 4, dst += 16) {
+    uint32x4_t d = vreinterpretq_u32_u8(vld1q_u8(dst));
+    float32x4_t sa = vld1q_f32(rgba + i + 3 * RTNVG_SPAN_CHUNK);
+    float32x4_t ia = vsubq_f32(one, vminq_f32(vmaxq_f32(sa, zero), one));
+    uint32x4_t out = vdupq_n_u32(0);
+    int c;
+    for (c = 0; c < 4; c++) {
+      uint32x4_t dc = vandq_u32(vshlq_u32(d, vdupq_n_s32(-8 * c)), lo);
+      float32x4_t df = vmulq_f32(vcvtq_f32_u32(dc), inv255);
+      float32x4_t r =
+          vmlaq_f32(vld1q_f32(rgba + c * RTNVG_SPAN_CHUNK + i), df, ia);
+      r = vminq_f32(vmaxq_f32(vmulq_f32(r, k255), zero), k255);
+      out = vorrq_u32(out, vshlq_u32(vcvtq_u32_f32(r), vdupq_n_s32(8 * c)));
+    }
+    vst1q_u8(dst, vreinterpretq_u8_u32(out));
+  }
+  if (i < n)
+    rtnvg__blendSpanScalar(dst, rgba + i, n - i);
+}
+
+static const RTNVGspanKernels rtnvg__neonKernels = {
+    rtnvg__gradientSpanNEON, rtnvg__maskSpanNEON, rtnvg__rampSpanScalar,
+    rtnvg__blendSpanNEON, rtnvg__compositeSpanScalar};
+#endif
+
+static const RTNVGspanKernels *rtnvg__selectKernels() {
+#if RTNVG_AVX2
+  if (rtnvg__cpuHasAVX2())
+    return &rtnvg__avx2Kernels;
+#endif
+#if RTNVG_SSE2
+  return &rtnvg__sse2Kernels;
+#elif RTNVG_NEON
+  return &rtnvg__neonKernels;
+#else
+  return &rtnvg__scalarKernels;
+#endif
+}
+
+static const RTNVGspanKernels *rtnvg__spanKernels() {
+  static const RTNVGspanKernels *kernels = rtnvg__selectKernels();
+  return kernels;
+}
+
+// Texel colors for texcoords u = tu[0] * x + tu[1], v = tv[0] * x + tv[1]
+// at the pixel centers x of the span.
+static void rtnvg__textureSpan(const RTNVGshadeState *st, const float *tu,
+                               const float *tv, int x, int n, float *rgba) {
+  int i;
+  for (i = 0; i < n; i++) {
+    float px = (float)(x + i) + 0.5f;
+    float c[4];
+    rtnvg__texelColor(st, tu[0] * px + tu[1], tv[0] * px + tv[1], c);
+    rgba[i] = c[0];
+    rgba[i + RTNVG_SPAN_CHUNK] = c[1];
+    rgba[i + 2 * RTNVG_SPAN_CHUNK] = c[2];
+    rgba[i + 3 * RTNVG_SPAN_CHUNK] = c[3];
+  }
+}
+
+static void rtnvg__solidSpan(const NVGcolor *col, int n, float *rgba) {
+  int i;
+  for (i = 0; i < n; i++) {
+    rgba[i] = col->r;
+    rgba[i + RTNVG_SPAN_CHUNK] = col->g;
+    rgba[i + 2 * RTNVG_SPAN_CHUNK] = col->b;
+    rgba[i + 3 * RTNVG_SPAN_CHUNK] = col->a;
+  }
+}
+
+static void rtnvg__lerpSpan(const NVGcolor *c0, const NVGcolor *c1,
+                            const float *grad, int n, float *rgba) {
+  int i, c;
+  for (c = 0; c < 4; c++, rgba += RTNVG_SPAN_CHUNK)
+    for (i = 0; i < n; i++)
+      rgba[i] = c0->rgba[c] + (c1->rgba[c] - c0->rgba[c]) * grad[i];
+}
+
+// Scissor mask and coverage, calls without scissor only need the coverage.
+static void rtnvg__maskSpan(const RTNVGspanKernels *kernels,
+                            const RTNVGshadeState *st, int x, int y, int n,
+                            const float *cover, float *rgba) {
+  int i;
+  if (st->scissor != RTNVG_SCISSOR_NONE) {
+    kernels->mask(st->frag, x, y, n, cover, rgba);
+    return;
+  }
+  for (i = 0; i < n; i++) {
+    rgba[i] *= cover[i];
+    rgba[i + RTNVG_SPAN_CHUNK] *= cover[i];
+    rgba[i + 2 * RTNVG_SPAN_CHUNK] *= cover[i];
+    rgba[i + 3 * RTNVG_SPAN_CHUNK] *= cover[i];
+  }
+}
+
+//
+// Scanline rasterizer (NVG_SCANLINE).
+//
+// Geometry is converted to a list of directed edges which is walked top to
+// bottom with an active edge table. On every scanline the active edges
+// deposit signed area into a row accumulation buffer (or a winding step at
+// the pixel center when NVG_ANTIALIAS is off), and a prefix sum over the row
+// yields the signed winding of each pixel, which the fill rule folds into
+// coverage. Covered runs are handed to a span functor:
+// span(y, x0, x1, coverage).
+//
+// Every draw is clipped to a pixel rect, which is the whole surface or one
+// tile with NVG_TILED. Edges are built and sorted once per call in
+// rtnvg__prepareCall and shared read-only by all tiles.
+//
+
+#define RTNVG_TILE_SIZE 64
+
+static int rtnvg__allocEdges(RTNVGcontext *rt, int n) {
+  int ret = 0;
+  if (rt->nedges + n > rt->cedges) {
+    RTNVGedge *edges;
+    int cedges =
+        rtnvg__maxi(rt->nedges + n, 256) + rt->cedges / 2; // 1.5x Overallocate
+    edges = (RTNVGedge *)realloc(rt->edges, sizeof(RTNVGedge) * cedges);
+    if (edges == NULL)
+      return -1;
+    rt->edges = edges;
+    rt->cedges = cedges;
+  }
+  ret = rt->nedges;
+  rt->nedges += n;
+  return ret;
+}
+
+// Returns 0 if the edge is horizontal or outside the rows [0, height).
+static int rtnvg__makeEdge(RTNVGedge *e, float x0, float y0, float x1,
+                           float y1, float height) {
+  float dir = 1.0f;
+
+  if (y0 == y1)
+    return 0;
+  if (y0 > y1) {
+    float t;
+    t = x0; x0 = x1; x1 = t;
+    t = y0; y0 = y1; y1 = t;
+    dir = -1.0f;
+  }
+  if (y1 <= 0.0f || y0 >= height)
+    return 0;
+
+  e->x0 = x0;
+  e->y0 = y0;
+  e->x1 = x1;
+  e->y1 = y1;
+  e->dxdy = (x1 - x0) / (y1 - y0);
+  e->dir = dir;
+  return 1;
+}
+
+static void rtnvg__addEdge(RTNVGcontext *rt, float x0, float y0, float x1,
+                           float y1) {
+  int i = rtnvg__allocEdges(rt, 1);
+  if (i == -1)
+    return;
+  if (!rtnvg__makeEdge(&rt->edges[i], x0, y0, x1, y1, (float)rt->height))
+    rt->nedges--;
+}
+
+static int rtnvg__cmpEdge(const void *a, const void *b) {
+  const RTNVGedge *ea = (const RTNVGedge *)a;
+  const RTNVGedge *eb = (const RTNVGedge *)b;
+  if (ea->y0 < eb->y0)
+    return -1;
+  if (ea->y0 > eb->y0)
+    return 1;
+  return 0;
+}
+
+// Pixel rect touched by the float rect, clamped to the surface.
+static void rtnvg__pixelBounds(const RTNVGcontext *rt, float xmin, float ymin,
+                               float xmax, float ymax, int *bounds) {
+  float w = (float)rt->width, h = (float)rt->height;
+  bounds[0] = (int)floorf(fclamp(xmin, 0.0f, w));
+  bounds[1] = (int)floorf(fclamp(ymin, 0.0f, h));
+  bounds[2] = std::min(rt->width, (int)ceilf(fclamp(xmax, 0.0f, w)) + 1);
+  bounds[3] = std::min(rt->height, (int)ceilf(fclamp(ymax, 0.0f, h)));
+}
+
+// Whether the scanline paths compute partial edge coverage or test pixel
+// centers. They have no use for fringes or sample masks, so any of the
+// anti-aliasing flags turns on the analytic coverage.
+static int rtnvg__edgeCoverage(const RTNVGcontext *rt) {
+  return (rt->flags & (NVG_ANTIALIAS | NVG_MSAA_4X | NVG_MSAA_8X |
+                       NVG_MSAA_16X)) != 0;
+}
+
+// Narrows the pixel rect r (l,t,r,b) to the scissor rect of the call.
+static void rtnvg__clipRect(const RTNVGcall *call, int *r) {
+  r[0] = rtnvg__maxi(r[0], call->clip[0]);
+  r[1] = rtnvg__maxi(r[1], call->clip[1]);
+  r[2] = std::min(r[2], call->clip[2]);
+  r[3] = std::min(r[3], call->clip[3]);
+}
+
+// Pixel rect covered by edges, clamped to the surface.
+static void rtnvg__edgeBounds(const RTNVGcontext *rt, const RTNVGedge *edges,
+                              int nedges, int *bounds) {
+  float xmin, xmax, ymin, ymax;
+  int i;
+
+  if (nedges == 0) {
+    bounds[0] = bounds[1] = bounds[2] = bounds[3] = 0;
+    return;
+  }
+
+  xmin = xmax = edges[0].x0;
+  ymin = edges[0].y0;
+  ymax = edges[0].y1;
+  for (i = 0; i < nedges; i++) {
+    const RTNVGedge *e = &edges[i];
+    xmin = std::min(xmin, std::min(e->x0, e->x1));
+    xmax = std::max(xmax, std::max(e->x0, e->x1));
+    ymin = std::min(ymin, e->y0);
+    ymax = std::max(ymax, e->y1);
+  }
+
+  rtnvg__pixelBounds(rt, xmin, ymin, xmax, ymax, bounds);
+}
+
+// Accumulates the signed area right of the segment (x, y) - (xnext, y + dy)
+// which lies within one scanline.
+static void rtnvg__accumulateArea(float *a, float x, float xnext, float dy,
+                                  float dir) {
+  float d = dy * dir;
+  float x0 = x < xnext ? x : xnext;
+  float x1 = x < xnext ? xnext : x;
+  float x0floor = floorf(x0);
+  int x0i = (int)x0floor;
+  float x1ceil = ceilf(x1);
+  int x1i = (int)x1ceil;
+
+  if (x1i <= x0i + 1) {
+    float xmf = 0.5f * (x + xnext) - x0floor;
+    a[x0i] += d - d * xmf;
+    a[x0i + 1] += d * xmf;
+  } else {
+    float s = 1.0f / (x1 - x0);
+    float x0f = x0 - x0floor;
+    float a0 = 0.5f * s * (1.0f - x0f) * (1.0f - x0f);
+    float x1f = x1 - x1ceil + 1.0f;
+    float am = 0.5f * s * x1f * x1f;
+    a[x0i] += d * a0;
+    if (x1i == x0i + 2) {
+      a[x0i + 1] += d * (1.0f - a0 - am);
+    } else {
+      float a1 = s * (1.5f - x0f);
+      float a2 = a1 + (float)(x1i - x0i - 3) * s;
+      int xi;
+      a[x0i + 1] += d * (a1 - a0);
+      for (xi = x0i + 2; xi < x1i - 1; xi++)
+        a[xi] += d * s;
+      a[x1i - 1] += d * (1.0f - a2 - am);
+    }
+    a[x1i] += d * am;
+  }
+}
+
+// Like rtnvg__accumulateArea, restricted to [xl, xr]. The part left of the
+// clip collapses into a full step at xl, the part right of it never reaches
+// a visible pixel.
+static void rtnvg__accumulateClipped(float *a, float xa, float xb, float dy,
+                                     float dir, float xl, float xr) {
+  if (xa > xb) {
+    float t = xa;
+    xa = xb;
+    xb = t;
+  }
+  if (xb <= xl) {
+    a[(int)xl] += dy * dir;
+    return;
+  }
+  if (xa >= xr)
+    return;
+  if (xa < xl) {
+    float t = (xl - xa) / (xb - xa);
+    a[(int)xl] += dy * t * dir;
+    dy *= 1.0f - t;
+    xa = xl;
+  }
+  if (xb > xr) {
+    float t = (xb - xr) / (xb - xa);
+    dy *= 1.0f - t;
+    xb = xr;
+  }
+  rtnvg__accumulateArea(a, xa, xb, dy, dir);
+}
+
+static RTNVGscratch *rtnvg__scratch(RTNVGcontext *rt, int worker, int nedges) {
+  RTNVGscratch *s = &rt->scratch[worker];
+  // Slack for span kernels loading whole vectors past the last pixel.
+  if (rt->width + 2 + 8 > s->ccover) {
+    int n = rt->width + 2 + 8;
+    float *cover = (float *)realloc(s->cover, sizeof(float) * n);
+    if (cover == NULL)
+      return NULL;
+    memset(cover, 0, sizeof(float) * n);
+    s->cover = cover;
+    s->ccover = n;
+  }
+  if (nedges > s->cactive || s->active == NULL) {
+    int cactive = rtnvg__maxi(nedges, 256) + s->cactive / 2;
+    int *active = (int *)realloc(s->active, sizeof(int) * cactive);
+    if (active == NULL)
+      return NULL;
+    s->active = active;
+    s->cactive = cactive;
+  }
+  return s;
+}
+
+static float *rtnvg__scratchAccum(RTNVGscratch *s, int w, int h) {
+  int size = w * h * 4;
+  if (size > s->caccum) {
+    float *accum = (float *)realloc(s->accum, sizeof(float) * size);
+    if (accum == NULL)
+      return NULL;
+    s->accum = accum;
+    s->caccum = size;
+  }
+  memset(s->accum, 0, sizeof(float) * size);
+  return s->accum;
+}
+
+// Rasterizes edges sorted by y0 within the pixel rect rect (l,t,r,b) with
+// the given NVGfillRule.
+template <typename SpanFunc>
+static void rtnvg__rasterizeEdges(const RTNVGcontext *rt, RTNVGscratch *s,
+                                  const RTNVGedge *edges, int nedges,
+                                  const int *rect, int fillRule,
+                                  SpanFunc &span) {
+  int aa = rtnvg__edgeCoverage(rt);
+  int evenOdd = fillRule == NVG_EVENODD;
+  float xl = (float)rect[0], xr = (float)rect[2];
+  int i, y, iclear;
+  int next = 0, nactive = 0;
+  float *a = s->cover;
+
+  if (rect[0] >= rect[2] || rect[1] >= rect[3])
+    return;
+  iclear = std::min(rt->width + 2, rect[2] + 2);
+
+  // Skip edges which end above the rect.
+  while (next < nedges && edges[next].y0 < (float)rect[1]) {
+    if (edges[next].y1 > (float)rect[1])
+      s->active[nactive++] = next;
+    next++;
+  }
+
+  for (y = rect[1]; y < rect[3]; y++) {
+    float fy = (float)y;
+    float yc = fy + 0.5f;
+    float acc = 0.0f;
+    int x, start = -1;
+
+    // Retire finished edges, then pull in the ones starting on this row.
+    for (i = 0; i < nactive;) {
+      if (edges[s->active[i]].y1 <= fy)
+        s->active[i] = s->active[--nactive];
+      else
+        i++;
+    }
+    while (next < nedges && edges[next].y0 < fy + 1.0f) {
+      if (edges[next].y1 > fy)
+        s->active[nactive++] = next;
+      next++;
+    }
+    if (nactive == 0) {
+      if (next == nedges)
+        break;
+      continue;
+    }
+
+    for (i = 0; i < nactive; i++) {
+      const RTNVGedge *e = &edges[s->active[i]];
+      if (aa) {
+        float ya = std::max(e->y0, fy);
+        float yb = std::min(e->y1, fy + 1.0f);
+        float xa = e->x0 + (ya - e->y0) * e->dxdy;
+        float xb = e->x0 + (yb - e->y0) * e->dxdy;
+        rtnvg__accumulateClipped(a, xa, xb, yb - ya, e->dir, xl, xr);
+      } else if (e->y0 <= yc && yc < e->y1) {
+        float xc = e->x0 + (yc - e->y0) * e->dxdy;
+        int xi = (int)ceilf(xc - 0.5f);
+        xi = xi < rect[0] ? rect[0] : (xi > rect[2] ? rect[2] : xi);
+        a[xi] += e->dir;
+      }
+    }
+
+    // Resolve coverage in place and emit the covered runs.
+    for (x = rect[0]; x < rect[2]; x++) {
+      float c;
+      acc += a[x];
+      c = fabsf(acc);
+      if (evenOdd) {
+        // Fold the winding onto [0, 2): partial coverage of an odd winding
+        // ramps up, that of an even one back down.
+        c -= 2.0f * floorf(c * 0.5f);
+        c = c > 1.0f ? 2.0f - c : c;
+      }
+      if (aa)
+        c = c > 1.0f ? 1.0f : c;
+      else
+        c = c > 0.5f ? 1.0f : 0.0f;
+      a[x] = c;
+      if (c > 1.0f / 512.0f) {
+        if (start < 0)
+          start = x;
+      } else if (start >= 0) {
+        span(y, start, x, a);
+        start = -1;
+      }
+    }
+    if (start >= 0)
+      span(y, start, rect[2], a);
+
+    memset(&a[rect[0]], 0, sizeof(float) * (iclear - rect[0]));
+  }
+}
+
+struct RTNVGshadeSpan {
+  RTNVGcontext *rt;
+  RTNVGshadeState paint;
+  const RTNVGspanKernels *kernels;
+
+  void operator()(int y, int x0, int x1, const float *cover) {
+    unsigned char *dst = &rt->pixels[y * rt->stride + 4 * x0];
+    const RTNVGfragUniforms *frag = paint.frag;
+    float rgba[4 * RTNVG_SPAN_CHUNK], grad[RTNVG_SPAN_CHUNK];
+    float tu[2], tv[2];
+    int x, n;
+
+    if (paint.type == NSVG_SHADER_FILLIMG) {
+      const float *m = frag->paintMat;
+      float py = (float)y + 0.5f;
+      tu[0] = m[0] * paint.invExtent[0];
+      tu[1] = (m[4] * py + m[8]) * paint.invExtent[0];
+      tv[0] = m[1] * paint.invExtent[1];
+      tv[1] = (m[5] * py + m[9]) * paint.invExtent[1];
+    }
+    for (x = x0; x < x1; x += n, dst += 4 * n) {
+      n = std::min(x1 - x, RTNVG_SPAN_CHUNK);
+      if (paint.type == NSVG_SHADER_FILLGRAD) {
+        if (paint.solid) {
+          rtnvg__solidSpan(&paint.innerCol, n, rgba);
+        } else {
+          kernels->gradient(frag, x, y, n, grad);
+          if (paint.ramp != NULL)
+            kernels->ramp(paint.ramp, grad, n, rgba);
+          else
+            rtnvg__lerpSpan(&paint.innerCol, &paint.outerCol, grad, n, rgba);
+        }
+      } else if (paint.tex != NULL) {
+        rtnvg__textureSpan(&paint, tu, tv, x, n, rgba);
+      } else {
+        continue;
+      }
+      rtnvg__maskSpan(kernels, &paint, x, y, n, &cover[x], rgba);
+      if (paint.composite)
+        kernels->composite(dst, rgba, n, &paint.comp);
+      else
+        kernels->blend(dst, rgba, n);
+    }
+  }
+};
+
+// Shades one triangle of a RTNVG_TRIANGLES call and accumulates the
+// premultiplied color into the call's accumulation rect, so that triangles
+// sharing an edge blend once just like with ray casting.
+struct RTNVGtriangleSpan {
+  RTNVGshadeState paint;
+  const RTNVGspanKernels *kernels;
+  float *accum;
+  int ax, ay, aw;
+  float u[3], v[3]; // Texcoord plane equations: u = u0 * x + u1 * y + u2
+
+  void operator()(int y, int x0, int x1, const float *cover) {
+    float *dst = &accum[4 * ((y - ay) * aw + (x0 - ax))];
+    float py = (float)y + 0.5f;
+    float rgba[4 * RTNVG_SPAN_CHUNK];
+    float tu[2], tv[2];
+    int i, x, n;
+
+    if (paint.tex == NULL)
+      return;
+    tu[0] = u[0];
+    tu[1] = u[1] * py + u[2];
+    tv[0] = v[0];
+    tv[1] = v[1] * py + v[2];
+    for (x = x0; x < x1; x += n) {
+      n = std::min(x1 - x, RTNVG_SPAN_CHUNK);
+      rtnvg__textureSpan(&paint, tu, tv, x, n, rgba);
+      rtnvg__maskSpan(kernels, &paint, x, y, n, &cover[x], rgba);
+      for (i = 0; i < n; i++, dst += 4) {
+        dst[0] += rgba[i];
+        dst[1] += rgba[i + RTNVG_SPAN_CHUNK];
+        dst[2] += rgba[i + 2 * RTNVG_SPAN_CHUNK];
+        dst[3] += rgba[i + 3 * RTNVG_SPAN_CHUNK];
+      }
+    }
+  }
+};
+
+static void rtnvg__addTriangle(RTNVGcontext *rt, const NVGvertex *a,
+                               const NVGvertex *b, const NVGvertex *c) {
+  // Orient every triangle the same way so overlaps add up instead of
+  // cancelling; nonzero coverage then becomes the union of the triangles.
+  float area = (b->x - a->x) * (c->y - a->y) - (c->x - a->x) * (b->y - a->y);
+  if (area < 0.0f) {
+    const NVGvertex *t = b;
+    b = c;
+    c = t;
+  }
+  rtnvg__addEdge(rt, a->x, a->y, b->x, b->y);
+  rtnvg__addEdge(rt, b->x, b->y, c->x, c->y);
+  rtnvg__addEdge(rt, c->x, c->y, a->x, a->y);
+}
+
+// Builds the sorted edge list and the pixel bounds of a call.
+static void rtnvg__prepareCall(RTNVGcontext *rt, RTNVGcall *call) {
+  RTNVGpath *paths = &rt->paths[call->pathOffset];
+  int i, j, npaths = call->pathCount;
+
+  call->edgeOffset = rt->nedges;
+
+  if (call->type == RTNVG_SHAPE) {
+    const NVGshape *sh = &call->shape;
+    float d = call->strokeWidth * 0.5f;
+    rtnvg__pixelBounds(rt, sh->cx - sh->hx - d, sh->cy - sh->hy - d,
+                       sh->cx + sh->hx + d, sh->cy + sh->hy + d, call->bounds);
+    rtnvg__clipRect(call, call->bounds);
+    return;
+  }
+
+  if (call->type == RTNVG_LINES) {
+    // Center lines are walked directly, only the bounds are needed.
+    float d = call->strokeWidth * 0.5f + 1.0f;
+    float bmin[2] = {1e30f, 1e30f}, bmax[2] = {-1e30f, -1e30f};
+    if (call->lineCap == NVG_SQUARE)
+      d += call->strokeWidth * 0.5f;
+    for (i = 0; i < npaths; i++) {
+      const NVGvertex *v = &rt->verts[paths[i].strokeOffset];
+      for (j = 0; j < paths[i].strokeCount; j++) {
+        bmin[0] = std::min(bmin[0], v[j].x);
+        bmin[1] = std::min(bmin[1], v[j].y);
+        bmax[0] = std::max(bmax[0], v[j].x);
+        bmax[1] = std::max(bmax[1], v[j].y);
+      }
+    }
+    if (bmin[0] > bmax[0]) {
+      call->bounds[0] = call->bounds[1] = call->bounds[2] = call->bounds[3] = 0;
+      return;
+    }
+    rtnvg__pixelBounds(rt, bmin[0] - d, bmin[1] - d, bmax[0] + d, bmax[1] + d,
+                       call->bounds);
+    rtnvg__clipRect(call, call->bounds);
+    return;
+  }
+
+  if (call->type == RTNVG_FILL || call->type == RTNVG_CONVEXFILL) {
+    // Fill polygons keep their orientation, so holes (NVG_CW) cancel out.
+    for (i = 0; i < npaths; i++) {
+      const NVGvertex *v = &rt->verts[paths[i].fillOffset];
+      int n = paths[i].fillCount;
+      for (j = 0; j < n; j++) {
+        const NVGvertex *v0 = &v[j];
+        const NVGvertex *v1 = &v[(j + 1) % n];
+        rtnvg__addEdge(rt, v0->x, v0->y, v1->x, v1->y);
+      }
+    }
+  } else if (call->type == RTNVG_STROKE) {
+    // TRIANGLE_STRIP -> TRIANGLES.
+    for (i = 0; i < npaths; i++) {
+      const NVGvertex *v = &rt->verts[paths[i].strokeOffset];
+      for (j = 0; j < paths[i].strokeCount - 2; j++)
+        rtnvg__addTriangle(rt, &v[j], &v[j + 1], &v[j + 2]);
+    }
+  } else if (call->type == RTNVG_TRIANGLES) {
+    // Triangles are rasterized one by one, only the bounds are needed.
+    const NVGvertex *v = &rt->verts[call->triangleOffset];
+    float bmin[2], bmax[2];
+    if (call->triangleCount < 3)
+      return;
+    bmin[0] = bmax[0] = v[0].x;
+    bmin[1] = bmax[1] = v[0].y;
+    for (i = 1; i < call->triangleCount; i++) {
+      bmin[0] = std::min(bmin[0], v[i].x);
+      bmin[1] = std::min(bmin[1], v[i].y);
+      bmax[0] = std::max(bmax[0], v[i].x);
+      bmax[1] = std::max(bmax[1], v[i].y);
+    }
+    rtnvg__pixelBounds(rt, bmin[0], bmin[1], bmax[0], bmax[1], call->bounds);
+    rtnvg__clipRect(call, call->bounds);
+    return;
+  }
+
+  call->edgeCount = rt->nedges - call->edgeOffset;
+  qsort(&rt->edges[call->edgeOffset], call->edgeCount, sizeof(RTNVGedge),
+        rtnvg__cmpEdge);
+  rtnvg__edgeBounds(rt, &rt->edges[call->edgeOffset], call->edgeCount,
+                    call->bounds);
+  rtnvg__clipRect(call, call->bounds);
+}
+
+static void rtnvg__scanlineTriangles(RTNVGcontext *rt, RTNVGscratch *s,
+                                     RTNVGcall *call, const int *rect) {
+  const NVGvertex *verts = &rt->verts[call->triangleOffset];
+  int i, j, x, y, n = call->triangleCount;
+  RTNVGtriangleSpan span;
+
+  rtnvg__shadeState(rt, call, nvg__fragUniformPtr(rt, call->uniformOffset),
+                    &span.paint);
+  span.kernels = rtnvg__spanKernels();
+  span.ax = rect[0];
+  span.ay = rect[1];
+  span.aw = rect[2] - rect[0];
+  span.accum = rtnvg__scratchAccum(s, span.aw, rect[3] - rect[1]);
+  if (span.accum == NULL)
+    return;
+
+  for (i = 0; i + 2 < n; i += 3) {
+    const NVGvertex *v0 = &verts[i];
+    const NVGvertex *v1 = &verts[i + 1];
+    const NVGvertex *v2 = &verts[i + 2];
+    float e1x = v1->x - v0->x, e1y = v1->y - v0->y;
+    float e2x = v2->x - v0->x, e2y = v2->y - v0->y;
+    float det = e1x * e2y - e2x * e1y;
+    RTNVGedge e[3];
+    int b[4], ne = 0;
+
+    if (det == 0.0f)
+      continue;
+    for (j = 0; j < 3; j++) {
+      const NVGvertex *p0 = &verts[i + j];
+      const NVGvertex *p1 = &verts[i + (j + 1) % 3];
+      ne += rtnvg__makeEdge(&e[ne], p0->x, p0->y, p1->x, p1->y,
+                            (float)rt->height);
+    }
+    if (ne == 0)
+      continue;
+    qsort(e, ne, sizeof(RTNVGedge), rtnvg__cmpEdge);
+    rtnvg__edgeBounds(rt, e, ne, b);
+    b[0] = rtnvg__maxi(b[0], rect[0]);
+    b[1] = rtnvg__maxi(b[1], rect[1]);
+    b[2] = std::min(b[2], rect[2]);
+    b[3] = std::min(b[3], rect[3]);
+
+    // Solve the affine maps (x, y) -> u and (x, y) -> v of this triangle.
+    {
+      float inv = 1.0f / det;
+      float du1 = v1->u - v0->u, du2 = v2->u - v0->u;
+      float dv1 = v1->v - v0->v, dv2 = v2->v - v0->v;
+      span.u[0] = (du1 * e2y - du2 * e1y) * inv;
+      span.u[1] = (du2 * e1x - du1 * e2x) * inv;
+      span.u[2] = v0->u - span.u[0] * v0->x - span.u[1] * v0->y;
+      span.v[0] = (dv1 * e2y - dv2 * e1y) * inv;
+      span.v[1] = (dv2 * e1x - dv1 * e2x) * inv;
+      span.v[2] = v0->v - span.v[0] * v0->x - span.v[1] * v0->y;
+    }
+
+    rtnvg__rasterizeEdges(rt, s, e, ne, b, NVG_NONZERO, span);
+  }
+
+  for (y = rect[1]; y < rect[3]; y++) {
+    unsigned char *dst = &rt->pixels[y * rt->stride + 4 * rect[0]];
+    const float *src = &span.accum[4 * (y - rect[1]) * span.aw];
+    for (x = rect[0]; x < rect[2]; x++, dst += 4, src += 4) {
+      if (src[0] > 0.0f || src[1] > 0.0f || src[2] > 0.0f || src[3] > 0.0f)
+        rtnvg__blendPixel(dst, src, &span.paint);
+    }
+  }
+}
+
+// Coverage of the pixel centered at (px, py) by the shape grown by d, or
+// shrunk for negative d. Straight edges get the exact pixel area, rounded
+// corners and ellipses the signed distance clamped to the pixel. Without aa
+// the pixel is either in or out, as decided by its center.
+static float rtnvg__shapeCoverage(const NVGshape *sh, float d, int aa,
+                                  float px, float py) {
+  float hx = sh->hx + d, hy = sh->hy + d;
+  float dx = fabsf(px - sh->cx), dy = fabsf(py - sh->cy);
+  float cov, sd;
+  if (hx <= 0.0f || hy <= 0.0f)
+    return 0.0f;
+
+  if (sh->type == NVG_SHAPE_ELLIPSE) {
+    if (hx == hy) {
+      sd = sqrtf(dx * dx + dy * dy) - hx;
+    } else {
+      // Distance estimate of the ellipse, f / |grad f|.
+      float k0 = sqrtf(dx * dx / (hx * hx) + dy * dy / (hy * hy));
+      float k1 = sqrtf(dx * dx / (hx * hx * hx * hx) +
+                       dy * dy / (hy * hy * hy * hy));
+      sd = k1 > 0.0f ? k0 * (k0 - 1.0f) / k1 : -std::min(hx, hy);
+    }
+    if (!aa)
+      return sd < 0.0f ? 1.0f : 0.0f;
+    return fclamp(0.5f - sd, 0.0f, 1.0f);
+  }
+
+  if (!aa)
+    cov = dx < hx && dy < hy ? 1.0f : 0.0f;
+  else
+    cov = fclamp(std::min(hx, dx + 0.5f) + std::min(hx, 0.5f - dx), 0.0f,
+                 1.0f) *
+          fclamp(std::min(hy, dy + 0.5f) + std::min(hy, 0.5f - dy), 0.0f,
+                 1.0f);
+  if (sh->type == NVG_SHAPE_ROUNDEDRECT && cov > 0.0f) {
+    float r = std::min(std::min(sh->radius + d, hx), hy);
+    float qx = dx - (hx - r), qy = dy - (hy - r);
+    if (r > 0.0f && qx > 0.0f && qy > 0.0f) {
+      sd = sqrtf(qx * qx + qy * qy) - r;
+      if (!aa)
+        cov = sd < 0.0f ? 1.0f : 0.0f;
+      else
+        cov = std::min(cov, fclamp(0.5f - sd, 0.0f, 1.0f));
+    }
+  }
+  return cov;
+}
+
+// Columns [band[0], band[1]) whose pixels lie between the rounded corners
+// of the shape grown by d, where coverage only depends on the row.
+static void rtnvg__shapeBand(const NVGshape *sh, float d, int *band) {
+  float hx = sh->hx + d, hy = sh->hy + d, r = 0.0f;
+  if (sh->type == NVG_SHAPE_ELLIPSE || hx <= 0.0f || hy <= 0.0f) {
+    band[0] = band[1] = 0;
+    return;
+  }
+  if (sh->type == NVG_SHAPE_ROUNDEDRECT)
+    r = std::max(std::min(std::min(sh->radius + d, hx), hy), 0.0f);
+  band[0] = (int)ceilf(sh->cx - (hx - r));
+  band[1] = (int)floorf(sh->cx + (hx - r));
+}
+
+// Draws a RTNVG_SHAPE call into rect without building any edges. Strokes
+// are the shape grown by half the width minus the shape shrunk by it.
+static void rtnvg__shapeCall(RTNVGcontext *rt, RTNVGscratch *s,
+                             RTNVGcall *call, const int *rect) {
+  const NVGshape *sh = &call->shape;
+  int aa = rtnvg__edgeCoverage(rt);
+  float d = call->strokeWidth * 0.5f;
+  float *cover = s->cover;
+  RTNVGshadeSpan span;
+  int band[2], inner[2];
+  int x, y, x0;
+
+  span.rt = rt;
+  rtnvg__shadeState(rt, call, nvg__fragUniformPtr(rt, call->uniformOffset),
+                    &span.paint);
+  span.kernels = rtnvg__spanKernels();
+
+  rtnvg__shapeBand(sh, d, band);
+  if (d > 0.0f && sh->hx > d && sh->hy > d) {
+    rtnvg__shapeBand(sh, -d, inner);
+    band[0] = rtnvg__maxi(band[0], inner[0]);
+    band[1] = std::min(band[1], inner[1]);
+  }
+  band[0] = rtnvg__maxi(band[0], rect[0]);
+  band[1] = rtnvg__maxi(std::min(band[1], rect[2]), band[0]);
+
+  for (y = rect[1]; y < rect[3]; y++) {
+    float py = (float)y + 0.5f;
+    float c;
+    for (x = rect[0]; x < rect[2]; x++) {
+      float px = (float)x + 0.5f;
+      if (x == band[0] && band[0] < band[1]) {
+        // Same coverage as the center column all the way through the band.
+        c = rtnvg__shapeCoverage(sh, d, aa, sh->cx, py);
+        if (d > 0.0f && c > 0.0f)
+          c -= rtnvg__shapeCoverage(sh, -d, aa, sh->cx, py);
+        for (; x < band[1]; x++)
+          cover[x] = c;
+        x--;
+        continue;
+      }
+      c = rtnvg__shapeCoverage(sh, d, aa, px, py);
+      if (d > 0.0f && c > 0.0f)
+        c -= rtnvg__shapeCoverage(sh, -d, aa, px, py);
+      cover[x] = c;
+    }
+    // Shade the covered runs only, e.g. skip the inside of strokes.
+    for (x = rect[0]; x < rect[2];) {
+      if (cover[x] <= 0.0f) {
+        x++;
+        continue;
+      }
+      for (x0 = x; x < rect[2] && cover[x] > 0.0f; x++)
+        ;
+      span(y, x0, x, cover);
+    }
+  }
+  // The edge rasterizer expects a cleared row buffer.
+  memset(&cover[rect[0]], 0, sizeof(float) * (rect[2] - rect[0]));
+}
+
+// Coverage of the pixel centered at p by one stroke segment of half width
+// hw, starting at a with unit direction (ux, uy) and length len. Segment
+// ends shared with a neighbour are rounded, which keeps joins closed; the
+// free ends of open paths get the cap, extended by ext.
+static float rtnvg__segmentCoverage(const NVGvertex *a, float ux, float uy,
+                                    float len, float hw, int capA, int capB,
+                                    float ext, int aa, float px, float py) {
+  float qx = px - a->x, qy = py - a->y;
+  float t = qx * ux + qy * uy;
+  float sp = qx * uy - qy * ux;
+  float c;
+
+  if ((t < 0.0f && !capA) || (t > len && !capB)) {
+    float d;
+    if (t > len) {
+      qx -= ux * len;
+      qy -= uy * len;
+    }
+    d = sqrtf(qx * qx + qy * qy);
+    return aa ? fclamp(hw + 0.5f - d, 0.0f, 1.0f) : (d < hw ? 1.0f : 0.0f);
+  }
+  if (!aa) {
+    // Half open across the line, so lines on pixel edges cover one row.
+    if (sp <= -hw || sp > hw)
+      return 0.0f;
+    if ((capA && t < -ext) || (capB && t >= len + ext))
+      return 0.0f;
+    return 1.0f;
+  }
+  c = fclamp(hw + 0.5f - fabsf(sp), 0.0f, 1.0f);
+  if (capA)
+    c = std::min(c, fclamp(t + ext + 0.5f, 0.0f, 1.0f));
+  if (capB)
+    c = std::min(c, fclamp(len + ext + 0.5f - t, 0.0f, 1.0f));
+  return c;
+}
+
+// Draws a RTNVG_LINES call into rect. Every row takes the maximum coverage
+// of the segments near it instead of their sum, so joins and overlaps of
+// the stroke blend once.
+static void rtnvg__linesCall(RTNVGcontext *rt, RTNVGscratch *s,
+                             RTNVGcall *call, const int *rect) {
+  const RTNVGpath *paths = &rt->paths[call->pathOffset];
+  int aa = rtnvg__edgeCoverage(rt);
+  float hw = call->strokeWidth * 0.5f;
+  float ext = call->lineCap == NVG_SQUARE ? hw : 0.0f;
+  float r = hw + ext + 1.0f;
+  float *cover = s->cover;
+  RTNVGshadeSpan span;
+  int i, j, x, y, x0;
+
+  span.rt = rt;
+  rtnvg__shadeState(rt, call, nvg__fragUniformPtr(rt, call->uniformOffset),
+                    &span.paint);
+  span.kernels = rtnvg__spanKernels();
+
+  for (y = rect[1]; y < rect[3]; y++) {
+    float py = (float)y + 0.5f;
+    int xmin = rect[2], xmax = rect[0];
+
+    for (i = 0; i < call->pathCount; i++) {
+      const NVGvertex *v = &rt->verts[paths[i].strokeOffset];
+      int n = paths[i].strokeCount;
+      int nseg = paths[i].closed ? n : n - 1;
+      for (j = 0; j < nseg; j++) {
+        const NVGvertex *a = &v[j], *b = &v[(j + 1) % n];
+        int capA = !paths[i].closed && j == 0 && call->lineCap != NVG_ROUND;
+        int capB =
+            !paths[i].closed && j == n - 2 && call->lineCap != NVG_ROUND;
+        float ya = std::min(a->y, b->y), yb = std::max(a->y, b->y);
+        float ux = b->x - a->x, uy = b->y - a->y, len;
+        float xa, xb;
+        int xl, xr;
+        if (ya - r > (float)y + 1.0f || yb + r < (float)y)
+          continue;
+        // Degenerate segments are dots at a join, or nothing between caps.
+        len = sqrtf(ux * ux + uy * uy);
+        if (len > 1e-6f) {
+          ux /= len;
+          uy /= len;
+        } else if (capA || capB) {
+          continue;
+        }
+        // X extent of the segment within the rows it can reach from here.
+        if (a->y == b->y) {
+          xa = std::min(a->x, b->x);
+          xb = std::max(a->x, b->x);
+        } else {
+          float dxdy = (b->x - a->x) / (b->y - a->y);
+          float t0 = fclamp((float)y - r, ya, yb);
+          float t1 = fclamp((float)y + 1.0f + r, ya, yb);
+          float x0f = a->x + (t0 - a->y) * dxdy;
+          float x1f = a->x + (t1 - a->y) * dxdy;
+          xa = std::min(x0f, x1f);
+          xb = std::max(x0f, x1f);
+        }
+        xl = rtnvg__maxi((int)floorf(xa - r), rect[0]);
+        xr = std::min((int)ceilf(xb + r), rect[2]);
+        for (x = xl; x < xr; x++) {
+          float c = rtnvg__segmentCoverage(a, ux, uy, len, hw, capA, capB,
+                                           ext, aa, (float)x + 0.5f, py);
+          if (c > cover[x])
+            cover[x] = c;
+        }
+        xmin = std::min(xmin, xl);
+        xmax = rtnvg__maxi(xmax, xr);
+      }
+    }
+
+    // Shade the covered runs and clear the row for the next one.
+    for (x = xmin; x < xmax;) {
+      if (cover[x] <= 0.0f) {
+        x++;
+        continue;
+      }
+      for (x0 = x; x < xmax && cover[x] > 0.0f; x++)
+        ;
+      span(y, x0, x, cover);
+    }
+    if (xmin < xmax)
+      memset(&cover[xmin], 0, sizeof(float) * (xmax - xmin));
+  }
+}
+
+// Draws a prepared call into the pixels of clip (l,t,r,b).
+static void rtnvg__scanlineCall(RTNVGcontext *rt, RTNVGscratch *s,
+                                RTNVGcall *call, const int *clip) {
+  int rect[4];
+  rect[0] = rtnvg__maxi(call->bounds[0], clip[0]);
+  rect[1] = rtnvg__maxi(call->bounds[1], clip[1]);
+  rect[2] = std::min(call->bounds[2], clip[2]);
+  rect[3] = std::min(call->bounds[3], clip[3]);
+  if (rect[0] >= rect[2] || rect[1] >= rect[3])
+    return;
+
+  if (call->type == RTNVG_TRIANGLES) {
+    rtnvg__scanlineTriangles(rt, s, call, rect);
+  } else if (call->type == RTNVG_SHAPE) {
+    rtnvg__shapeCall(rt, s, call, rect);
+  } else if (call->type == RTNVG_LINES) {
+    rtnvg__linesCall(rt, s, call, rect);
+  } else {
+    // Fills keep the paint in their second uniform, after the stencil one.
+    int uniform = call->uniformOffset;
+    RTNVGshadeSpan span;
+    if (call->type == RTNVG_FILL)
+      uniform += rt->fragSize;
+    span.rt = rt;
+    rtnvg__shadeState(rt, call, nvg__fragUniformPtr(rt, uniform),
+                      &span.paint);
+    span.kernels = rtnvg__spanKernels();
+    rtnvg__rasterizeEdges(rt, s, &rt->edges[call->edgeOffset],
+                          call->edgeCount, rect, call->fillRule, span);
+  }
+}
+
+static int rtnvg__allocScratch(RTNVGcontext *rt, int n) {
+  if (n > rt->nscratch) {
+    RTNVGscratch *scratch =
+        (RTNVGscratch *)realloc(rt->scratch, sizeof(RTNVGscratch) * n);
+    if (scratch == NULL)
+      return 0;
+    memset(&scratch[rt->nscratch], 0,
+           sizeof(RTNVGscratch) * (n - rt->nscratch));
+    rt->scratch = scratch;
+    rt->nscratch = n;
+  }
+  return 1;
+}
+
+// Sorts the calls into RTNVG_TILE_SIZE tiles, keeping call order per tile.
+static int rtnvg__binCalls(RTNVGcontext *rt, int tw, int th) {
+  int i, tx, ty, total = 0, ntiles = tw * th;
+
+  if (ntiles + 1 > rt->ctileStart) {
+    int *tileStart = (int *)realloc(rt->tileStart, sizeof(int) * (ntiles + 1));
+    if (tileStart == NULL)
+      return 0;
+    rt->tileStart = tileStart;
+    rt->ctileStart = ntiles + 1;
+  }
+  memset(rt->tileStart, 0, sizeof(int) * (ntiles + 1));
+
+  for (i = 0; i < rt->ncalls; i++) {
+    const int *b = rt->calls[i].bounds;
+    if (b[0] >= b[2] || b[1] >= b[3])
+      continue;
+    for (ty = b[1] / RTNVG_TILE_SIZE; ty <= (b[3] - 1) / RTNVG_TILE_SIZE; ty++)
+      for (tx = b[0] / RTNVG_TILE_SIZE; tx <= (b[2] - 1) / RTNVG_TILE_SIZE;
+           tx++)
+        rt->tileStart[ty * tw + tx + 1]++;
+  }
+  for (i = 0; i < ntiles; i++)
+    rt->tileStart[i + 1] += rt->tileStart[i];
+  total = rt->tileStart[ntiles];
+
+  if (total > rt->ctileCalls) {
+    int *tileCalls = (int *)realloc(rt->tileCalls, sizeof(int) * total);
+    if (tileCalls == NULL)
+      return 0;
+    rt->tileCalls = tileCalls;
+    rt->ctileCalls = total;
+  }
+
+  // Fill from the back of each bin so that earlier calls end up first.
+  for (i = rt->ncalls - 1; i >= 0; i--) {
+    const int *b = rt->calls[i].bounds;
+    if (b[0] >= b[2] || b[1] >= b[3])
+      continue;
+    for (ty = b[1] / RTNVG_TILE_SIZE; ty <= (b[3] - 1) / RTNVG_TILE_SIZE; ty++)
+      for (tx = b[0] / RTNVG_TILE_SIZE; tx <= (b[2] - 1) / RTNVG_TILE_SIZE;
+           tx++)
+        rt->tileCalls[--rt->tileStart[ty * tw + tx + 1]] = i;
+  }
+  // tileStart[t + 1] now points at the first call of tile t; shift back.
+  for (i = 0; i < ntiles; i++)
+    rt->tileStart[i] = rt->tileStart[i + 1];
+  rt->tileStart[ntiles] = total;
+
+  return 1;
+}
+
+// The worker pool of NVG_TILED contexts, created on first use. NULL when
+// running on the calling thread only.
+static RTNVGworkerPool *rtnvg__workers(RTNVGcontext *rt) {
+  if (!(rt->flags & NVG_TILED))
+    return NULL;
+  if (rt->workers == NULL) {
+    int nthreads = rt->nthreads;
+    if (nthreads <= 0)
+      nthreads = (int)std::thread::hardware_concurrency();
+    if (nthreads > 1)
+      rt->workers = new RTNVGworkerPool(nthreads - 1);
+  }
+  return rt->workers;
+}
+
+static void rtnvg__scanlineFlush(RTNVGcontext *rt) {
+  int i;
+
+  for (i = 0; i < rt->ncalls; i++)
+    rtnvg__prepareCall(rt, &rt->calls[i]);
+
+  if (rtnvg__workers(rt) != NULL) {
+    int tw = (rt->width + RTNVG_TILE_SIZE - 1) / RTNVG_TILE_SIZE;
+    int th = (rt->height + RTNVG_TILE_SIZE - 1) / RTNVG_TILE_SIZE;
+    if (rtnvg__allocScratch(rt, rt->workers->size()) &&
+        rtnvg__binCalls(rt, tw, th)) {
+      rt->workers->run(tw * th, [rt, tw](int tile, int worker) {
+        int clip[4], k;
+        clip[0] = (tile % tw) * RTNVG_TILE_SIZE;
+        clip[1] = (tile / tw) * RTNVG_TILE_SIZE;
+        clip[2] = std::min(rt->width, clip[0] + RTNVG_TILE_SIZE);
+        clip[3] = std::min(rt->height, clip[1] + RTNVG_TILE_SIZE);
+        for (k = rt->tileStart[tile]; k < rt->tileStart[tile + 1]; k++) {
+          RTNVGcall *call = &rt->calls[rt->tileCalls[k]];
+          RTNVGscratch *s = rtnvg__scratch(rt, worker, call->edgeCount);
+          if (s != NULL)
+            rtnvg__scanlineCall(rt, s, call, clip);
+        }
+      });
+      rt->nedges = 0;
+      return;
+    }
+  }
+
+  if (rtnvg__allocScratch(rt, 1)) {
+    int clip[4] = {0, 0, rt->width, rt->height};
+    for (i = 0; i < rt->ncalls; i++) {
+      RTNVGcall *call = &rt->calls[i];
+      RTNVGscratch *s = rtnvg__scratch(rt, 0, call->edgeCount);
+      if (s != NULL)
+        rtnvg__scanlineCall(rt, s, call, clip);
+    }
+  }
+  rt->nedges = 0;
+}
+
+//
+// Frame arena for the geometry handed to nanort. Allocations are bumped off
+// the newest block and all released at once by rtnvg__renderFlush, which
+// also merges the blocks into one, so a steady frame does not allocate.
+//
+
+#define RTNVG_ARENA_ALIGN 16
+#define RTNVG_ARENA_HEADER                                                     \
+  ((sizeof(RTNVGarenaBlock) + RTNVG_ARENA_ALIGN - 1) &                         \
+   ~(size_t)(RTNVG_ARENA_ALIGN - 1))
+
+static RTNVGarenaBlock *rtnvg__arenaBlock(RTNVGcontext *rt, size_t size) {
+  RTNVGarenaBlock *block =
+      (RTNVGarenaBlock *)malloc(RTNVG_ARENA_HEADER + size);
+  if (block == NULL)
+    return NULL;
+  block->next = rt->arena;
+  block->size = size;
+  block->used = 0;
+  rt->arena = block;
+  return block;
+}
+
+static void *rtnvg__arenaAlloc(RTNVGcontext *rt, size_t size) {
+  RTNVGarenaBlock *block = rt->arena;
+  void *ptr;
+  size = (size + RTNVG_ARENA_ALIGN - 1) & ~(size_t)(RTNVG_ARENA_ALIGN - 1);
+  if (block == NULL || block->used + size > block->size) {
+    size_t bsize = block != NULL ? block->size * 2 : 64 * 1024;
+    block = rtnvg__arenaBlock(rt, size > bsize ? size : bsize);
+    if (block == NULL)
+      return NULL;
+  }
+  ptr = (unsigned char *)block + RTNVG_ARENA_HEADER + block->used;
+  block->used += size;
+  return ptr;
+}
+
+static void rtnvg__arenaFree(RTNVGcontext *rt) {
+  while (rt->arena != NULL) {
+    RTNVGarenaBlock *next = rt->arena->next;
+    free(rt->arena);
+    rt->arena = next;
+  }
+}
+
+static void rtnvg__arenaReset(RTNVGcontext *rt) {
+  RTNVGarenaBlock *block;
+  size_t total = 0;
+  if (rt->arena == NULL)
+    return;
+  if (rt->arena->next == NULL) {
+    rt->arena->used = 0;
+    return;
+  }
+  // The frame needed several blocks, replace them with one that fits all.
+  for (block = rt->arena; block != NULL; block = block->next)
+    total += block->size;
+  rtnvg__arenaFree(rt);
+  rtnvg__arenaBlock(rt, total);
+}
+
+// Calls with more triangles build their BVH on the NVG_TILED worker pool.
+#define RTNVG_PARALLEL_BUILD_FACES (1024 * 16)
+
+// The BVH of the call being ray cast, its buffers are reused across calls.
+static nanort::BVHAccel *rtnvg__accel(RTNVGcontext *rt) {
+  if (rt->accel == NULL)
+    rt->accel = new nanort::BVHAccel();
+  return rt->accel;
+}
+
+// BVH build options of the ray cast path. NVG_TILED contexts build large
+// BVHs on their worker pool.
+static void rtnvg__buildOptions(RTNVGcontext *rt,
+                                nanort::BVHBuildOptions *options) {
+  RTNVGworkerPool *workers = rtnvg__workers(rt);
+  if (workers == NULL)
+    return;
+  options->minPrimitivesForParallelBuild = RTNVG_PARALLEL_BUILD_FACES;
+  options->parallelFor = [workers](int count,
+                                   const std::function<void(int)> &job) {
+    workers->run(count, [&job](int i, int) { job(i); });
+  };
+}
+
+//
+// Coverage mask anti-aliasing of the ray cast path (NVG_MSAA_*). Instead of
+// casting a ray per sample, the triangles overlapping a pixel are fetched
+// from the BVH once and the sample pattern is tested against each of them.
+//
+
+// Standard sample positions, in 1/16 pixel from the pixel center.
+static const signed char rtnvg__samples4[4][2] = {
+    {-2, -6}, {6, -2}, {-6, 2}, {2, 6}};
+static const signed char rtnvg__samples8[8][2] = {
+    {1, -3}, {-1, 3}, {5, 1}, {-3, -5}, {-5, 5}, {-7, -1}, {3, 7}, {7, -7}};
+static const signed char rtnvg__samples16[16][2] = {
+    {1, 1},   {-1, -3}, {-3, 2},  {4, -1}, {-5, -2}, {2, 5},
+    {5, 3},   {3, -5},  {-2, 6},  {0, -7}, {-4, -6}, {-6, 4},
+    {-8, 0},  {7, -4},  {6, 7},   {-7, -8}};
+
+// Samples per pixel of the NVG_MSAA_* flags, 0 without coverage masks.
+static int rtnvg__sampleCount(int flags) {
+  if (flags & NVG_MSAA_16X)
+    return 16;
+  if (flags & NVG_MSAA_8X)
+    return 8;
+  if (flags & NVG_MSAA_4X)
+    return 4;
+  return 0;
+}
+
+static const signed char (*rtnvg__samplePattern(int nsamples))[2] {
+  if (nsamples == 16)
+    return rtnvg__samples16;
+  if (nsamples == 8)
+    return rtnvg__samples8;
+  return rtnvg__samples4;
+}
+
+static int rtnvg__popcount(unsigned int m) {
+  int n = 0;
+  for (; m != 0; m &= m - 1)
+    n++;
+  return n;
+}
+
+// Bitmask of the samples of pixel (x, y) inside triangle f. Samples right on
+// an edge go to one side only, so triangles sharing the edge never both
+// cover them.
+static unsigned int rtnvg__triangleMask(const float *vertices,
+                                        const unsigned int *faces,
+                                        unsigned int f, int x, int y,
+                                        const signed char (*pos)[2],
+                                        int nsamples) {
+  const float *v[3];
+  float ex[3], ey[3];
+  unsigned int mask = 0;
+  int i, k;
+  v[0] = &vertices[3 * faces[3 * f + 0]];
+  v[1] = &vertices[3 * faces[3 * f + 1]];
+  v[2] = &vertices[3 * faces[3 * f + 2]];
+  float area = (v[1][0] - v[0][0]) * (v[2][1] - v[0][1]) -
+               (v[1][1] - v[0][1]) * (v[2][0] - v[0][0]);
+  if (area == 0.0f)
+    return 0;
+  if (area < 0.0f)
+    std::swap(v[1], v[2]);
+  for (k = 0; k < 3; k++) {
+    ex[k] = v[(k + 1) % 3][0] - v[k][0];
+    ey[k] = v[(k + 1) % 3][1] - v[k][1];
+  }
+  for (i = 0; i < nsamples; i++) {
+    float px = (float)x + 0.5f + (float)pos[i][0] * (1.0f / 16.0f);
+    float py = (float)y + 0.5f + (float)pos[i][1] * (1.0f / 16.0f);
+    for (k = 0; k < 3; k++) {
+      float e = ex[k] * (py - v[k][1]) - ey[k] * (px - v[k][0]);
+      if (e < 0.0f || (e == 0.0f && !(ey[k] > 0.0f ||
+                                       (ey[k] == 0.0f && ex[k] < 0.0f))))
+        break;
+    }
+    if (k == 3)
+      mask |= 1u << i;
+  }
+  return mask;
+}
+
+// Covers the pixels of bound with an odd number of triangles over them,
+// same as the odd hit count test of the single sample ray casts.
+static void rtnvg__maskCoverage(RTNVGcontext *rt, nanort::BVHAccel &accel,
+                                const float *vertices,
+                                const unsigned int *faces, const int *bound,
+                                const RTNVGshadeState *paint) {
+  int nsamples = rtnvg__sampleCount(rt->flags);
+  const signed char(*pos)[2] = rtnvg__samplePattern(nsamples);
+  nanort::StackVector<unsigned int, 128> ids;
+  float bmin[3], bmax[3];
+  bmin[2] = -1.0e+30f;
+  bmax[2] = 1.0e+30f;
+
+  for (int y = bound[1]; y < bound[3]; y++) {
+    for (int x = bound[0]; x < bound[2]; x++) {
+      unsigned int mask = 0;
+      bmin[0] = (float)x;
+      bmin[1] = (float)y;
+      bmax[0] = (float)x + 1.0f;
+      bmax[1] = (float)y + 1.0f;
+      if (!accel.OverlapTraverse(ids, vertices, faces, bmin, bmax))
+        continue;
+      for (size_t i = 0; i < ids->size(); i++)
+        mask ^= rtnvg__triangleMask(vertices, faces, ids[i], x, y, pos,
+                                    nsamples);
+      if (mask != 0) {
+        float col[4], k = (float)rtnvg__popcount(mask) / (float)nsamples;
+        rtnvg__shade(col, paint, (float)x + 0.5f, (float)y + 0.5f, 0.0f,
+                     0.0f);
+        col[0] *= k;
+        col[1] *= k;
+        col[2] *= k;
+        col[3] *= k;
+        rtnvg__blendPixel(&rt->pixels[y * rt->stride + 4 * x], col, paint);
+      }
+    }
+  }
+}
+
+// Triangle calls sum the colors of all triangles over a pixel, each shaded
+// once at the pixel center and weighted by its own coverage.
+static void rtnvg__maskTriangles(RTNVGcontext *rt, nanort::BVHAccel &accel,
+                                 const float *vertices,
+                                 const unsigned int *faces,
+                                 const float *texcoords, const int *bound,
+                                 const RTNVGshadeState *paint) {
+  int nsamples = rtnvg__sampleCount(rt->flags);
+  const signed char(*pos)[2] = rtnvg__samplePattern(nsamples);
+  nanort::StackVector<unsigned int, 128> ids;
+  float bmin[3], bmax[3];
+  bmin[2] = -1.0e+30f;
+  bmax[2] = 1.0e+30f;
+
+  for (int y = bound[1]; y < bound[3]; y++) {
+    for (int x = bound[0]; x < bound[2]; x++) {
+      float px = (float)x + 0.5f, py = (float)y + 0.5f;
+      float pixelCol[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+      bmin[0] = (float)x;
+      bmin[1] = (float)y;
+      bmax[0] = (float)x + 1.0f;
+      bmax[1] = (float)y + 1.0f;
+      if (!accel.OverlapTraverse(ids, vertices, faces, bmin, bmax))
+        continue;
+      for (size_t i = 0; i < ids->size(); i++) {
+        unsigned int f = ids[i];
+        unsigned int mask =
+            rtnvg__triangleMask(vertices, faces, f, x, y, pos, nsamples);
+        if (mask == 0)
+          continue;
+        int f0 = faces[3 * f + 0];
+        int f1 = faces[3 * f + 1];
+        int f2 = faces[3 * f + 2];
+        const float *a = &vertices[3 * f0];
+        const float *b = &vertices[3 * f1];
+        const float *c = &vertices[3 * f2];
+        // Barycentrics of the pixel center, U weights f1 and V weights f2.
+        float d = (b[0] - a[0]) * (c[1] - a[1]) - (b[1] - a[1]) * (c[0] - a[0]);
+        float U = ((px - a[0]) * (c[1] - a[1]) - (py - a[1]) * (c[0] - a[0])) / d;
+        float V = ((b[0] - a[0]) * (py - a[1]) - (b[1] - a[1]) * (px - a[0])) / d;
+        float tu = (1.0f - U - V) * texcoords[2 * f0 + 0] +
+                   U * texcoords[2 * f1 + 0] + V * texcoords[2 * f2 + 0];
+        float tv = (1.0f - U - V) * texcoords[2 * f0 + 1] +
+                   U * texcoords[2 * f1 + 1] + V * texcoords[2 * f2 + 1];
+        float fragCol[4], k = (float)rtnvg__popcount(mask) / (float)nsamples;
+        rtnvg__shade(fragCol, paint, px, py, tu, tv);
+        pixelCol[0] += fragCol[0] * k;
+        pixelCol[1] += fragCol[1] * k;
+        pixelCol[2] += fragCol[2] * k;
+        pixelCol[3] += fragCol[3] * k;
+      }
+      if (pixelCol[3] > 0.0f)
+        rtnvg__blendPixel(&rt->pixels[y * rt->stride + 4 * x], pixelCol,
+                          paint);
+    }
+  }
+}
+
+// Concave fills are not ray cast: counting hits along a ray only gives the
+// parity of the covering triangles and loses the sign of the winding. The
+// fill polygons go through the scanline rasterizer instead, whose signed
+// area accumulation resolves nonzero and even-odd coverage in one sweep.
+static void rtnvg__fill(RTNVGcontext *rt, RTNVGcall *call) {
+  int clip[4] = {0, 0, rt->width, rt->height};
+  RTNVGscratch *s;
+
+  rtnvg__prepareCall(rt, call);
+  if (rtnvg__allocScratch(rt, 1)) {
+    s = rtnvg__scratch(rt, 0, call->edgeCount);
+    if (s != NULL)
+      rtnvg__scanlineCall(rt, s, call, clip);
+  }
+  rt->nedges = 0;
+}
+
+// Sets up the rays through the sample (ox, oy) of the pixels [x, x1) of row
+// y, at most NANORT_PACKET_SIZE of them. Returns the number of pixels.
+static int rtnvg__rowPacket(nanort::RayPacket *packet, int x, int x1, int y,
+                            float ox, float oy) {
+  int n = x1 - x;
+  if (n > NANORT_PACKET_SIZE)
+    n = NANORT_PACKET_SIZE;
+  for (int k = 0; k < NANORT_PACKET_SIZE; k++) {
+    packet->org[0][k] = (float)(x + k) + ox;
+    packet->org[1][k] = (float)y + oy;
+    packet->org[2][k] = 1.0f;
+  }
+  // Simple ortho camera.
+  packet->dir[0] = 0.0f;
+  packet->dir[1] = 0.0f;
+  packet->dir[2] = -1.0f;
+  packet->count = n;
+  return n;
+}
+
+// Shades the pixel centers of `bound` covered an odd number of times, the
+// rays of a row are traced a packet at a time.
+static void rtnvg__castParity(RTNVGcontext *rt, nanort::BVHAccel &accel,
+                              const float *vertices, const unsigned int *faces,
+                              const int *bound, const RTNVGshadeState *paint) {
+  // Use multi-hit ray traversal to detect overdraw.
+  nanort::StackVector<nanort::Intersection, 128> isects[NANORT_PACKET_SIZE];
+  nanort::RayPacket packet;
+  int maxIsects = 128;
+
+  for (int y = bound[1]; y < bound[3]; y++) {
+    for (int x = bound[0]; x < bound[2]; x += NANORT_PACKET_SIZE) {
+      int n = rtnvg__rowPacket(&packet, x, bound[2], y, 0.5f, 0.5f);
+      unsigned int hit = accel.MultiHitTraversePacket(isects, maxIsects,
+                                                      vertices, faces, packet);
+      for (int k = 0; k < n; k++) {
+        // odd # of intersections --> valid hit.
+        if ((hit & (1u << k)) && (isects[k]->size() % 2 == 1)) {
+          float col[4];
+          rtnvg__shade(col, paint, packet.org[0][k], packet.org[1][k], 0.0f,
+                       0.0f);
+          rtnvg__blendPixel(&rt->pixels[y * rt->stride + 4 * (x + k)], col,
+                            paint);
+        }
+      }
+    }
+  }
 }
 
 static void rtnvg__convexFill(RTNVGcontext *rt, RTNVGcall *call) {
@@ -1573,6 +3544,9 @@ static void rtnvg__convexFill(RTNVGcontext *rt, RTNVGcall *call) {
   (void)i;
   (void)npaths;
   (void)paths;
+  RTNVGshadeState paint;
+  rtnvg__shadeState(rt, call, nvg__fragUniformPtr(rt, call->uniformOffset),
+                    &paint);
 
   rtnvg__setUniforms(rt, call->uniformOffset, call->image);
   rtnvg__checkError(rt, "convex fill");
@@ -1594,44 +3568,49 @@ static void rtnvg__convexFill(RTNVGcontext *rt, RTNVGcall *call) {
 
   // render
   {
-    std::vector<float> vertices;
-    std::vector<float> texcoords;
-    std::vector<unsigned int> faces;
+    float *vertices;
+    unsigned int *faces;
+    int nverts = 0, nfaces = 0;
 
     // Convert geometry to nanort friendly format.
+    for (int k = 0; k < npaths; k++) {
+      nverts += paths[k].fillCount;
+      nfaces += rtnvg__maxi(paths[k].fillCount - 2, 0);
+    }
+    vertices = (float *)rtnvg__arenaAlloc(rt, sizeof(float) * 3 * nverts);
+    faces = (unsigned int *)rtnvg__arenaAlloc(rt, sizeof(int) * 3 * nfaces);
+    if (vertices == NULL || faces == NULL)
+      return;
 
     // TRIANGLE_FAN -> TRIANGLES.
+    nverts = nfaces = 0;
     for (int k = 0; k < npaths; k++) {
       int npolys = paths[k].fillCount - 2;
-      int voffset = (int)vertices.size() / 3;
-      for (int n = 0; n < npolys; n++) {
-        faces.push_back(voffset + 0);
-        faces.push_back(voffset + n + 1);
-        faces.push_back(voffset + n + 2);
+      int voffset = nverts;
+      for (int n = 0; n < npolys; n++, nfaces++) {
+        faces[3 * nfaces + 0] = voffset + 0;
+        faces[3 * nfaces + 1] = voffset + n + 1;
+        faces[3 * nfaces + 2] = voffset + n + 2;
       }
 
-      for (int n = 0; n < paths[k].fillCount; n++) {
-        vertices.push_back(rt->verts[paths[k].fillOffset + n].x);
-        vertices.push_back(rt->verts[paths[k].fillOffset + n].y);
-        vertices.push_back(0.0f);
-        texcoords.push_back(rt->verts[paths[k].fillOffset + n].u);
-        texcoords.push_back(rt->verts[paths[k].fillOffset + n].v);
+      for (int n = 0; n < paths[k].fillCount; n++, nverts++) {
+        vertices[3 * nverts + 0] = rt->verts[paths[k].fillOffset + n].x;
+        vertices[3 * nverts + 1] = rt->verts[paths[k].fillOffset + n].y;
+        vertices[3 * nverts + 2] = 0.0f;
       }
     }
 
-    if (faces.size() > 0) {
-
-      unsigned char *rgba = rt->pixels;
+    if (nfaces > 0) {
 
       nanort::BVHBuildOptions options; // Use default option
+      rtnvg__buildOptions(rt, &options);
 
       // printf("  BVH build option:\n");
       // printf("    # of leaf primitives: %d\n", options.minLeafPrimitives);
       // printf("    SAH binsize         : %d\n", options.binSize);
 
-      nanort::BVHAccel accel;
-      bool ret =
-          accel.Build(&vertices.at(0), &faces.at(0), (unsigned int)faces.size() / 3, options);
+      nanort::BVHAccel &accel = *rtnvg__accel(rt);
+      bool ret = accel.Build(vertices, faces, (unsigned int)nfaces, options);
       assert(ret);
       (void)ret;
 
@@ -1659,47 +3638,15 @@ static void rtnvg__convexFill(RTNVGcontext *rt, RTNVGcall *call) {
       if (bound[1] < 0)           bound[1] = 0;
       if (bound[2] >= rt->width)  bound[2] = rt->width - 1;
       if (bound[3] >= rt->height) bound[3] = rt->height - 1;
+      rtnvg__clipRect(call, bound);
+      if (rtnvg__sampleCount(rt->flags) > 0) {
+        rtnvg__maskCoverage(rt, accel, vertices, faces, bound, &paint);
+        return;
+      }
       // printf("drawFill: triangleOffset: %d, triangleCount: %d\n",
       // call->triangleOffset, call->triangleCount);
       // Shoot rays.
-      for (int y = bound[1]; y < bound[3]; y++) {
-        // bound check
-        if (y < 0) continue;
-        if (y >= rt->height) continue;
-        for (int x = bound[0]; x < bound[2]; x++) {
-          // bound check
-          if (x < 0) continue;
-          if (x >= rt->width) continue;
-
-          // Use multi-hit ray traversal to detect overdraw.
-          nanort::StackVector<nanort::Intersection, 128> isects;
-          int maxIsects = 128;
-
-          // Simple ortho camera.
-
-          nanort::Ray ray;
-          ray.org[0] = x + 0.5f;
-          ray.org[1] = y + 0.5f;
-          ray.org[2] = 1.0f;
-
-          ray.dir[0] = 0.0f;
-          ray.dir[1] = 0.0f;
-          ray.dir[2] = -1.0f;
-
-          bool hit = accel.MultiHitTraverse(isects, maxIsects, &vertices.at(0),
-                                            &faces.at(0), ray);
-
-          // odd # of intersections --> valid hit.
-          if (hit && (isects->size() % 2 == 1)) {
-            float col[4];
-            RTNVGfragUniforms *frag =
-                nvg__fragUniformPtr(rt, call->uniformOffset);
-            rtnvg__shade(col, rt, frag, ray.org[0], ray.org[1], 0.0f, 0.0f,
-                         call->image);
-            rtnvg__alphaBlend(&rgba[4 * (y * rt->width + x)], col);
-          }
-        }
-      }
+      rtnvg__castParity(rt, accel, vertices, faces, bound, &paint);
     }
   }
 }
@@ -1711,6 +3658,9 @@ static void rtnvg__stroke(RTNVGcontext *rt, RTNVGcall *call) {
   (void)i;
   (void)npaths;
   (void)paths;
+  RTNVGshadeState paint;
+  rtnvg__shadeState(rt, call, nvg__fragUniformPtr(rt, call->uniformOffset),
+                    &paint);
 
   if (rt->flags & NVG_STENCIL_STROKES) {
 
@@ -1764,17 +3714,26 @@ static void rtnvg__stroke(RTNVGcontext *rt, RTNVGcall *call) {
 
   // render
   {
-    std::vector<float> vertices;
-    std::vector<float> texcoords;
-    std::vector<unsigned int> faces;
+    float *vertices;
+    unsigned int *faces;
+    int nverts = 0, nfaces = 0;
 
     // Convert geometry to nanort friendly format.
+    for (int k = 0; k < npaths; k++) {
+      nverts += paths[k].strokeCount;
+      nfaces += rtnvg__maxi(paths[k].strokeCount - 2, 0);
+    }
+    vertices = (float *)rtnvg__arenaAlloc(rt, sizeof(float) * 3 * nverts);
+    faces = (unsigned int *)rtnvg__arenaAlloc(rt, sizeof(int) * 3 * nfaces);
+    if (vertices == NULL || faces == NULL)
+      return;
 
     // TRIANGLE_STRIP -> TRIANGLES.
+    nverts = nfaces = 0;
     for (int k = 0; k < npaths; k++) {
       int npolys = paths[k].strokeCount - 2;
-      int voffset = (int)vertices.size() / 3;
-      for (int n = 0; n < npolys; n++) {
+      int voffset = nverts;
+      for (int n = 0; n < npolys; n++, nfaces++) {
         int n0, n1, n2;
         // flip vertex order for even and odd triangle.
         if ((n % 2) == 0) {
@@ -1786,36 +3745,30 @@ static void rtnvg__stroke(RTNVGcontext *rt, RTNVGcall *call) {
           n1 = n + 0;
           n2 = n + 2;
         }
-        faces.push_back(voffset + n0);
-        faces.push_back(voffset + n1);
-        faces.push_back(voffset + n2);
+        faces[3 * nfaces + 0] = voffset + n0;
+        faces[3 * nfaces + 1] = voffset + n1;
+        faces[3 * nfaces + 2] = voffset + n2;
       }
 
-      for (int n = 0; n < paths[k].strokeCount; n++) {
-        vertices.push_back(rt->verts[paths[k].strokeOffset + n].x);
-        vertices.push_back(rt->verts[paths[k].strokeOffset + n].y);
-        vertices.push_back(0.0f);
-        texcoords.push_back(rt->verts[paths[k].strokeOffset + n].u);
-        texcoords.push_back(rt->verts[paths[k].strokeOffset + n].v);
+      for (int n = 0; n < paths[k].strokeCount; n++, nverts++) {
+        vertices[3 * nverts + 0] = rt->verts[paths[k].strokeOffset + n].x;
+        vertices[3 * nverts + 1] = rt->verts[paths[k].strokeOffset + n].y;
+        vertices[3 * nverts + 2] = 0.0f;
       }
     }
 
-    // printf("vertices.size = %d\n", (int)vertices.size() / 3);
-    // printf("faces.size = %d\n", (int)faces.size() / 3);
-
-    if (faces.size() > 0) {
 
-      unsigned char *rgba = rt->pixels;
+    if (nfaces > 0) {
 
       nanort::BVHBuildOptions options; // Use default option
+      rtnvg__buildOptions(rt, &options);
 
       // printf("  BVH build option:\n");
       // printf("    # of leaf primitives: %d\n", options.minLeafPrimitives);
       // printf("    SAH binsize         : %d\n", options.binSize);
 
-      nanort::BVHAccel accel;
-      bool ret =
-          accel.Build(&vertices.at(0), &faces.at(0), (unsigned int)faces.size() / 3, options);
+      nanort::BVHAccel &accel = *rtnvg__accel(rt);
+      bool ret = accel.Build(vertices, faces, (unsigned int)nfaces, options);
       assert(ret);
       (void)ret;
 
@@ -1841,44 +3794,47 @@ static void rtnvg__stroke(RTNVGcontext *rt, RTNVGcall *call) {
       if (bound[1] < 0)           bound[1] = 0;
       if (bound[2] >= rt->width)  bound[2] = rt->width - 1;
       if (bound[3] >= rt->height) bound[3] = rt->height - 1;
-      // Shoot rays.
-      for (int y = bound[1]; y < bound[3]; y++) {
-        for (int x = bound[0]; x < bound[2]; x++) {
-          // Use multi-hit ray traversal to detect overdraw.
-          nanort::StackVector<nanort::Intersection, 128> isects;
-          int maxIsects = 128;
-
-          // Simple ortho camera.
-
-          nanort::Ray ray;
-          ray.org[0] = x + 0.5f;
-          ray.org[1] = y + 0.5f;
-          ray.org[2] = 1.0f;
-
-          ray.dir[0] = 0.0f;
-          ray.dir[1] = 0.0f;
-          ray.dir[2] = -1.0f;
-
-          bool hit = accel.MultiHitTraverse(isects, maxIsects, &vertices.at(0),
-                                            &faces.at(0), ray);
-
-          // odd # of intersections --> valid hit.
-          if (hit && (isects->size() % 2 == 1)) {
-            float col[4];
-            RTNVGfragUniforms *frag =
-                nvg__fragUniformPtr(rt, call->uniformOffset);
-            rtnvg__shade(col, rt, frag, ray.org[0], ray.org[1], 0.0f, 0.0f,
-                         call->image);
-            rtnvg__alphaBlend(&rgba[4 * (y * rt->width + x) + 0], col);
-          }
-        }
+      rtnvg__clipRect(call, bound);
+      if (rtnvg__sampleCount(rt->flags) > 0) {
+        rtnvg__maskCoverage(rt, accel, vertices, faces, bound, &paint);
+        return;
       }
+      // Shoot rays.
+      rtnvg__castParity(rt, accel, vertices, faces, bound, &paint);
     }
   }
 }
 
+// Shapes are evaluated analytically, there is nothing to cast rays at.
+static void rtnvg__shape(RTNVGcontext *rt, RTNVGcall *call) {
+  RTNVGscratch *s;
+  if (!rtnvg__allocScratch(rt, 1))
+    return;
+  s = rtnvg__scratch(rt, 0, 0);
+  if (s == NULL)
+    return;
+  rtnvg__prepareCall(rt, call);
+  if (call->bounds[0] < call->bounds[2] && call->bounds[1] < call->bounds[3])
+    rtnvg__shapeCall(rt, s, call, call->bounds);
+}
+
+static void rtnvg__lines(RTNVGcontext *rt, RTNVGcall *call) {
+  RTNVGscratch *s;
+  if (!rtnvg__allocScratch(rt, 1))
+    return;
+  s = rtnvg__scratch(rt, 0, 0);
+  if (s == NULL)
+    return;
+  rtnvg__prepareCall(rt, call);
+  if (call->bounds[0] < call->bounds[2] && call->bounds[1] < call->bounds[3])
+    rtnvg__linesCall(rt, s, call, call->bounds);
+}
+
 static void rtnvg__triangles(RTNVGcontext *rt, RTNVGcall *call) {
   // printf("__triangles\n");
+  RTNVGshadeState paint;
+  rtnvg__shadeState(rt, call, nvg__fragUniformPtr(rt, call->uniformOffset),
+                    &paint);
   rtnvg__setUniforms(rt, call->uniformOffset, call->image);
   rtnvg__checkError(rt, "triangles fill");
 
@@ -1888,48 +3844,50 @@ static void rtnvg__triangles(RTNVGcontext *rt, RTNVGcall *call) {
 
   // render
   {
-    std::vector<float> vertices;
-    std::vector<float> texcoords;
-    std::vector<unsigned int> faces;
+    int nfaces = call->triangleCount / 3;
+    float *vertices =
+        (float *)rtnvg__arenaAlloc(rt, sizeof(float) * 9 * nfaces);
+    float *texcoords =
+        (float *)rtnvg__arenaAlloc(rt, sizeof(float) * 6 * nfaces);
+    unsigned int *faces =
+        (unsigned int *)rtnvg__arenaAlloc(rt, sizeof(int) * 3 * nfaces);
+    if (vertices == NULL || texcoords == NULL || faces == NULL)
+      return;
 
     // Convert geometry to nanort friendly format.
 
     // TRIANGLES.
     {
-      int npolys = call->triangleCount / 3;
-      for (int n = 0; n < npolys; n++) {
-        faces.push_back(3 * n + 0);
-        faces.push_back(3 * n + 1);
-        faces.push_back(3 * n + 2);
+      for (int n = 0; n < nfaces; n++) {
+        faces[3 * n + 0] = 3 * n + 0;
+        faces[3 * n + 1] = 3 * n + 1;
+        faces[3 * n + 2] = 3 * n + 2;
 
         for (int k = 0; k < 3; k++) {
+          const NVGvertex *v = &rt->verts[call->triangleOffset + 3 * n + k];
           // Adjust Z index to solve triangle overlapping.
-          vertices.push_back(rt->verts[call->triangleOffset + 3 * n + k].x);
-          vertices.push_back(rt->verts[call->triangleOffset + 3 * n + k].y);
-          vertices.push_back(-(float)n);
+          vertices[3 * (3 * n + k) + 0] = v->x;
+          vertices[3 * (3 * n + k) + 1] = v->y;
+          vertices[3 * (3 * n + k) + 2] = -(float)n;
 
-          texcoords.push_back(rt->verts[call->triangleOffset + 3 * n + k].u);
-          texcoords.push_back(rt->verts[call->triangleOffset + 3 * n + k].v);
+          texcoords[2 * (3 * n + k) + 0] = v->u;
+          texcoords[2 * (3 * n + k) + 1] = v->v;
         }
       }
     }
 
-    // printf("vertices.size = %d\n", (int)vertices.size() / 3);
-    // printf("faces.size = %d\n", (int)faces.size() / 3);
-
-    if (faces.size() > 0) {
 
-      unsigned char *rgba = rt->pixels;
+    if (nfaces > 0) {
 
       nanort::BVHBuildOptions options; // Use default option
+      rtnvg__buildOptions(rt, &options);
 
       // printf("  BVH build option:\n");
       // printf("    # of leaf primitives: %d\n", options.minLeafPrimitives);
       // printf("    SAH binsize         : %d\n", options.binSize);
 
-      nanort::BVHAccel accel;
-      bool ret =
-          accel.Build(&vertices.at(0), &faces.at(0), (unsigned int)faces.size() / 3, options);
+      nanort::BVHAccel &accel = *rtnvg__accel(rt);
+      bool ret = accel.Build(vertices, faces, (unsigned int)nfaces, options);
       assert(ret);
       (void)ret;
 
@@ -1955,74 +3913,76 @@ static void rtnvg__triangles(RTNVGcontext *rt, RTNVGcall *call) {
       if (bound[1] < 0)           bound[1] = 0;
       if (bound[2] >= rt->width)  bound[2] = rt->width - 1;
       if (bound[3] >= rt->height) bound[3] = rt->height - 1;
-      // Shoot rays.
-      for (int y = bound[1]; y < bound[3]; y++) {
-        for (int x = bound[0]; x < bound[2]; x++) {
+      rtnvg__clipRect(call, bound);
+      if (rtnvg__sampleCount(rt->flags) > 0) {
+        rtnvg__maskTriangles(rt, accel, vertices, faces, texcoords, bound,
+                             &paint);
+        return;
+      }
+      int nsamples = 1;
+      if (rt->flags & NVG_ANTIALIAS) {
+        nsamples = 2; // 2x2 super sampling.
+      }
 
-          int nsamples = 1;
-          if (rt->flags & NVG_ANTIALIAS) {
-            nsamples = 2; // 2x2 super sampling.
-          }
+      // Use multi-hit ray traversal to detect overdraw.
+      nanort::StackVector<nanort::Intersection, 128> isects[NANORT_PACKET_SIZE];
+      nanort::RayPacket packet;
+      int maxIsects = 128;
 
-          float pixelCol[4] = {0.0f, 0.0f, 0.0f, 0.0f};
+      // Shoot rays, a packet of adjacent pixels at a time.
+      for (int y = bound[1]; y < bound[3]; y++) {
+        for (int x = bound[0]; x < bound[2]; x += NANORT_PACKET_SIZE) {
+          float pixelCol[NANORT_PACKET_SIZE][4];
+          memset(pixelCol, 0, sizeof(pixelCol));
+          int n = 0;
           for (int sy = 0; sy < nsamples; sy++) {
             for (int sx = 0; sx < nsamples; sx++) {
+              n = rtnvg__rowPacket(&packet, x, bound[2], y,
+                                   ((float)sx + 0.5f) / (float)nsamples,
+                                   ((float)sy + 0.5f) / (float)nsamples);
+              unsigned int hit = accel.MultiHitTraversePacket(
+                  isects, maxIsects, vertices, faces, packet);
 
-              // Use multi-hit ray traversal to detect overdraw.
-              nanort::StackVector<nanort::Intersection, 128> isects;
-              int maxIsects = 128;
-
-              // Simple ortho camera.
-
-              nanort::Ray ray;
-              ray.org[0] = x + ((float)sx + 0.5f) / (float)nsamples;
-              ray.org[1] = y + ((float)sy + 0.5f) / (float)nsamples;
-              ray.org[2] = 1.0f;
-
-              ray.dir[0] = 0.0f;
-              ray.dir[1] = 0.0f;
-              ray.dir[2] = -1.0f;
-
-              bool hit = accel.MultiHitTraverse(
-                  isects, maxIsects, &vertices.at(0), &faces.at(0), ray);
-
-              if (hit) {
+              for (int j = 0; j < n; j++) {
+                if (!(hit & (1u << j)))
+                  continue;
 
                 float fragCol[4];
 
                 // Assume larger i => layer in back
-                for (size_t i = 0; i < isects->size(); i++) {
-                  float U = isects[i].u;
-                  float V = isects[i].v;
+                for (size_t i = 0; i < isects[j]->size(); i++) {
+                  float U = isects[j][i].u;
+                  float V = isects[j][i].v;
                   // Compute interpolated texcoord.
-                  int f0 = faces[3 * isects[i].faceID + 0];
-                  int f1 = faces[3 * isects[i].faceID + 1];
-                  int f2 = faces[3 * isects[i].faceID + 2];
+                  int f0 = faces[3 * isects[j][i].faceID + 0];
+                  int f1 = faces[3 * isects[j][i].faceID + 1];
+                  int f2 = faces[3 * isects[j][i].faceID + 2];
                   float tu = (1.0f - U - V) * texcoords[2 * f0 + 0] +
                              U * texcoords[2 * f1 + 0] +
                              V * texcoords[2 * f2 + 0];
                   float tv = (1.0f - U - V) * texcoords[2 * f0 + 1] +
                              U * texcoords[2 * f1 + 1] +
                              V * texcoords[2 * f2 + 1];
-                  RTNVGfragUniforms *frag =
-                      nvg__fragUniformPtr(rt, call->uniformOffset);
-                  rtnvg__shade(fragCol, rt, frag, ray.org[0], ray.org[1], tu,
-                               tv, call->image);
-                  pixelCol[0] += fragCol[0];
-                  pixelCol[1] += fragCol[1];
-                  pixelCol[2] += fragCol[2];
-                  pixelCol[3] += fragCol[3];
+                  rtnvg__shade(fragCol, &paint, packet.org[0][j],
+                               packet.org[1][j], tu, tv);
+                  pixelCol[j][0] += fragCol[0];
+                  pixelCol[j][1] += fragCol[1];
+                  pixelCol[j][2] += fragCol[2];
+                  pixelCol[j][3] += fragCol[3];
                 }
               }
             }
           }
 
           float ndiv = 1.0f / (nsamples * nsamples);
-          pixelCol[0] *= ndiv;
-          pixelCol[1] *= ndiv;
-          pixelCol[2] *= ndiv;
-          pixelCol[3] *= ndiv; // @fixme
-          rtnvg__alphaBlend(&rgba[4 * (y * rt->width + x) + 0], pixelCol);
+          for (int j = 0; j < n; j++) {
+            pixelCol[j][0] *= ndiv;
+            pixelCol[j][1] *= ndiv;
+            pixelCol[j][2] *= ndiv;
+            pixelCol[j][3] *= ndiv; // @fixme
+            rtnvg__blendPixel(&rt->pixels[y * rt->stride + 4 * (x + j)],
+                              pixelCol[j], &paint);
+          }
         }
       }
     }
@@ -2045,22 +4005,32 @@ static void rtnvg__renderFlush(void *uptr) {
   if (rt->ncalls > 0) {
     // printf("nverts = %d\n", rt->nverts);
     // printf("ncalls = %d\n", rt->ncalls);
-    for (int i = 0; i < rt->ncalls; i++) {
-      RTNVGcall *call = &rt->calls[i];
-      if (call->type == RTNVG_FILL)
-        rtnvg__fill(rt, call);
-      else if (call->type == RTNVG_CONVEXFILL)
-        rtnvg__convexFill(rt, call);
-      else if (call->type == RTNVG_STROKE)
-        rtnvg__stroke(rt, call);
-      else if (call->type == RTNVG_TRIANGLES)
-        rtnvg__triangles(rt, call);
+    rtnvg__resolveRamps(rt);
+    if (rt->flags & NVG_SCANLINE) {
+      rtnvg__scanlineFlush(rt);
+    } else {
+      for (int i = 0; i < rt->ncalls; i++) {
+        RTNVGcall *call = &rt->calls[i];
+        if (call->type == RTNVG_FILL)
+          rtnvg__fill(rt, call);
+        else if (call->type == RTNVG_CONVEXFILL)
+          rtnvg__convexFill(rt, call);
+        else if (call->type == RTNVG_STROKE)
+          rtnvg__stroke(rt, call);
+        else if (call->type == RTNVG_TRIANGLES)
+          rtnvg__triangles(rt, call);
+        else if (call->type == RTNVG_SHAPE)
+          rtnvg__shape(rt, call);
+        else if (call->type == RTNVG_LINES)
+          rtnvg__lines(rt, call);
+      }
     }
 
     rtnvg__bindTexture(rt, 0);
   }
 
   // Reset calls
+  rtnvg__arenaReset(rt);
   rt->nverts = 0;
   rt->npaths = 0;
   rt->ncalls = 0;
@@ -2157,9 +4127,34 @@ static void rtnvg__vset(NVGvertex *vtx, float x, float y, float u, float v) {
   vtx->v = v;
 }
 
+// NanoVG flags a path convex when all its turns go the same way, which a
+// self-intersecting star does as well. The ray cast convex fill counts
+// crossings by parity, so it only gets paths that also wind once around,
+// i.e. whose x and y each change direction at most twice.
+static int rtnvg__windsOnce(const NVGvertex *pts, int n) {
+  int flips[2] = {0, 0}, first[2] = {0, 0}, last[2] = {0, 0};
+  for (int i = 0; i < n; i++) {
+    const NVGvertex *a = &pts[i], *b = &pts[(i + 1) % n];
+    int dir[2] = {(b->x > a->x) - (b->x < a->x), (b->y > a->y) - (b->y < a->y)};
+    for (int k = 0; k < 2; k++) {
+      if (dir[k] == 0)
+        continue;
+      if (first[k] == 0)
+        first[k] = dir[k];
+      else if (dir[k] != last[k])
+        flips[k]++;
+      last[k] = dir[k];
+    }
+  }
+  for (int k = 0; k < 2; k++)
+    if (last[k] != first[k])
+      flips[k]++;
+  return flips[0] <= 2 && flips[1] <= 2;
+}
+
 static void rtnvg__renderFill(void *uptr, NVGpaint *paint, NVGcompositeOperationState compositeOperation, NVGscissor *scissor,
                               float fringe, const float *bounds,
-                              const NVGpath *paths, int npaths) {
+                              const NVGpath *paths, int npaths, int fillRule) {
   // printf("__renderFill\n");
   RTNVGcontext *rt = (RTNVGcontext *)uptr;
   RTNVGcall *call = rtnvg__allocCall(rt);
@@ -2176,13 +4171,13 @@ static void rtnvg__renderFill(void *uptr, NVGpaint *paint, NVGcompositeOperation
     goto error;
   call->pathCount = npaths;
   call->image = paint->image;
-  // TODO(syoyo): Implement
-  // call->blendFunc = glnvg_blendCompositeOperation(compositeOperation)
-  (void)compositeOperation;
+  call->fillRule = fillRule;
+  call->compositeOperation = compositeOperation;
 
   // printf("pathOffset = %d\n", call->pathOffset);
 
-  if (npaths == 1 && paths[0].convex)
+  if (npaths == 1 && paths[0].convex &&
+      rtnvg__windsOnce(paths[0].fill, paths[0].nfill))
     call->type = RTNVG_CONVEXFILL;
 
   // Allocate vertices for all the paths.
@@ -2245,14 +4240,14 @@ static void rtnvg__renderFill(void *uptr, NVGpaint *paint, NVGcompositeOperation
     // Fill shader
     rtnvg__convertPaint(
         rt, nvg__fragUniformPtr(rt, call->uniformOffset + rt->fragSize), paint,
-        scissor, fringe, fringe, -1.0f);
+        scissor, fringe, fringe, -1.0f, call->clip);
   } else {
     call->uniformOffset = rtnvg__allocFragUniforms(rt, 1);
     if (call->uniformOffset == -1)
       goto error;
     // Fill shader
     rtnvg__convertPaint(rt, nvg__fragUniformPtr(rt, call->uniformOffset), paint,
-                        scissor, fringe, fringe, -1.0f);
+                        scissor, fringe, fringe, -1.0f, call->clip);
   }
 
   return;
@@ -2283,9 +4278,7 @@ static void rtnvg__renderStroke(void *uptr, NVGpaint *paint,
     goto error;
   call->pathCount = npaths;
   call->image = paint->image;
-  // TODO(syoyo): Implement
-  // call->blendFunc = glnvg_blendCompositeOperation(compositeOperation)
-  (void)compositeOperation;
+  call->compositeOperation = compositeOperation;
 
   // Allocate vertices for all the paths.
   maxverts = rtnvg__maxVertCount(paths, npaths);
@@ -2313,10 +4306,10 @@ static void rtnvg__renderStroke(void *uptr, NVGpaint *paint,
       goto error;
 
     rtnvg__convertPaint(rt, nvg__fragUniformPtr(rt, call->uniformOffset), paint,
-                        scissor, strokeWidth, fringe, -1.0f);
+                        scissor, strokeWidth, fringe, -1.0f, call->clip);
     rtnvg__convertPaint(
         rt, nvg__fragUniformPtr(rt, call->uniformOffset + rt->fragSize), paint,
-        scissor, strokeWidth, fringe, 1.0f - 0.5f / 255.0f);
+        scissor, strokeWidth, fringe, 1.0f - 0.5f / 255.0f, call->clip);
 
   } else {
     // Fill shader
@@ -2324,7 +4317,7 @@ static void rtnvg__renderStroke(void *uptr, NVGpaint *paint,
     if (call->uniformOffset == -1)
       goto error;
     rtnvg__convertPaint(rt, nvg__fragUniformPtr(rt, call->uniformOffset), paint,
-                        scissor, strokeWidth, fringe, -1.0f);
+                        scissor, strokeWidth, fringe, -1.0f, call->clip);
   }
 
   return;
@@ -2350,9 +4343,7 @@ static void rtnvg__renderTriangles(void *uptr, NVGpaint *paint,
 
   call->type = RTNVG_TRIANGLES;
   call->image = paint->image;
-  // TODO(syoyo): Implement
-  // call->blendFunc = glnvg_blendCompositeOperation(compositeOperation)
-  (void)compositeOperation;
+  call->compositeOperation = compositeOperation;
 
   // Allocate vertices for all the paths.
   call->triangleOffset = rtnvg__allocVerts(rt, nverts);
@@ -2367,7 +4358,7 @@ static void rtnvg__renderTriangles(void *uptr, NVGpaint *paint,
   if (call->uniformOffset == -1)
     goto error;
   frag = nvg__fragUniformPtr(rt, call->uniformOffset);
-  rtnvg__convertPaint(rt, frag, paint, scissor, 1.0f, 1.0f, -1.0f);
+  rtnvg__convertPaint(rt, frag, paint, scissor, 1.0f, 1.0f, -1.0f, call->clip);
   frag->type = NSVG_SHADER_IMG;
 
   return;
@@ -2379,6 +4370,89 @@ error:
     rt->ncalls--;
 }
 
+static int rtnvg__renderShape(void *uptr, NVGpaint *paint,
+                              NVGcompositeOperationState compositeOperation,
+                              NVGscissor *scissor, float fringe,
+                              float strokeWidth, const NVGshape *shape) {
+  RTNVGcontext *rt = (RTNVGcontext *)uptr;
+  RTNVGcall *call = rtnvg__allocCall(rt);
+
+  if (call == NULL)
+    return 0;
+
+  call->type = RTNVG_SHAPE;
+  call->image = paint->image;
+  call->compositeOperation = compositeOperation;
+  call->shape = *shape;
+  call->strokeWidth = strokeWidth;
+
+  call->uniformOffset = rtnvg__allocFragUniforms(rt, 1);
+  if (call->uniformOffset == -1)
+    goto error;
+  rtnvg__convertPaint(rt, nvg__fragUniformPtr(rt, call->uniformOffset), paint,
+                      scissor, strokeWidth > 0.0f ? strokeWidth : fringe,
+                      fringe, -1.0f, call->clip);
+
+  return 1;
+
+error:
+  // Roll back the call, nanovg then tessellates the shape instead.
+  if (rt->ncalls > 0)
+    rt->ncalls--;
+  return 0;
+}
+
+static int rtnvg__renderHairline(void *uptr, NVGpaint *paint,
+                                 NVGcompositeOperationState compositeOperation,
+                                 NVGscissor *scissor, float fringe,
+                                 float strokeWidth, int lineCap,
+                                 const NVGpath *paths, int npaths) {
+  RTNVGcontext *rt = (RTNVGcontext *)uptr;
+  RTNVGcall *call = rtnvg__allocCall(rt);
+  int i, offset;
+
+  if (call == NULL)
+    return 0;
+
+  call->type = RTNVG_LINES;
+  call->pathOffset = rtnvg__allocPaths(rt, npaths);
+  if (call->pathOffset == -1)
+    goto error;
+  call->pathCount = npaths;
+  call->image = paint->image;
+  call->compositeOperation = compositeOperation;
+  call->strokeWidth = strokeWidth;
+  call->lineCap = lineCap;
+
+  offset = rtnvg__allocVerts(rt, rtnvg__maxVertCount(paths, npaths));
+  if (offset == -1)
+    goto error;
+  for (i = 0; i < npaths; i++) {
+    RTNVGpath *copy = &rt->paths[call->pathOffset + i];
+    const NVGpath *path = &paths[i];
+    memset(copy, 0, sizeof(RTNVGpath));
+    copy->strokeOffset = offset;
+    copy->strokeCount = path->nstroke;
+    copy->closed = path->closed;
+    memcpy(&rt->verts[offset], path->stroke, sizeof(NVGvertex) * path->nstroke);
+    offset += path->nstroke;
+  }
+
+  call->uniformOffset = rtnvg__allocFragUniforms(rt, 1);
+  if (call->uniformOffset == -1)
+    goto error;
+  rtnvg__convertPaint(rt, nvg__fragUniformPtr(rt, call->uniformOffset), paint,
+                      scissor, strokeWidth, fringe, -1.0f, call->clip);
+
+  return 1;
+
+error:
+  // Roll back the call, nanovg then expands the stroke instead.
+  if (rt->ncalls > 0)
+    rt->ncalls--;
+  return 0;
+}
+
 static void rtnvg__renderDelete(void *uptr) {
   // printf("__renderDelete\n");
   RTNVGcontext *rt = (RTNVGcontext *)uptr;
@@ -2392,8 +4466,9 @@ static void rtnvg__renderDelete(void *uptr) {
   //	glDeleteBuffers(1, &rt->vertBuf);
 
   for (i = 0; i < rt->ntextures; i++) {
-    // if (rt->textures[i].tex != 0 && (rt->textures[i].flags &
-    // NVG_IMAGE_NODELETE) == 0)
+    if (rt->textures[i].id != 0 &&
+        (rt->textures[i].flags & NVG_IMAGE_NODELETE) == 0)
+      free(rt->textures[i].data);
     //	glDeleteTextures(1, &rt->textures[i].tex);
   }
   free(rt->textures);
@@ -2402,10 +4477,65 @@ static void rtnvg__renderDelete(void *uptr) {
   free(rt->verts);
   free(rt->uniforms);
   free(rt->calls);
+  free(rt->ownPixels);
+  free(rt->ramps);
+  rtnvg__arenaFree(rt);
+  delete rt->accel;
+  delete rt->workers;
+  for (i = 0; i < rt->nscratch; i++) {
+    free(rt->scratch[i].active);
+    free(rt->scratch[i].cover);
+    free(rt->scratch[i].accum);
+  }
+  free(rt->scratch);
+  free(rt->edges);
+  free(rt->tileStart);
+  free(rt->tileCalls);
 
   free(rt);
 }
 
+// Points the context at the pixels it renders into, its own buffer when
+// pixels is NULL.
+static int rtnvg__setTarget(RTNVGcontext *rt, unsigned char *pixels, int w,
+                            int h, int stride) {
+  if (w <= 0 || h <= 0)
+    return 0;
+  if (pixels == NULL) {
+    int size = w * h * 4;
+    if (size > rt->cownPixels) {
+      unsigned char *own = (unsigned char *)realloc(rt->ownPixels, size);
+      if (own == NULL)
+        return 0;
+      rt->ownPixels = own;
+      rt->cownPixels = size;
+    }
+    pixels = rt->ownPixels;
+    stride = w * 4;
+  } else if (stride < w * 4) {
+    return 0;
+  }
+  rt->pixels = pixels;
+  rt->width = w;
+  rt->height = h;
+  rt->stride = stride;
+  return 1;
+}
+
+static void rtnvg__clear(RTNVGcontext *rt, unsigned char r, unsigned char g,
+                         unsigned char b, unsigned char a) {
+  int x, y;
+  for (y = 0; y < rt->height; y++) {
+    unsigned char *row = &rt->pixels[y * rt->stride];
+    for (x = 0; x < rt->width; x++, row += 4) {
+      row[0] = r;
+      row[1] = g;
+      row[2] = b;
+      row[3] = a;
+    }
+  }
+}
+
 NVGcontext *nvgCreateRT(int flags, int w, int h) {
   NVGparams params;
   NVGcontext *ctx = NULL;
@@ -2426,39 +4556,38 @@ NVGcontext *nvgCreateRT(int flags, int w, int h) {
   params.renderFill = rtnvg__renderFill;
   params.renderStroke = rtnvg__renderStroke;
   params.renderTriangles = rtnvg__renderTriangles;
+  params.renderShape = rtnvg__renderShape;
+  params.renderHairline = rtnvg__renderHairline;
   params.renderDelete = rtnvg__renderDelete;
   params.userPtr = rt;
-  params.edgeAntiAlias = flags & NVG_ANTIALIAS ? 1 : 0;
+  // The scanline rasterizer resolves edge coverage itself, fringes would
+  // only shrink the shapes by half a pixel.
+  params.edgeAntiAlias = (flags & NVG_ANTIALIAS) && !(flags & NVG_SCANLINE) &&
+                                 rtnvg__sampleCount(flags) == 0
+                             ? 1
+                             : 0;
+  // Concave fills always take the signed area sweep.
+  params.concaveFillCoverage = 1;
 
   rt->flags = flags;
 
-  rt->width = w;
-  rt->height = h;
-  rt->pixels = (unsigned char *)malloc(rt->width * rt->height * 4);
-  for (size_t i = 0; i < rt->width * rt->height; i++) {
-    rt->pixels[4 * i + 0] = 0;
-    rt->pixels[4 * i + 1] = 0;
-    rt->pixels[4 * i + 2] = 0;
-    rt->pixels[4 * i + 3] = 255;
-  }
-
-  ctx = nvgCreateInternal(&params);
-  if (ctx == NULL)
+  if (!rtnvg__setTarget(rt, NULL, w, h, 0))
     goto error;
+  rtnvg__clear(rt, 0, 0, 0, 255);
 
+  ctx = nvgCreateInternal(&params);
   return ctx;
 
 error:
-  free(rt->pixels);
-  // 'gl' is freed by nvgDeleteInternal.
-  if (ctx != NULL)
-    nvgDeleteInternal(ctx);
+  // Once nvgCreateInternal ran, 'rt' is freed by rtnvg__renderDelete.
+  if (rt != NULL) {
+    free(rt->ownPixels);
+    free(rt);
+  }
   return NULL;
 }
 
 void nvgDeleteRT(NVGcontext *ctx) {
-  RTNVGcontext *rt = (RTNVGcontext *)nvgInternalParams(ctx)->userPtr;
-  free(rt->pixels);
   // printf("delete\n");
   nvgDeleteInternal(ctx);
 }
@@ -2490,16 +4619,7 @@ unsigned int nvglImageHandle(NVGcontext *ctx, int image) {
 
 void nvgClearBackgroundRT(NVGcontext *ctx, float r, float g, float b, float a) {
   RTNVGcontext *rt = (RTNVGcontext *)nvgInternalParams(ctx)->userPtr;
-  unsigned char red = ftouc(r);
-  unsigned char green = ftouc(g);
-  unsigned char blue = ftouc(b);
-  unsigned char alpha = ftouc(a);
-  for (size_t i = 0; i < rt->width * rt->height; i++) {
-    rt->pixels[4 * i + 0] = red;
-    rt->pixels[4 * i + 1] = green;
-    rt->pixels[4 * i + 2] = blue;
-    rt->pixels[4 * i + 3] = alpha;
-  }
+  rtnvg__clear(rt, ftouc(r), ftouc(g), ftouc(b), ftouc(a));
 }
 
 unsigned char *nvgReadPixelsRT(NVGcontext *ctx) {
@@ -2507,4 +4627,25 @@ unsigned char *nvgReadPixelsRT(NVGcontext *ctx) {
   return rt->pixels;
 }
 
+int nvgBindPixelsRT(NVGcontext *ctx, unsigned char *pixels, int w, int h,
+                    int stride) {
+  RTNVGcontext *rt = (RTNVGcontext *)nvgInternalParams(ctx)->userPtr;
+  return rtnvg__setTarget(rt, pixels, w, h, stride);
+}
+
+int nvgPixelStrideRT(NVGcontext *ctx) {
+  RTNVGcontext *rt = (RTNVGcontext *)nvgInternalParams(ctx)->userPtr;
+  return rt->stride;
+}
+
+void nvgThreadCountRT(NVGcontext *ctx, int nthreads) {
+  RTNVGcontext *rt = (RTNVGcontext *)nvgInternalParams(ctx)->userPtr;
+  if (rt->nthreads == nthreads)
+    return;
+  // The pool is recreated with the new size on the next flush.
+  delete rt->workers;
+  rt->workers = NULL;
+  rt->nthreads = nthreads;
+}
+
 #endif /* NANOVG_RT_IMPLEMENTATION */
@@ -48,8 +48,7 @@ void PopupButton::draw(SDL_Renderer* renderer)
       Color textColor = (mTextColor.a() == 0 ? mTheme->mTextColor : mTextColor);
       if (!mEnabled)
         textColor = mTheme->mDisabledTextColor;
-      int fntsize = (mFontSize < 0 ? mTheme->mButtonFontSize : mFontSize) * 1.5f;
-      mTheme->getTexAndRectUtf8(renderer, _chevronTex, 0, 0, icon.data(), "icons", fntsize, textColor);
+      mTheme->getTexAndRectUtf8(renderer, _chevronTex, 0, 0, icon.data(), mIconFont, textColor);
     }
 
     Vector2i ap = absolutePosition();
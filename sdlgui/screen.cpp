@@ -102,6 +102,8 @@ void Screen::initialize(SDL_Window* window)
 
 Screen::~Screen()
 {
+    if (mTheme && mSDL_Renderer)
+        mTheme->releaseRenderer(mSDL_Renderer);
     __sdlgui_screens.erase(_window);
 }
 
@@ -170,7 +172,7 @@ void Screen::drawWidgets()
               Vector2i pos = widget->absolutePosition() + Vector2i(widget->width() / 2, widget->height() + 10);
 
               float alpha = (std::min(1.0, 2 * (elapsed - 0.5f)) * 0.8) * 255;
-              SDL_SetTextureAlphaMod(_tooltipTex.tex, alpha);
+              SDL_SetTextureAlphaMod(_tooltipTex, alpha);
 
               SDL_Rect bgrect{ pos.x - 2, pos.y - 2 - _tooltipTex.h(), _tooltipTex.w() + 4, _tooltipTex.h() + 4 };
 
@@ -33,7 +33,7 @@ public:
     Screen( SDL_Window* window, const Vector2i &size, const std::string &caption,
             bool resizable = true, bool fullscreen = false);
 
-    /// Release all resources
+    /// Release all resources, the renderer must still be alive
     virtual ~Screen();
 
     /// Get the window titlebar caption
@@ -31,7 +31,7 @@ Vector2i TabHeader::TabButton::preferredSize(SDL_Renderer *ctx) const
     // No need to call nvg font related functions since this is done by the tab header implementation
     int w, h;
     auto theme = const_cast<TabButton*>(this)->mHeader->theme();
-    theme->getUtf8Bounds("sans", mHeader->fontSize(), mLabel.c_str(), &w, &h);
+    theme->getUtf8Bounds(mHeader->mLabelFont, mLabel.c_str(), &w, &h);
    
     int buttonWidth = w + 2 * mHeader->theme()->mTabButtonHorizontalPadding;
     int buttonHeight = h + 2 * mHeader->theme()->mTabButtonVerticalPadding;
@@ -41,20 +41,18 @@ Vector2i TabHeader::TabButton::preferredSize(SDL_Renderer *ctx) const
 void TabHeader::TabButton::calculateVisibleString(SDL_Renderer *renderer) 
 {
     // The size must have been set in by the enclosing tab header.
-    std::string displayedText =  mHeader->theme()->breakText(renderer, mLabel.c_str(), 
-                                                             "sans", mHeader->fontSize(), mSize.x-10);
+    Theme* theme = mHeader->theme();
+    const std::vector<TextRow>& rows = theme->breakLines(mHeader->mLabelFont,
+                                                         mLabel.c_str(), mSize.x - 10, TextBreak::Ellipsis);
 
     mVisibleText.first = mLabel.c_str();
 
     // Check to see if the text need to be truncated.
-    if (displayedText.size() != mLabel.size()) 
+    if (!rows.empty() && rows.front().end != mLabel.size()) 
     {
-      int truncatedWidth = mHeader->theme()->getTextWidth("sans", mHeader->fontSize(), displayedText.c_str());
-      int dotsWidth = mHeader->theme()->getTextWidth("sans", mHeader->fontSize(), dots);
-      
       // Remember the truncated width to know where to display the dots.
-      mVisibleWidth = truncatedWidth;
-      mVisibleText.last = mLabel.c_str() + displayedText.size();
+      mVisibleWidth = rows.front().width;
+      mVisibleText.last = mLabel.c_str() + rows.front().end;
     } 
     else 
     {
@@ -128,7 +126,7 @@ void TabHeader::TabButton::drawAtPosition(SDL_Renderer *renderer, const Vector2i
 
       if (mVisibleText.last != nullptr)
         lb += dots;
-      mHeader->theme()->getTexAndRectUtf8(renderer, _labelTex, 0, 0, lb.c_str(), "sans", mHeader->fontSize(), mHeader->theme()->mTextColor);
+      mHeader->theme()->getTexAndRectUtf8(renderer, _labelTex, 0, 0, lb.c_str(), mHeader->mLabelFont, mHeader->theme()->mTextColor);
     }
 
     if (_labelTex.tex)
@@ -173,6 +171,34 @@ void TabHeader::TabButton::drawInactiveBorderAt(SDL_Renderer *renderer, const Ve
 TabHeader::TabHeader(Widget* parent, const std::string& font)
     : Widget(parent), mFont(font) 
 {
+    updateFontIds();
+}
+
+void TabHeader::setTheme(Theme *theme)
+{
+    Widget::setTheme(theme);
+    updateFontIds();
+}
+
+void TabHeader::setFontSize(int fontSize)
+{
+    Widget::setFontSize(fontSize);
+    updateFontIds();
+    for (auto& tab : mTabButtons)
+        tab.invalidate();
+    _lastLeftActive = _lastRightActive = -1;
+}
+
+void TabHeader::updateFontIds()
+{
+    if (!mTheme)
+    {
+        mLabelFont = mIconFont = kInvalidFont;
+        return;
+    }
+    int iconSize = mFontSize == -1 ? mTheme->mButtonFontSize : mFontSize;
+    mLabelFont = mTheme->fontId("sans", fontSize());
+    mIconFont = mTheme->fontId("icons", iconSize * 1.5f);
 }
 
 void TabHeader::setActiveTab(int tabIndex) 
@@ -472,20 +498,17 @@ void TabHeader::drawControls(SDL_Renderer *renderer)
     // Draw the arrow.
     if (_lastLeftActive != lactive || _lastRightActive != ractive)
     {
-      int fontSize = mFontSize == -1 ? mTheme->mButtonFontSize : mFontSize;
-      float ih = fontSize;
-      ih *= 1.5f;
       if (_lastLeftActive != lactive)
       {
         auto iconLeft = utf8(ENTYPO_ICON_LEFT_BOLD);
-        mTheme->getTexAndRectUtf8(renderer, _leftIcon, 0, 0, iconLeft.data(), "icons", ih, 
+        mTheme->getTexAndRectUtf8(renderer, _leftIcon, 0, 0, iconLeft.data(), mIconFont,
                                   lactive ? mTheme->mTextColor : mTheme->mButtonGradientBotPushed);
       }
 
       if (_lastRightActive != ractive)
       {
         auto iconRight = utf8(ENTYPO_ICON_RIGHT_BOLD);
-        mTheme->getTexAndRectUtf8(renderer, _rightIcon, 0, 0, iconRight.data(), "icons", ih,
+        mTheme->getTexAndRectUtf8(renderer, _rightIcon, 0, 0, iconRight.data(), mIconFont,
                                   ractive ? mTheme->mTextColor : mTheme->mButtonGradientBotPushed);
       }
 
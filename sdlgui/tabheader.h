@@ -34,6 +34,8 @@ public:
 
     void setFont(const std::string& font) { mFont = font; }
     const std::string& font() const { return mFont; }
+    void setTheme(Theme *theme) override;
+    void setFontSize(int fontSize) override;
     bool overflowing() const { return mOverflowing; }
 
     /**
@@ -115,6 +117,8 @@ private:
         const std::string& label() const { return mLabel; }
         void setSize(const Vector2i& size) { mSize = size; }
         const Vector2i& size() const { return mSize; }
+        /// Re-render the label on the next draw
+        void invalidate() { _labelTex.dirty = true; }
 
         Vector2i preferredSize(SDL_Renderer* ctx) const;
         void calculateVisibleString(SDL_Renderer* renderer);
@@ -168,6 +172,9 @@ private:
     void onArrowLeft();
     void onArrowRight();
 
+    /// Resolves the label and arrow fonts after the font size or the theme changed.
+    void updateFontIds();
+
     std::function<void(int)> mCallback;
     std::vector<TabButton> mTabButtons;
     int mVisibleStart = 0;
@@ -176,6 +183,8 @@ private:
     bool mOverflowing = false;
 
     std::string mFont;
+    FontId mLabelFont = kInvalidFont;
+    FontId mIconFont = kInvalidFont;
     Texture _leftIcon;
     Texture _rightIcon;
     int _lastLeftActive = -1, _lastRightActive = -1;
@@ -17,6 +17,7 @@
 #include <sdlgui/entypo.h>
 #include <SDL.h>
 #include <regex>
+#include <algorithm>
 #include <iostream>
 
 NAMESPACE_BEGIN(sdlgui)
@@ -45,6 +46,7 @@ TextBox::TextBox(Widget *parent,const std::string &value, const std::string& uni
 {
     if (mTheme) 
       mFontSize = mTheme->mTextBoxFontSize;
+    updateFontId();
     _captionTex.dirty = true;
     _unitsTex.dirty = true;
 }
@@ -61,6 +63,21 @@ void TextBox::setTheme(Theme *theme)
     Widget::setTheme(theme);
     if (mTheme)
         mFontSize = mTheme->mTextBoxFontSize;
+    updateFontId();
+}
+
+void TextBox::setFontSize(int fontSize)
+{
+    Widget::setFontSize(fontSize);
+    updateFontId();
+    _captionTex.dirty = true;
+    _unitsTex.dirty = true;
+    _tempTex.dirty = true;
+}
+
+void TextBox::updateFontId()
+{
+    mFontId = mTheme ? mTheme->fontId("sans", fontSize()) : kInvalidFont;
 }
 
 Vector2i TextBox::preferredSize(SDL_Renderer *ctx) const
@@ -78,7 +95,7 @@ Vector2i TextBox::preferredSize(SDL_Renderer *ctx) const
     }
     else if (!mUnits.empty()) 
     {
-        uw = const_cast<TextBox*>(this)->mTheme->getUtf8Width("sans", fontSize(), mUnits.c_str());
+        uw = const_cast<TextBox*>(this)->mTheme->getUtf8Width(mFontId, mUnits.c_str());
     }
     float sw = 0;
     if (mSpinnable) 
@@ -86,7 +103,7 @@ Vector2i TextBox::preferredSize(SDL_Renderer *ctx) const
         sw = 14.f;
     }
 
-    float ts = const_cast<TextBox*>(this)->mTheme->getUtf8Width("sans", fontSize(), mValue.c_str());
+    float ts = const_cast<TextBox*>(this)->mTheme->getUtf8Width(mFontId, mValue.c_str());
     size.x = size.y + ts + uw + sw;
     return size;
 }
@@ -146,7 +163,7 @@ void TextBox::draw(SDL_Renderer* renderer)
     else if (!mUnits.empty()) 
     {
       if (_unitsTex.dirty)
-        mTheme->getTexAndRectUtf8(renderer, _unitsTex, 0, 0, mUnits.c_str(), "sans", fontSize(), Color(255, mEnabled ? 64 : 32));
+        mTheme->getTexAndRectUtf8(renderer, _unitsTex, 0, 0, mUnits.c_str(), mFontId, Color(255, mEnabled ? 64 : 32));
 
       unitWidth = _unitsTex.w()+2;
       SDL_RenderCopy(renderer, _unitsTex, absolutePosition() + Vector2i(mSize.x - unitWidth, (mSize.y - _unitsTex.h()) * 0.5f));
@@ -216,7 +233,7 @@ void TextBox::draw(SDL_Renderer* renderer)
     drawPos.y += (mSize.y - _captionTex.h()) / 2;
 
     if (_captionTex.dirty)
-      mTheme->getTexAndRectUtf8(renderer, _captionTex, 0, 0, mValue.c_str(), "sans", fontSize(), mEnabled ? mTheme->mTextColor : mTheme->mDisabledTextColor);
+      mTheme->getTexAndRectUtf8(renderer, _captionTex, 0, 0, mValue.c_str(), mFontId, mEnabled ? mTheme->mTextColor : mTheme->mDisabledTextColor);
 
     if (mCommitted) 
     {
@@ -225,7 +242,7 @@ void TextBox::draw(SDL_Renderer* renderer)
     else 
     {
       int w, h;
-      mTheme->getUtf8Bounds("sans", fontSize(), mValueTemp.c_str(), &w, &h);
+      mTheme->getUtf8Bounds(mFontId, mValueTemp.c_str(), &w, &h);
       float textBound[4] = {drawPos.x, drawPos.y, drawPos.x + w, drawPos.y + h};
       float lineh = textBound[3] - textBound[1];
 
@@ -246,7 +263,7 @@ void TextBox::draw(SDL_Renderer* renderer)
         //drawPos.x() = oldDrawPos.x() + mTextOffset;
 
         if (_tempTex.dirty)
-          mTheme->getTexAndRectUtf8(renderer, _tempTex, 0, 0, mValueTemp.c_str(), "sans", fontSize(), mTheme->mTextColor);
+          mTheme->getTexAndRectUtf8(renderer, _tempTex, 0, 0, mValueTemp.c_str(), mFontId, mTheme->mTextColor);
        
         // draw text with offset
         SDL_RenderCopy(renderer, _tempTex, oldDrawPos);
@@ -677,30 +694,56 @@ void TextBox::updateCursor(float lastx, const std::string& str)
         mSelectionPos = -1;
 }
 
+void TextBox::updateCaretOffsets(const std::string& str)
+{
+    size_t from = 0;
+    if (mFontId == mCaretOffsetsFont)
+    {
+        if (str == mCaretOffsetsText)
+            return;
+        size_t n = std::min(str.size(), mCaretOffsetsText.size());
+        while (from < n && str[from] == mCaretOffsetsText[from])
+            from++;
+    }
+
+    mTheme->getUtf8Offsets(mFontId, str, from, mCaretOffsets);
+    mCaretOffsetsText = str;
+    mCaretOffsetsFont = mFontId;
+}
+
 float TextBox::cursorIndex2Position(int index, float lastx, const std::string& str) 
 {
     float pos = 0;
-    if (index >= str.size())
-        pos = _tempTex.w(); // last character
-    else
-        pos = mTheme->getUtf8Width("sans", fontSize(), str.substr(0, index).c_str());;
+    if (index > 0)
+    {
+        updateCaretOffsets(str);
+        pos = mCaretOffsets[std::min<size_t>(index, str.size())];
+    }
 
     return pos;
 }
 
 int TextBox::position2CursorIndex(float posx, float lastx, const std::string& str) 
 {
-    int mCursorId = 0;
-    float caretx = mTheme->getUtf8Width("sans", fontSize(), str.substr(0, mCursorId).c_str());
-    for (int j = 1; j <= str.size(); j++) 
+    updateCaretOffsets(str);
+
+    // Offsets never decrease, so the closest caret is either the first one
+    // at or past posx, or the first one holding the offset just before it.
+    auto it = std::lower_bound(mCaretOffsets.begin(), mCaretOffsets.end(), posx);
+    int mCursorId = (int)(it - mCaretOffsets.begin());
+    if (mCursorId > (int)str.size())
+        mCursorId = (int)str.size();
+    while (mCursorId > 0 && mCaretOffsets[mCursorId - 1] == mCaretOffsets[mCursorId])
+        mCursorId--;
+    if (mCursorId > 0)
     {
-      int glposx = mTheme->getUtf8Width("sans", fontSize(), str.substr(0, j).c_str());
-        if (std::abs(caretx - posx) > std::abs(glposx - posx)) 
-        {
-            mCursorId = j;
-            caretx = mTheme->getUtf8Width("sans", fontSize(), str.substr(0, mCursorId).c_str()); 
-        }
+        int prev = mCursorId - 1;
+        while (prev > 0 && mCaretOffsets[prev - 1] == mCaretOffsets[prev])
+            prev--;
+        if (std::abs(mCaretOffsets[prev] - posx) <= std::abs(mCaretOffsets[mCursorId] - posx))
+            mCursorId = prev;
     }
+    float caretx = mCaretOffsets[mCursorId];
     if (std::abs(caretx - posx) > std::abs(lastx - posx))
         mCursorId = str.size();
 
@@ -68,6 +68,9 @@ public:
     /// Set the \ref Theme used to draw this widget
     void setTheme(Theme *theme) override;
 
+    /// Set the font size of the edited text
+    void setFontSize(int fontSize) override;
+
     /// Set the change callback
     std::function<bool(const std::string& str)> callback() const { return mCallback; }
     void setCallback(const std::function<bool(const std::string& str)> &callback) { mCallback = callback; }
@@ -88,6 +91,9 @@ protected:
     bool deleteSelection();
 
     void updateCursor(float lastx, const std::string& str);
+    void updateCaretOffsets(const std::string& str);
+    /// Resolves mFontId after the font size or the theme changed
+    void updateFontId();
     float cursorIndex2Position(int index, float lastx, const std::string& str);
     int position2CursorIndex(float posx, float lastx, const std::string& str);
 
@@ -117,6 +123,13 @@ protected:
     float mTextOffset;
     double mLastClick;
     int caretLastTickCount = 0;
+    FontId mFontId = kInvalidFont;
+
+    // Caret offset before each byte of the edited text, re-measured from the
+    // first byte that differs from the text it was built for.
+    std::vector<float> mCaretOffsets;
+    std::string mCaretOffsetsText;
+    FontId mCaretOffsetsFont = kInvalidFont;
 
     Texture _captionTex;
     Texture _unitsTex;
@@ -11,15 +11,439 @@
 #include <sdlgui/theme.h>
 #include "resources.h"
 #include <map>
+#include <list>
 #include <string>
+#include <cstring>
+#include <unordered_map>
 
 #include <SDL_ttf.h>
 
+#ifndef SDL_TTF_VERSION_ATLEAST
+#define SDL_TTF_VERSION_ATLEAST(X, Y, Z) 0
+#endif
+
 NAMESPACE_BEGIN(sdlgui)
 
 namespace internal
 {
-  std::map<std::string, TTF_Font*> fonts;
+  // Fonts by FontId, and the ids of each family by point size.
+  struct FontFamily
+  {
+    std::string name;
+    std::vector<FontId> sizes;
+  };
+
+  std::vector<TTF_Font*> fonts;
+  std::vector<FontFamily> families;
+
+  // Extents of recently measured strings, most recent first. The text is
+  // hashed once per lookup, and compared only to rule out a collision.
+  struct TextExtentCache
+  {
+    enum { kCapacity = 4096 };
+
+    struct Entry
+    {
+      size_t key;
+      FontId font;
+      bool utf8;
+      std::string text;
+      int w, h;
+    };
+
+    std::list<Entry> lru;
+    std::unordered_map<size_t, std::list<Entry>::iterator> index;
+    size_t hits = 0, misses = 0;
+
+    static size_t keyOf(FontId font, bool utf8, const char* text)
+    {
+      // FNV-1a over the text, seeded with the font and encoding.
+      size_t h = (size_t)14695981039346656037ULL ^ ((size_t)font * 2 + (utf8 ? 1 : 0));
+      for (const unsigned char* p = (const unsigned char*)text; *p; p++)
+        h = (h ^ *p) * (size_t)1099511628211ULL;
+      return h;
+    }
+
+    int extent(TTF_Font* ttf, FontId font, bool utf8, const char* text, int* w, int* h)
+    {
+      size_t key = keyOf(font, utf8, text);
+      auto it = index.find(key);
+      if (it != index.end())
+      {
+        Entry& e = *it->second;
+        if (e.font == font && e.utf8 == utf8 && e.text == text)
+        {
+          hits++;
+          lru.splice(lru.begin(), lru, it->second);
+          *w = e.w;
+          *h = e.h;
+          return 0;
+        }
+        // Collision, the newer string takes the slot.
+        lru.erase(it->second);
+        index.erase(it);
+      }
+
+      misses++;
+      int ww = 0, hh = 0;
+      int result = utf8 ? TTF_SizeUTF8(ttf, text, &ww, &hh) : TTF_SizeText(ttf, text, &ww, &hh);
+      *w = ww;
+      *h = hh;
+      if (result != 0)
+        return result;
+
+      lru.push_front({ key, font, utf8, text, ww, hh });
+      index[key] = lru.begin();
+      if (lru.size() > kCapacity)
+      {
+        index.erase(lru.back().key);
+        lru.pop_back();
+      }
+      return 0;
+    }
+  };
+
+  TextExtentCache textExtents;
+
+  // Decodes the code point at p and advances past it, U+FFFD for bad input.
+  Uint32 nextUtf8(const char*& p)
+  {
+    const unsigned char* s = (const unsigned char*)p;
+    Uint32 c = *s++;
+    int n = c < 0x80 ? 0 : c < 0xe0 ? 1 : c < 0xf0 ? 2 : 3;
+    if (n > 0)
+    {
+      c &= 0x3f >> n;
+      for (int i = 0; i < n; i++, s++)
+      {
+        if ((*s & 0xc0) != 0x80)
+        {
+          p = (const char*)s;
+          return 0xfffd;
+        }
+        c = (c << 6) | (*s & 0x3f);
+      }
+    }
+    p = (const char*)s;
+    return c;
+  }
+
+  int glyphKerning(TTF_Font* font, Uint32 prev, Uint32 ch)
+  {
+#if SDL_TTF_VERSION_ATLEAST(2, 0, 18)
+    return prev ? TTF_GetFontKerningSizeGlyphs32(font, prev, ch) : 0;
+#else
+    return 0;
+#endif
+  }
+
+  int glyphAdvance(TTF_Font* font, Uint32 ch, int* left = nullptr, int* right = nullptr)
+  {
+    int minx = 0, maxx = 0, miny, maxy, advance = 0;
+#if SDL_TTF_VERSION_ATLEAST(2, 0, 18)
+    TTF_GlyphMetrics32(font, ch, &minx, &maxx, &miny, &maxy, &advance);
+#else
+    TTF_GlyphMetrics(font, (Uint16)ch, &minx, &maxx, &miny, &maxy, &advance);
+#endif
+    if (left)
+      *left = minx;
+    if (right)
+      *right = maxx;
+    return advance;
+  }
+
+  // Pen positions along a row the way TTF_RenderUTF8_Blended places them:
+  // kerned advances, and the whole row moved right by xstart, what sticks
+  // out left of the first pen position. Its box is xstart plus the farther
+  // of the pen and the rightmost glyph edge wide, as TTF_SizeUTF8 measures.
+  struct RowLayout
+  {
+    int pen = 0, xstart = 0, right = 0;
+    Uint32 prev = 0;
+
+    // Returns the pen position of ch, not yet moved by xstart.
+    int add(TTF_Font* font, Uint32 ch, int left, int advance, int glyphRight)
+    {
+      pen += glyphKerning(font, prev, ch);
+      prev = ch;
+      int at = pen;
+      xstart = std::max(xstart, -(pen + left));
+      right = std::max(right, pen + glyphRight);
+      pen += advance;
+      return at;
+    }
+
+    int width() const { return xstart + std::max(right, pen); }
+  };
+
+  // Walks the glyph advances of text once and splits it into rows no wider
+  // than width. In Word mode a row ending at spaces leaves them out, and the
+  // next row starts after them.
+  void breakLines(TTF_Font* font, const char* text, float width, TextBreak mode, std::vector<TextRow>& rows)
+  {
+    const size_t npos = (size_t)-1;
+    int dots = mode == TextBreak::Ellipsis ? 3 * glyphAdvance(font, '.') : 0;
+
+    size_t begin = 0, fitEnd = 0;
+    int pen = 0, fitWidth = 0;
+    size_t spaceBegin = npos, wordBegin = npos;
+    int spacePen = 0, wordPen = 0;
+    bool inSpace = false;
+    Uint32 prev = 0;
+
+    const char* p = text;
+    while (*p)
+    {
+      size_t i = p - text;
+      Uint32 ch = nextUtf8(p);
+      size_t next = p - text;
+
+      if (ch == '\n')
+      {
+        if (mode == TextBreak::Ellipsis)
+        {
+          rows.push_back({ 0, fitEnd, fitWidth });
+          return;
+        }
+        rows.push_back({ begin, i, pen });
+        begin = next;
+        pen = 0;
+        prev = 0;
+        spaceBegin = wordBegin = npos;
+        inSpace = false;
+        continue;
+      }
+
+      int x = pen + glyphKerning(font, prev, ch) + glyphAdvance(font, ch);
+      prev = ch;
+
+      if (mode == TextBreak::Ellipsis)
+      {
+        if (x + dots <= width)
+        {
+          fitEnd = next;
+          fitWidth = x;
+        }
+        if (x > width)
+        {
+          rows.push_back({ 0, fitEnd, fitWidth });
+          return;
+        }
+        pen = x;
+        continue;
+      }
+
+      // The last break opportunity is the run of spaces before wordBegin.
+      bool space = ch == ' ' || ch == '\t';
+      if (space && !inSpace && i > begin)
+      {
+        spaceBegin = i;
+        spacePen = pen;
+        wordBegin = npos;
+      }
+      else if (!space && inSpace && spaceBegin != npos)
+      {
+        wordBegin = i;
+        wordPen = pen;
+      }
+      inSpace = space;
+
+      if (x > width && (!space || mode == TextBreak::Char) && i > begin)
+      {
+        if (mode == TextBreak::Word && wordBegin != npos)
+        {
+          rows.push_back({ begin, spaceBegin, spacePen });
+          begin = wordBegin;
+          x -= wordPen;
+        }
+        else
+        {
+          rows.push_back({ begin, i, pen });
+          begin = i;
+          x -= pen;
+        }
+        spaceBegin = wordBegin = npos;
+      }
+      pen = x;
+    }
+
+    rows.push_back({ mode == TextBreak::Ellipsis ? 0 : begin, (size_t)(p - text), pen });
+  }
+
+  // Rows of recently broken strings, most recent first, found the same way
+  // as text extents.
+  struct LineBreakCache
+  {
+    enum { kCapacity = 256 };
+
+    struct Entry
+    {
+      size_t key;
+      FontId font;
+      TextBreak mode;
+      float width;
+      std::string text;
+      std::vector<TextRow> rows;
+    };
+
+    std::list<Entry> lru;
+    std::unordered_map<size_t, std::list<Entry>::iterator> index;
+
+    const std::vector<TextRow>& rows(TTF_Font* ttf, FontId font, const char* text, float width, TextBreak mode)
+    {
+      size_t key = TextExtentCache::keyOf(font, false, text);
+      key ^= (std::hash<float>()(width) + (size_t)mode) * (size_t)0x9e3779b97f4a7c15ULL;
+      auto it = index.find(key);
+      if (it != index.end())
+      {
+        Entry& e = *it->second;
+        if (e.font == font && e.mode == mode && e.width == width && e.text == text)
+        {
+          lru.splice(lru.begin(), lru, it->second);
+          return e.rows;
+        }
+        lru.erase(it->second);
+        index.erase(it);
+      }
+
+      lru.push_front({ key, font, mode, width, text, {} });
+      index[key] = lru.begin();
+      breakLines(ttf, text, width, mode, lru.front().rows);
+      if (lru.size() > kCapacity)
+      {
+        index.erase(lru.back().key);
+        lru.pop_back();
+      }
+      return lru.front().rows;
+    }
+  };
+
+  LineBreakCache lineBreaks;
+
+#ifdef SDLGUI_GLYPH_ATLAS
+  // Glyphs rasterized once per font and size into shared textures, packed
+  // in shelves. Textures belong to a renderer, so each has its own atlas.
+  struct GlyphAtlas
+  {
+    enum { kPageSize = 1024, kPadding = 1 };
+
+    // A glyph is rasterized like a one character string, so its image
+    // starts left of the pen by the part of the glyph that is, and above the
+    // row top by the part that rises over the ascent.
+    struct Glyph
+    {
+      SDL_Texture* page = nullptr;  // Null for glyphs with no pixels.
+      SDL_Rect src;
+      int left, right;              // Pen to the glyph's leftmost and rightmost edges.
+      int dx, dy;                   // Pen and row top to the image.
+      int advance;
+    };
+
+    SDL_Renderer* renderer = nullptr;
+    std::vector<SDL_Texture*> pages;
+    int shelfX = 0, shelfY = 0, shelfH = 0;
+    std::unordered_map<TTF_Font*, std::unordered_map<Uint32, Glyph>> glyphs;
+
+    bool place(int w, int h, SDL_Rect& rect)
+    {
+      if (w + kPadding > kPageSize || h + kPadding > kPageSize)
+        return false;
+      if (shelfX + w + kPadding > kPageSize)
+      {
+        shelfX = 0;
+        shelfY += shelfH;
+        shelfH = 0;
+      }
+      if (pages.empty() || shelfY + h + kPadding > kPageSize)
+      {
+        SDL_Texture* page = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ARGB8888, SDL_TEXTUREACCESS_STATIC, kPageSize, kPageSize);
+        if (!page)
+          return false;
+        SDL_SetTextureBlendMode(page, SDL_BLENDMODE_BLEND);
+        pages.push_back(page);
+        shelfX = shelfY = shelfH = 0;
+      }
+      rect = { shelfX, shelfY, w, h };
+      shelfX += w + kPadding;
+      shelfH = std::max(shelfH, h + kPadding);
+      return true;
+    }
+
+    const Glyph& glyph(TTF_Font* font, std::unordered_map<Uint32, Glyph>& cache, Uint32 ch)
+    {
+      auto it = cache.find(ch);
+      if (it != cache.end())
+        return it->second;
+
+      Glyph& g = cache[ch];
+      int minx = 0, maxx = 0, miny, maxy = 0, advance = 0;
+#if SDL_TTF_VERSION_ATLEAST(2, 0, 18)
+      TTF_GlyphMetrics32(font, ch, &minx, &maxx, &miny, &maxy, &advance);
+      SDL_Surface* surface = TTF_RenderGlyph32_Blended(font, ch, SDL_Color{ 255, 255, 255, 255 });
+#else
+      TTF_GlyphMetrics(font, (Uint16)ch, &minx, &maxx, &miny, &maxy, &advance);
+      SDL_Surface* surface = TTF_RenderGlyph_Blended(font, (Uint16)ch, SDL_Color{ 255, 255, 255, 255 });
+#endif
+      g.advance = advance;
+      g.left = minx;
+      g.right = maxx;
+      g.dx = std::min(minx, 0);
+      g.dy = -std::max(maxy - TTF_FontAscent(font), 0);
+      if (!surface)
+        return g;
+
+      SDL_Surface* argb = surface->format->format == SDL_PIXELFORMAT_ARGB8888
+                            ? surface : SDL_ConvertSurfaceFormat(surface, SDL_PIXELFORMAT_ARGB8888, 0);
+      if (argb && place(argb->w, argb->h, g.src))
+      {
+        g.page = pages.back();
+        SDL_UpdateTexture(g.page, &g.src, argb->pixels, argb->pitch);
+      }
+      if (argb != surface)
+        SDL_FreeSurface(argb);
+      SDL_FreeSurface(surface);
+      return g;
+    }
+  };
+
+  std::map<SDL_Renderer*, GlyphAtlas> atlases;
+
+  std::vector<int> quadIndices;
+  std::vector<SDL_Vertex> vertexScratch;
+
+  void renderGlyphs(SDL_Renderer* renderer, const Texture& tx, float x, float y)
+  {
+    size_t nquads = tx.glyphPages.size();
+    if (quadIndices.size() < nquads * 6)
+    {
+      size_t first = quadIndices.size() / 6;
+      for (size_t q = first; q < nquads; q++)
+      {
+        int v = (int)q * 4;
+        quadIndices.insert(quadIndices.end(), { v, v + 1, v + 2, v + 2, v + 1, v + 3 });
+      }
+    }
+
+    vertexScratch.assign(tx.glyphs.begin(), tx.glyphs.end());
+    for (auto& v : vertexScratch)
+    {
+      v.position.x += x;
+      v.position.y += y;
+      v.color.a = (Uint8)(v.color.a * tx.alpha / 255);
+    }
+
+    // One call per run of quads on the same page.
+    for (size_t q = 0; q < nquads;)
+    {
+      size_t end = q + 1;
+      while (end < nquads && tx.glyphPages[end] == tx.glyphPages[q])
+        end++;
+      SDL_RenderGeometry(renderer, tx.glyphPages[q], &vertexScratch[q * 4], (int)(end - q) * 4,
+                         quadIndices.data(), (int)(end - q) * 6);
+      q = end;
+    }
+  }
+#endif
 }
 
 Theme::Theme(SDL_Renderer *ctx) {
@@ -77,78 +501,184 @@ Theme::Theme(SDL_Renderer *ctx) {
     TTF_Init();
 }
 
-TTF_Font* getFont(const char* fontname, size_t ptsize)
+FontId Theme::fontId(const char* fontname, size_t ptsize)
 {
-  std::string fullFontName = fontname;
-  fullFontName += "_";
-  fullFontName += std::to_string(ptsize);
-
-  TTF_Font* font = nullptr;
-  auto fontIt = internal::fonts.find(fullFontName);
-  if (fontIt == internal::fonts.end())
+  internal::FontFamily* family = nullptr;
+  for (auto& f : internal::families)
   {
-    SDL_RWops* rw = nullptr;
-    std::string tmpFontname = fontname;
-    if (tmpFontname == "sans")
-      rw = SDL_RWFromMem(roboto_regular_ttf, roboto_regular_ttf_size);
-    else if (tmpFontname == "sans-bold")
-      rw = SDL_RWFromMem(roboto_bold_ttf, roboto_bold_ttf_size);
-    else if (tmpFontname == "icons")
-      rw = SDL_RWFromMem(entypo_ttf, entypo_ttf_size);
-
-    TTF_Font* newFont = TTF_OpenFontRW(rw, false, ptsize);
-    internal::fonts[fullFontName] = newFont;
-    font = newFont;
+    if (f.name == fontname)
+    {
+      family = &f;
+      break;
+    }
   }
-  else
+  if (!family)
   {
-    font = fontIt->second;
+    internal::families.push_back({ fontname, {} });
+    family = &internal::families.back();
   }
 
-  return font;
+  if (family->sizes.size() <= ptsize)
+    family->sizes.resize(ptsize + 1, kInvalidFont);
+  if (family->sizes[ptsize] != kInvalidFont)
+    return family->sizes[ptsize];
+
+  SDL_RWops* rw = nullptr;
+  if (family->name == "sans")
+    rw = SDL_RWFromMem(roboto_regular_ttf, roboto_regular_ttf_size);
+  else if (family->name == "sans-bold")
+    rw = SDL_RWFromMem(roboto_bold_ttf, roboto_bold_ttf_size);
+  else if (family->name == "icons")
+    rw = SDL_RWFromMem(entypo_ttf, entypo_ttf_size);
+
+  family->sizes[ptsize] = (FontId)internal::fonts.size();
+  internal::fonts.push_back(TTF_OpenFontRW(rw, false, ptsize));
+  return family->sizes[ptsize];
+}
+
+static TTF_Font* getFont(FontId font)
+{
+  return font >= 0 && font < (FontId)internal::fonts.size() ? internal::fonts[font] : nullptr;
 }
 
 int Theme::getTextBounds(const char* fontname, size_t ptsize, const char* text, int *w, int *h)
 {
-  TTF_Font* font = getFont(fontname, ptsize);
+  return getTextBounds(fontId(fontname, ptsize), text, w, h);
+}
+
+int Theme::getTextBounds(FontId fontId, const char* text, int *w, int *h)
+{
+  TTF_Font* font = getFont(fontId);
 
   if (!font)
     return -1;
 
-  TTF_SizeText(font, text, w, h);  
+  internal::textExtents.extent(font, fontId, false, text, w, h);
   return 0;
 }
 
 int Theme::getUtf8Bounds(const char* fontname, size_t ptsize, const char* text, int *w, int *h)
 {
-  TTF_Font* font = getFont(fontname, ptsize);
+  return getUtf8Bounds(fontId(fontname, ptsize), text, w, h);
+}
+
+int Theme::getUtf8Bounds(FontId fontId, const char* text, int *w, int *h)
+{
+  TTF_Font* font = getFont(fontId);
 
   if (!font)
     return -1;
 
-  TTF_SizeUTF8(font, text, w, h);
+  internal::textExtents.extent(font, fontId, true, text, w, h);
   return 0;
 }
 
 int Theme::getTextWidth(const char* fontname, size_t ptsize, const char* text)
+{
+  return getTextWidth(fontId(fontname, ptsize), text);
+}
+
+int Theme::getTextWidth(FontId fontId, const char* text)
 {
   int w, h;
-  getTextBounds(fontname, ptsize, text, &w, &h);
+  getTextBounds(fontId, text, &w, &h);
   return w;
 }
 
 int Theme::getUtf8Width(const char* fontname, size_t ptsize, const char* text)
 {
-  TTF_Font* font = getFont(fontname, ptsize);
-
-  if (!font)
-    return -1;
+  return getUtf8Width(fontId(fontname, ptsize), text);
+}
 
+int Theme::getUtf8Width(FontId fontId, const char* text)
+{
   int w, h;
-  TTF_SizeUTF8(font, text, &w, &h);
+  if (getUtf8Bounds(fontId, text, &w, &h) != 0)
+    return -1;
   return w;
 }
 
+int Theme::fontHeight(FontId fontId)
+{
+  TTF_Font* font = getFont(fontId);
+  return font ? TTF_FontHeight(font) : 0;
+}
+
+void Theme::getUtf8Offsets(FontId fontId, const std::string& text, size_t from, std::vector<float>& offsets)
+{
+  offsets.resize(text.size() + 1);
+  from = std::min(from, text.size());
+
+  // Restart at the code point before the first changed one, its kerning
+  // with the changed text may differ.
+  while (from > 0 && from < text.size() && (text[from] & 0xc0) == 0x80)
+    from--;
+  size_t start = from;
+  if (start > 0)
+  {
+    start--;
+    while (start > 0 && (text[start] & 0xc0) == 0x80)
+      start--;
+  }
+
+  // The offsets are the pen positions the text is drawn at, moved by the
+  // row's xstart. Only a glyph overhanging left of the origin makes that
+  // nonzero, the prefix is kept only if none did. The kept glyphs' right
+  // edges are taken to end by the pen of the first glyph laid out again.
+  if (start > 0 && offsets[0] != 0.0f)
+    start = 0;
+
+  TTF_Font* font = getFont(fontId);
+  internal::RowLayout row;
+  row.pen = row.right = start > 0 ? (int)offsets[start] : 0;
+  for (size_t i = start; i < text.size();)
+  {
+    const char* p = text.c_str() + i;
+    Uint32 ch = internal::nextUtf8(p);
+    size_t next = std::min((size_t)(p - text.c_str()), text.size());
+
+    int pen = 0;
+    if (font)
+    {
+      int left, right;
+      int advance = internal::glyphAdvance(font, ch, &left, &right);
+      pen = row.add(font, ch, left, advance, right);
+    }
+
+    for (; i < next; i++)
+      offsets[i] = (float)pen;
+  }
+  if (row.xstart > 0)
+    for (size_t i = 0; i < text.size(); i++)
+      offsets[i] += row.xstart;
+
+  // The end of the text is the right edge of its box, past the last
+  // glyph's advance when it overhangs it.
+  offsets[text.size()] = (float)row.width();
+}
+
+size_t Theme::textCacheHits() const
+{
+  return internal::textExtents.hits;
+}
+
+size_t Theme::textCacheMisses() const
+{
+  return internal::textExtents.misses;
+}
+
+void Theme::releaseRenderer(SDL_Renderer* renderer)
+{
+#ifdef SDLGUI_GLYPH_ATLAS
+  auto it = internal::atlases.find(renderer);
+  if (it == internal::atlases.end())
+    return;
+  for (SDL_Texture* page : it->second.pages)
+    SDL_DestroyTexture(page);
+  internal::atlases.erase(it);
+#endif
+}
+
 
 void Theme::getTexAndRect(SDL_Renderer *renderer, int x, int y, const char *text,
                            const char* fontname, size_t ptsize, SDL_Texture **texture, SDL_Rect *rect, SDL_Color *textColor)
@@ -161,7 +691,7 @@ void Theme::getTexAndRect(SDL_Renderer *renderer, int x, int y, const char *text
 
   SDL_Color defColor{ 255,255,255,0 };
 
-  TTF_Font* font = getFont(fontname, ptsize);
+  TTF_Font* font = getFont(fontId(fontname, ptsize));
 
   if (!font)
     return;
@@ -190,6 +720,12 @@ void Theme::getTexAndRect(SDL_Renderer *renderer, int x, int y, const char *text
 
 void Theme::getTexAndRectUtf8(SDL_Renderer *renderer, int x, int y, const char *text,
   const char* fontname, size_t ptsize, SDL_Texture **texture, SDL_Rect *rect, SDL_Color *textColor)
+{
+  getTexAndRectUtf8(renderer, x, y, text, fontId(fontname, ptsize), texture, rect, textColor);
+}
+
+void Theme::getTexAndRectUtf8(SDL_Renderer *renderer, int x, int y, const char *text,
+  FontId fontId, SDL_Texture **texture, SDL_Rect *rect, SDL_Color *textColor)
 {
   int text_width;
   int text_height;
@@ -199,7 +735,7 @@ void Theme::getTexAndRectUtf8(SDL_Renderer *renderer, int x, int y, const char *
 
   SDL_Color defColor{ 255,255,255,0 };
 
-  TTF_Font* font = getFont(fontname, ptsize);
+  TTF_Font* font = getFont(fontId);
 
   if (!font)
     return;
@@ -227,23 +763,109 @@ void Theme::getTexAndRectUtf8(SDL_Renderer *renderer, int x, int y, const char *
 
 std::string Theme::breakText(SDL_Renderer* renderer, const char* string, const char* fontname, int ptsize, float breakRowWidth)
 {
-  std::string _string(string);
-  for (int i = 0; i < _string.size(); i++)
-  {
-    int slen = getTextWidth(fontname, ptsize, _string.substr(0, i).c_str());
-    if (slen >= breakRowWidth)
-      return _string.substr(0, i);
-  }
+  return breakText(renderer, string, fontId(fontname, ptsize), breakRowWidth);
+}
 
-  return string;
+std::string Theme::breakText(SDL_Renderer* renderer, const char* string, FontId fontId, float breakRowWidth)
+{
+  const std::vector<TextRow>& rows = breakLines(fontId, string, breakRowWidth, TextBreak::Char);
+  return rows.empty() ? std::string(string) : std::string(string, rows.front().end);
+}
+
+const std::vector<TextRow>& Theme::breakLines(FontId fontId, const char* text, float width, TextBreak mode)
+{
+  static const std::vector<TextRow> none;
+  TTF_Font* font = getFont(fontId);
+  if (!font || !text)
+    return none;
+  return internal::lineBreaks.rows(font, fontId, text, width, mode);
 }
 
 void Theme::getTexAndRectUtf8(SDL_Renderer *renderer, Texture& tx, int x, int y, const char *text,
   const char* fontname, size_t ptsize, const Color& textColor)
+{
+  getTexAndRectUtf8(renderer, tx, x, y, text, fontId(fontname, ptsize), textColor);
+}
+
+void Theme::getTexAndRectUtf8(SDL_Renderer *renderer, Texture& tx, int x, int y, const char *text,
+  FontId fontId, const Color& textColor)
 {
   tx.dirty = false;
   SDL_Color tColor = textColor.toSdlColor();
-  getTexAndRectUtf8(renderer, 0, 0, text, fontname, ptsize, &tx.tex, &tx.rrect, &tColor);
+#ifdef SDLGUI_GLYPH_ATLAS
+  // Lays the string out as quads on the atlas pages, only glyphs not seen
+  // before in this font and size are rasterized.
+  tx.tex = nullptr;
+  tx.glyphs.clear();
+  tx.glyphPages.clear();
+  tx.rrect = { 0, 0, 0, 0 };
+
+  TTF_Font* font = getFont(fontId);
+  if (!font || !text || !*text)
+    return;
+
+  internal::GlyphAtlas& atlas = internal::atlases[renderer];
+  atlas.renderer = renderer;
+  auto& cache = atlas.glyphs[font];
+
+  // TTF_RenderUTF8_Blended treats a transparent color as opaque.
+  if (tColor.a == 0)
+    tColor.a = 255;
+
+  // Lay the string out first. Like TTF_RenderUTF8_Blended, the whole row
+  // moves right by what sticks out left of the first pen position and down
+  // by what rises over the ascent, so its box is the one of TTF_SizeUTF8.
+  struct Placed
+  {
+    const internal::GlyphAtlas::Glyph* glyph;
+    int pen;
+  };
+  std::vector<Placed> placed;
+  internal::RowLayout row;
+  int ystart = 0;
+  for (const char* p = text; *p;)
+  {
+    Uint32 ch = internal::nextUtf8(p);
+    const internal::GlyphAtlas::Glyph& g = atlas.glyph(font, cache, ch);
+    placed.push_back({ &g, row.add(font, ch, g.left, g.advance, g.right) });
+    ystart = std::max(ystart, -g.dy);
+  }
+
+  const float kPage = (float)internal::GlyphAtlas::kPageSize;
+  for (const Placed& pg : placed)
+  {
+    const internal::GlyphAtlas::Glyph& g = *pg.glyph;
+    if (!g.page)
+      continue;
+    float x0 = (float)(row.xstart + pg.pen + g.dx), y0 = (float)(ystart + g.dy);
+    float x1 = x0 + g.src.w, y1 = y0 + g.src.h;
+    float s0 = g.src.x / kPage, t0 = g.src.y / kPage;
+    float s1 = (g.src.x + g.src.w) / kPage, t1 = (g.src.y + g.src.h) / kPage;
+    tx.glyphs.push_back({ { x0, y0 }, tColor, { s0, t0 } });
+    tx.glyphs.push_back({ { x1, y0 }, tColor, { s1, t0 } });
+    tx.glyphs.push_back({ { x0, y1 }, tColor, { s0, t1 } });
+    tx.glyphs.push_back({ { x1, y1 }, tColor, { s1, t1 } });
+    tx.glyphPages.push_back(g.page);
+  }
+
+  if (tx.glyphPages.empty())
+    return;
+  tx.tex = tx.glyphPages.front();
+  getUtf8Bounds(fontId, text, &tx.rrect.w, &tx.rrect.h);
+#else
+  getTexAndRectUtf8(renderer, 0, 0, text, fontId, &tx.tex, &tx.rrect, &tColor);
+#endif
+}
+
+void SDL_SetTextureAlphaMod(Texture& tx, Uint8 alpha)
+{
+  tx.alpha = alpha;
+#ifdef SDLGUI_GLYPH_ATLAS
+  if (!tx.glyphs.empty())
+    return;
+#endif
+  if (tx.tex)
+    SDL_SetTextureAlphaMod(tx.tex, alpha);
 }
 
 void SDL_RenderCopy(SDL_Renderer* renderer, Texture& tx, const Vector2i& pos)
@@ -251,6 +873,14 @@ void SDL_RenderCopy(SDL_Renderer* renderer, Texture& tx, const Vector2i& pos)
   if (!tx.tex)
     return;
 
+#ifdef SDLGUI_GLYPH_ATLAS
+  if (!tx.glyphs.empty())
+  {
+    internal::renderGlyphs(renderer, tx, (float)pos.x, (float)pos.y);
+    return;
+  }
+#endif
+
   SDL_Rect rect{ pos.x, pos.y, tx.rrect.w, tx.rrect.h };
   SDL_RenderCopy(renderer, tx.tex, nullptr, &rect);
 }
@@ -260,6 +890,14 @@ void SDL_RenderCopyF(SDL_Renderer* renderer, Texture& tx, const Vector2f& pos)
   if (!tx.tex)
     return;
 
+#ifdef SDLGUI_GLYPH_ATLAS
+  if (!tx.glyphs.empty())
+  {
+    internal::renderGlyphs(renderer, tx, pos.x, pos.y);
+    return;
+  }
+#endif
+
   SDL_FRect rect{ pos.x, pos.y, tx.rrect.w, tx.rrect.h };
   SDL_RenderCopyF(renderer, tx.tex, nullptr, &rect);
 }
@@ -19,6 +19,13 @@ struct SDL_Renderer;
 struct SDL_Texture;
 struct SDL_Rect;
 
+// Text is drawn from glyph atlas pages shared by all strings when the build
+// asks for it and the renderer can draw geometry, with a texture per string
+// otherwise. tests/theme_text.cpp checks both draw the same pixels.
+#if defined(SDLGUI_USE_GLYPH_ATLAS) && SDL_VERSION_ATLEAST(2, 0, 18)
+#define SDLGUI_GLYPH_ATLAS
+#endif
+
 NAMESPACE_BEGIN(sdlgui)
 
 struct Texture
@@ -26,13 +33,41 @@ struct Texture
   SDL_Texture* tex = nullptr;
   SDL_Rect rrect;
   bool dirty = false;
+  Uint8 alpha = 255;
+
+#ifdef SDLGUI_GLYPH_ATLAS
+  // Glyph quads of text, relative to the top left corner. tex is then the
+  // atlas page of the first glyph and not owned.
+  std::vector<SDL_Vertex> glyphs;
+  std::vector<SDL_Texture*> glyphPages;
+#endif
 
   inline int w() const { return rrect.w; }
   inline int h() const { return rrect.h; }
 };
 
+/// Handle of a loaded font at one point size, see Theme::fontId().
+typedef int FontId;
+const FontId kInvalidFont = -1;
+
+/// How Theme::breakLines() fits text into a width.
+enum class TextBreak
+{
+  Word,     ///< At spaces, inside a word only when it is wider than a row.
+  Char,     ///< Before the first character that does not fit.
+  Ellipsis  ///< A single row, cut where it still fits with "..." appended.
+};
+
+/// Bytes [begin, end) of broken text making up one row, and their width.
+struct TextRow
+{
+  size_t begin, end;
+  int width;
+};
+
 void SDL_RenderCopy(SDL_Renderer* renderer, Texture& tex, const Vector2i& pos);
 void SDL_RenderCopyF(SDL_Renderer* renderer, Texture& tex, const Vector2f& pos);
+void SDL_SetTextureAlphaMod(Texture& tex, Uint8 alpha);
 /**
  * \class Theme theme.h sdlgui/theme.h
  *
@@ -97,22 +132,61 @@ public:
     Color mWindowPopup;
     Color mWindowPopupTransparent;
 
+    /// Interns a font name and size, loading the font the first time. Widgets
+    /// that measure or draw often should resolve the handle once and pass it
+    /// to the FontId overloads below.
+    FontId fontId(const char* fontname, size_t ptsize);
+
     void getTexAndRect(SDL_Renderer *renderer, int x, int y, const char *text,
       const char* fontname, size_t ptsize, SDL_Texture **texture, SDL_Rect *rect, SDL_Color *textColor);
 
     void getTexAndRectUtf8(SDL_Renderer *renderer, int x, int y, const char *text,
       const char* fontname, size_t ptsize, SDL_Texture **texture, SDL_Rect *rect, SDL_Color *textColor);
+    void getTexAndRectUtf8(SDL_Renderer *renderer, int x, int y, const char *text,
+      FontId font, SDL_Texture **texture, SDL_Rect *rect, SDL_Color *textColor);
 
     std::string breakText(SDL_Renderer* renderer, const char* string, const char* fontname, int ptsize,
                        float breakRowWidth);
+    std::string breakText(SDL_Renderer* renderer, const char* string, FontId font, float breakRowWidth);
+
+    /// Splits text into rows no wider than width, at newlines and where mode
+    /// allows. Results are cached per font, mode, width and string, and the
+    /// reference stays valid until the next call. In Ellipsis mode a row
+    /// ending before the text does needs "..." drawn after it.
+    const std::vector<TextRow>& breakLines(FontId font, const char* text, float width, TextBreak mode);
 
     int getTextWidth(const char* fontname, size_t ptsize, const char* text);
     int getUtf8Width(const char* fontname, size_t ptsize, const char* text);
     int getTextBounds(const char* fontname, size_t ptsize, const char* text, int *w, int *h);
     int getUtf8Bounds(const char* fontname, size_t ptsize, const char* text, int *w, int *h);
+    int getTextWidth(FontId font, const char* text);
+    int getUtf8Width(FontId font, const char* text);
+    int getTextBounds(FontId font, const char* text, int *w, int *h);
+    int getUtf8Bounds(FontId font, const char* text, int *w, int *h);
+    /// Height of a row of text in font, 0 when it is not loaded.
+    int fontHeight(FontId font);
+
+    /// Fills offsets[i] with the caret offset before byte i of text, one entry
+    /// per byte plus the end, where the end is the TTF_SizeUTF8 width. Entries
+    /// before byte from are assumed to still be valid for text and are kept,
+    /// so an edit only re-measures what follows. The offsets come from the
+    /// glyph layout text is drawn with.
+    void getUtf8Offsets(FontId font, const std::string& text, size_t from, std::vector<float>& offsets);
+
+    /// Lookups served from and missed by the cache of measured strings,
+    /// which all the width and bounds queries above go through.
+    size_t textCacheHits() const;
+    size_t textCacheMisses() const;
+
+    /// Destroys the glyph atlas pages made for renderer, texts drawn with it
+    /// must be rebuilt afterwards. Call it before destroying the renderer,
+    /// Screen does so when it is deleted.
+    void releaseRenderer(SDL_Renderer* renderer);
 
     void getTexAndRectUtf8(SDL_Renderer *renderer, Texture& tx, int x, int y, const char *text,
                            const char* fontname, size_t ptsize, const Color& textColor);
+    void getTexAndRectUtf8(SDL_Renderer *renderer, Texture& tx, int x, int y, const char *text,
+                           FontId font, const Color& textColor);
 
 protected:
     virtual ~Theme() { };
@@ -23,12 +23,92 @@
 
 NAMESPACE_BEGIN(sdlgui)
 
+// Idle RT contexts kept for reuse, keyed by surface size class. Creating a
+// context allocates its vertex and fontstash buffers, reusing one only binds
+// it to the caller's pixels.
+struct RTContextPool
+{
+  struct Entry
+  {
+    int cw, ch;
+    NVGcontext* ctx;
+  };
+
+  enum { kMinClass = 32, kMaxIdlePerClass = 8 };
+
+  std::mutex mutex;
+  std::vector<Entry> idle;
+
+  static int sizeClass(int v)
+  {
+    int c = kMinClass;
+    while (c < v)
+      c <<= 1;
+    return c;
+  }
+
+  NVGcontext* acquire(unsigned char* pixels, int w, int h)
+  {
+    int cw = sizeClass(w), ch = sizeClass(h);
+    NVGcontext* ctx = nullptr;
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      for (size_t i = 0; i < idle.size(); i++)
+      {
+        if (idle[i].cw == cw && idle[i].ch == ch)
+        {
+          ctx = idle[i].ctx;
+          idle.erase(idle.begin() + i);
+          break;
+        }
+      }
+    }
+
+    if (!ctx)
+      ctx = nvgCreateRT(NVG_DEBUG | NVG_SCANLINE, w, h);
+    if (ctx && nvgBindPixelsRT(ctx, pixels, w, h, w * 4))
+      return ctx;
+    if (ctx)
+      nvgDeleteRT(ctx);
+    return nullptr;
+  }
+
+  void release(NVGcontext* ctx, int w, int h)
+  {
+    int cw = sizeClass(w), ch = sizeClass(h);
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      int count = 0;
+      for (auto& e : idle)
+        count += (e.cw == cw && e.ch == ch) ? 1 : 0;
+      if (count < kMaxIdlePerClass)
+      {
+        idle.push_back({ cw, ch, ctx });
+        return;
+      }
+    }
+    nvgDeleteRT(ctx);
+  }
+};
+
+// Detached loader threads may still hold contexts at exit, so the pool is
+// never destroyed.
+static RTContextPool& rtContextPool()
+{
+  static RTContextPool* pool = new RTContextPool;
+  return *pool;
+}
+
 struct vgButton::AsyncTexture
 {
   int id;
-  static std::mutex i_mutex;
 	Texture tex;
-  NVGcontext* ctx = nullptr;
+
+  // Pixels handed over by the loader thread once the frame is drawn.
+  std::mutex mutex;
+  std::vector<unsigned char> frame;
+  bool ready = false;
+  int width = 0, height = 0;
 
   AsyncTexture(int _id) : id(_id) {};
 
@@ -39,11 +119,14 @@ struct vgButton::AsyncTexture
     std::thread tgr([=]() {
       Theme* theme = button->theme();
       Color backgroundColor = button->backgroundColor();
-      std::lock_guard<std::mutex> guard(i_mutex);
 
       int ww = button->width();
       int hh = button->height();
-      NVGcontext *ctx = nvgCreateRT(NVG_DEBUG, ww+2, hh+2);
+      // Rasterized straight into the buffer perform() uploads from.
+      std::vector<unsigned char> pixels((ww+2) * (hh+2) * 4);
+      NVGcontext *ctx = rtContextPool().acquire(pixels.data(), ww+2, hh+2);
+      if (!ctx)
+        return;
 
       float pxRatio = 1.0f;
       nvgClearBackgroundRT(ctx, 0, 0, 0, 0.0f);
@@ -99,8 +182,15 @@ struct vgButton::AsyncTexture
       nvgStroke(ctx);
 
       nvgEndFrame(ctx);
-      self->tex.rrect = { 0, 0, ww+2, hh+2 };
-      self->ctx = ctx;
+      rtContextPool().release(ctx, ww+2, hh+2);
+
+      std::lock_guard<std::mutex> guard(self->mutex);
+      if (self->ready)
+        return;  // An earlier frame is still waiting for perform(), keep that one.
+      self->width = ww+2;
+      self->height = hh+2;
+      self->frame.swap(pixels);
+      self->ready = true;
     });
 
     tgr.detach();
@@ -108,27 +198,25 @@ struct vgButton::AsyncTexture
 
   void perform(SDL_Renderer* renderer)
   {
-    if (!ctx)
-      return;
-
-    unsigned char *rgba = nvgReadPixelsRT(ctx);
-
-    tex.tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STREAMING, tex.w(), tex.h());
+    std::vector<unsigned char> pixels;
+    {
+      std::lock_guard<std::mutex> guard(mutex);
+      if (!ready)
+        return;
+      pixels.swap(frame);
+      ready = false;
+      tex.rrect = { 0, 0, width, height };
+    }
 
-    int pitch;
-    uint8_t *pixels;
-    int ok = SDL_LockTexture(tex.tex, nullptr, (void **)&pixels, &pitch);
-    memcpy(pixels, rgba, sizeof(uint32_t) * tex.w() * tex.h());
+    if (tex.tex)
+      SDL_DestroyTexture(tex.tex);
+    tex.tex = SDL_CreateTexture(renderer, SDL_PIXELFORMAT_ABGR8888, SDL_TEXTUREACCESS_STATIC, tex.w(), tex.h());
+    // The rasterized pixels go to the texture as they are, no staging copy.
+    SDL_UpdateTexture(tex.tex, nullptr, pixels.data(), tex.w() * 4);
     SDL_SetTextureBlendMode(tex.tex, SDL_BLENDMODE_BLEND);
-    SDL_UnlockTexture(tex.tex);
-
-    nvgDeleteRT(ctx);
-    ctx = nullptr;
   }
 };
 
-std::mutex vgButton::AsyncTexture::i_mutex;
-
 vgButton::vgButton(Widget *parent, const std::string &caption, int icon)
 	: Button(parent, caption, icon) 
 {
@@ -19,9 +19,16 @@ NAMESPACE_BEGIN(sdlgui)
 Window::Window(Widget *parent, const std::string &title)
     : Widget(parent), mTitle(title), mButtonPanel(nullptr), mModal(false), mDrag(false) 
 {
+  mTitleFont = mTheme ? mTheme->fontId("sans-bold", 18) : kInvalidFont;
   _titleTex.dirty = true;
 }
 
+void Window::setTheme(Theme *theme)
+{
+  Widget::setTheme(theme);
+  mTitleFont = mTheme ? mTheme->fontId("sans-bold", 18) : kInvalidFont;
+}
+
 Vector2i Window::preferredSize(SDL_Renderer *ctx) const
 {
     if (mButtonPanel)
@@ -31,7 +38,7 @@ Vector2i Window::preferredSize(SDL_Renderer *ctx) const
         mButtonPanel->setVisible(true);
 
     int w, h;
-    const_cast<Window*>(this)->mTheme->getTextBounds("sans-bold", 18.0, mTitle.c_str(), &w, &h);
+    const_cast<Window*>(this)->mTheme->getTextBounds(mTitleFont, mTitle.c_str(), &w, &h);
 
     return result.cmax(Vector2i(w + 20, h));
 }
@@ -93,7 +100,7 @@ void Window::draw(SDL_Renderer* renderer)
   if (_titleTex.dirty)
   {
     Color titleTextColor = (mFocused ? mTheme->mWindowTitleFocused : mTheme->mWindowTitleUnfocused);
-    mTheme->getTexAndRectUtf8(renderer, _titleTex, 0, 0, mTitle.c_str(), "sans-bold", 18, titleTextColor);
+    mTheme->getTexAndRectUtf8(renderer, _titleTex, 0, 0, mTitle.c_str(), mTitleFont, titleTextColor);
   }
 
   SDL_FRect wndBdRect{ getAbsoluteLeft() - 1.5f, getAbsoluteTop() - 1.5f, width() + 3.5f, height() + 3.5f };
@@ -63,6 +63,9 @@ public:
     /// Handle a focus change event (default implementation: record the focus status, but do nothing)
     bool focusEvent(bool focused);
 
+    /// Set the \ref Theme used to draw this window and its title
+    void setTheme(Theme *theme) override;
+
 protected:
     /// Internal helper function to maintain nested window position values; overridden in \ref Popup
     void refreshRelativePlacement();
@@ -71,6 +74,7 @@ protected:
     std::string mTitle;
     Widget *mButtonPanel;
 
+    FontId mTitleFont = kInvalidFont;
     Texture _titleTex;
 
     bool mModal;
@@ -0,0 +1,116 @@
+/*
+    tests/fontatlas_threads.cpp -- Two RT contexts drawing text from their
+    own threads through one shared font atlas
+
+    All rights reserved. Use of this source code is governed by a
+    BSD-style license that can be found in the LICENSE.txt file.
+*/
+
+#include <sdlgui/nanovg.h>
+#define NANOVG_RT_IMPLEMENTATION
+#define NANORT_IMPLEMENTATION
+#include <sdlgui/nanovg_rt.h>
+#include <sdlgui/resources.h>
+#include <cstdio>
+#include <cstring>
+#include <thread>
+#include <vector>
+
+namespace
+{
+  const int kWidth = 256, kHeight = 64, kFrames = 40;
+
+  // Each thread writes its own strings, so both keep adding glyphs to the
+  // atlas while the other one draws.
+  void drawFrame(NVGcontext* ctx, int thread, int frame)
+  {
+    char text[64];
+    if (thread == 0)
+      snprintf(text, sizeof(text), "Frame %d: 0123456789", frame * 7919);
+    else
+      snprintf(text, sizeof(text), "%c%c%c quick brown fox", 'A' + frame % 26, 'a' + frame * 3 % 26, 'K' + frame % 16);
+
+    nvgClearBackgroundRT(ctx, 0, 0, 0, 0);
+    nvgBeginFrame(ctx, kWidth, kHeight, 1.0f);
+    nvgFontFace(ctx, "sans");
+    nvgFontSize(ctx, 14.0f + frame % 3 * 4.0f);
+    nvgFillColor(ctx, nvgRGBA(255, 255, 255, 255));
+
+    // Text box layout measures rows with nested font calls, which take the
+    // atlas lock again.
+    float bounds[4];
+    nvgTextBoxBounds(ctx, 4, 20, kWidth - 8, text, nullptr, bounds);
+    nvgTextBox(ctx, 4, 20, kWidth - 8, text, nullptr);
+    nvgEndFrame(ctx);
+  }
+
+  std::vector<unsigned char> pixels(NVGcontext* ctx)
+  {
+    const unsigned char* p = nvgReadPixelsRT(ctx);
+    int stride = nvgPixelStrideRT(ctx);
+    std::vector<unsigned char> out(kWidth * kHeight * 4);
+    for (int y = 0; y < kHeight; y++)
+      memcpy(&out[y * kWidth * 4], p + y * stride, kWidth * 4);
+    return out;
+  }
+}
+
+int main()
+{
+  // What each thread should get, drawn by contexts with their own fonts.
+  std::vector<std::vector<unsigned char>> expected[2];
+  for (int t = 0; t < 2; t++)
+  {
+    NVGcontext* ctx = nvgCreateRT(NVG_SCANLINE, kWidth, kHeight);
+    nvgCreateFontMem(ctx, "sans", roboto_regular_ttf, roboto_regular_ttf_size, 0);
+    for (int f = 0; f < kFrames; f++)
+    {
+      drawFrame(ctx, t, f);
+      expected[t].push_back(pixels(ctx));
+    }
+    nvgDeleteRT(ctx);
+    if (expected[t][0] == std::vector<unsigned char>(kWidth * kHeight * 4, 0))
+    {
+      printf("no text drawn\n");
+      return 1;
+    }
+  }
+
+  NVGfontAtlas* atlas = nvgCreateFontAtlas();
+  NVGcontext* ctx[2];
+  for (int t = 0; t < 2; t++)
+  {
+    ctx[t] = nvgCreateRT(NVG_SCANLINE, kWidth, kHeight);
+    if (!atlas || !ctx[t] || !nvgShareFontAtlas(ctx[t], atlas))
+    {
+      printf("could not share the font atlas\n");
+      return 1;
+    }
+  }
+  nvgDeleteFontAtlas(atlas);
+  // Added through one context, the font is there for both.
+  nvgCreateFontMem(ctx[0], "sans", roboto_regular_ttf, roboto_regular_ttf_size, 0);
+
+  int mismatches[2] = { 0, 0 };
+  std::vector<std::thread> threads;
+  for (int t = 0; t < 2; t++)
+  {
+    threads.emplace_back([&, t]() {
+      for (int f = 0; f < kFrames; f++)
+      {
+        drawFrame(ctx[t], t, f);
+        if (pixels(ctx[t]) != expected[t][f])
+          mismatches[t]++;
+      }
+    });
+  }
+  for (auto& thread : threads)
+    thread.join();
+
+  for (int t = 0; t < 2; t++)
+    nvgDeleteRT(ctx[t]);
+
+  printf("thread 0: %d of %d frames differ, thread 1: %d of %d frames differ\n",
+         mismatches[0], kFrames, mismatches[1], kFrames);
+  return mismatches[0] + mismatches[1] == 0 ? 0 : 1;
+}
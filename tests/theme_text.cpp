@@ -0,0 +1,156 @@
+/*
+    tests/theme_text.cpp -- Text drawn by Theme into a Texture against the
+    texture TTF_RenderUTF8_Blended makes of the whole string, and caret
+    offsets against the width TTF_SizeUTF8 gives it
+
+    All rights reserved. Use of this source code is governed by a
+    BSD-style license that can be found in the LICENSE.txt file.
+*/
+
+#include <sdlgui/theme.h>
+#include <cstdio>
+#include <cstdlib>
+#include <string>
+#include <vector>
+
+using namespace sdlgui;
+
+namespace
+{
+  const int kWidth = 640, kHeight = 64;
+  const Vector2i kPos(7, 5);
+  // RenderCopy and RenderGeometry may round the blend differently.
+  const int kTolerance = 2;
+
+  const char* kStrings[] = {
+    "Hello world", "AVATAR Wave To Ty", "jump quickly, fjord", "0123456789 +-*/",
+    "\xc3\x9c\x62\x65r \xc3\x85ngstr\xc3\xb6m \xc3\x89t\xc3\xa9", "   spaced   ", "T", "ij"
+  };
+  const char* kFonts[] = { "sans", "sans-bold" };
+  const int kSizes[] = { 12, 16, 20, 31 };
+
+  std::vector<Uint32> readPixels(SDL_Renderer* renderer)
+  {
+    std::vector<Uint32> pixels(kWidth * kHeight);
+    SDL_RenderReadPixels(renderer, nullptr, SDL_PIXELFORMAT_ARGB8888, pixels.data(), kWidth * 4);
+    return pixels;
+  }
+
+  void clear(SDL_Renderer* renderer)
+  {
+    SDL_SetRenderDrawColor(renderer, 43, 43, 43, 255);
+    SDL_RenderClear(renderer);
+  }
+
+  int maxDiff(Uint32 a, Uint32 b)
+  {
+    int d = 0;
+    for (int shift = 0; shift < 32; shift += 8)
+      d = std::max(d, std::abs((int)((a >> shift) & 0xff) - (int)((b >> shift) & 0xff)));
+    return d;
+  }
+}
+
+int main(int argc, char** argv)
+{
+  (void)argc;
+  (void)argv;
+
+  SDL_Init(0);
+  SDL_Surface* target = SDL_CreateRGBSurfaceWithFormat(0, kWidth, kHeight, 32, SDL_PIXELFORMAT_ARGB8888);
+  SDL_Renderer* renderer = target ? SDL_CreateSoftwareRenderer(target) : nullptr;
+  if (!renderer)
+  {
+    printf("no software renderer: %s\n", SDL_GetError());
+    return 1;
+  }
+
+  ref<Theme> theme = new Theme(renderer);
+  Color colors[] = { theme->mTextColor, Color(255, 192, 0, 255), Color(255, 255, 255, 0) };
+
+  int failures = 0, cases = 0;
+
+  // The caret after the last character sits at the right edge of the text,
+  // and offsets updated as the text is typed match the ones built at once.
+  std::vector<float> offsets, typed;
+  for (const char* fontname : kFonts)
+  for (int size : kSizes)
+  for (const char* text : kStrings)
+  {
+    cases++;
+    FontId font = theme->fontId(fontname, size);
+    std::string str(text);
+    theme->getUtf8Offsets(font, str, 0, offsets);
+    typed.clear();
+    for (size_t n = 1, last = 0; n <= str.size(); n++)
+    {
+      if (n < str.size() && (str[n] & 0xc0) == 0x80)
+        continue;
+      theme->getUtf8Offsets(font, str.substr(0, n), last, typed);
+      last = n;
+    }
+
+    int width = theme->getUtf8Width(font, text);
+    if (offsets.back() != (float)width || typed != offsets)
+    {
+      failures++;
+      printf("%s %d \"%s\": caret offsets end at %g, text is %d wide%s\n",
+             fontname, size, text, offsets.back(), width, typed != offsets ? ", typed offsets differ" : "");
+    }
+  }
+
+  for (const char* fontname : kFonts)
+  for (int size : kSizes)
+  for (const char* text : kStrings)
+  for (const Color& color : colors)
+  {
+    cases++;
+    FontId font = theme->fontId(fontname, size);
+
+    // The whole string rendered by SDL_ttf, as text was drawn before the atlas.
+    SDL_Texture* texture = nullptr;
+    SDL_Rect rect;
+    SDL_Color sdlColor = color.toSdlColor();
+    theme->getTexAndRectUtf8(renderer, kPos.x, kPos.y, text, font, &texture, &rect, &sdlColor);
+    clear(renderer);
+    if (texture)
+      SDL_RenderCopy(renderer, texture, nullptr, &rect);
+    std::vector<Uint32> expected = readPixels(renderer);
+    if (texture)
+      SDL_DestroyTexture(texture);
+
+    Texture tx;
+    theme->getTexAndRectUtf8(renderer, tx, 0, 0, text, font, color);
+    clear(renderer);
+    SDL_RenderCopy(renderer, tx, kPos);
+    std::vector<Uint32> actual = readPixels(renderer);
+
+    int worst = 0, worstX = 0, worstY = 0;
+    for (int i = 0; i < kWidth * kHeight; i++)
+    {
+      int d = maxDiff(expected[i], actual[i]);
+      if (d > worst)
+      {
+        worst = d;
+        worstX = i % kWidth;
+        worstY = i / kWidth;
+      }
+    }
+
+    bool sameBox = tx.w() == rect.w && tx.h() == rect.h;
+    if (!sameBox || worst > kTolerance)
+    {
+      failures++;
+      printf("%s %d \"%s\" alpha %d: box %dx%d, expected %dx%d, off by %d at %d,%d\n",
+             fontname, size, text, sdlColor.a, tx.w(), tx.h(), rect.w, rect.h, worst, worstX, worstY);
+    }
+  }
+
+  theme->releaseRenderer(renderer);
+  SDL_DestroyRenderer(renderer);
+  SDL_FreeSurface(target);
+  SDL_Quit();
+
+  printf("%d of %d strings differ\n", failures, cases);
+  return failures == 0 ? 0 : 1;
+}